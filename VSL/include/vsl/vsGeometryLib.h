@@ -5,6 +5,9 @@
  *
  * VSGeometryLib - Very Simple Geometry Library
  *
+ * \version 0.1.1
+ *		VSCartesian objects can be drawn in instanced batches
+ *
  * \version 0.1.0
  *		Initial Release
  *
@@ -47,12 +50,33 @@ class VSCartesian : public VSModelLib {
 public:
 	~VSCartesian();
 
+	/** Queues the object to be drawn by renderBatch, with the
+	  * current model matrix
+	*/
+	void addToBatch();
+
+	/** Draws the queued objects with one instanced call per
+	  * primitive type, and empties the queue. The shader must
+	  * apply instanceMatrix, and use instanceColor as the diffuse
+	  * color (see VSModelLib::setInstanceMatrices)
+	*/
+	static void renderBatch();
+
 protected:
 	static bool Init();
 	static bool sInit;
 
 	static VSSurfRevLib sCylinder, sCone, sSphere;
 
+	/// queued instances of a primitive
+	struct Batch {
+		std::vector<float> matrices;
+		std::vector<float> colors;
+	};
+	/// sphere, cone and cylinder
+	static Batch sBatches[3];
+	static VSSurfRevLib *sPrimitives[3];
+
 	VSCartesian();
 };
 
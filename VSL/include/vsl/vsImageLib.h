@@ -0,0 +1,186 @@
+/** ----------------------------------------------------------
+ * \class VSImageLib
+ *
+ * Lighthouse3D
+ *
+ * VSImageLib - Very Simple Image Library
+ *
+ * \version 0.1.1
+ *		Mip chains with Kaiser and sRGB correct filters, and alpha coverage
+ *		Textures are allocated with glTexStorage2D when available
+ *
+ * \version 0.1.0
+ *		Initial Release
+ *
+ * This lib provides CPU side image processing for textures:
+ * block compression (BC1, BC3, BC4, BC5 and BC7), mip chains,
+ * and DDS files to cache the results. Blocks are encoded on
+ * the threads of VSThreadLib. Only the upload functions issue
+ * OpenGL calls, the others can be called from any thread.
+ *
+ * This lib requires the following classes from VSL:
+ * (http://www.lighthouse3d.com/very-simple-libs)
+ *
+ * VSThreadLib
+ * VSMeshOptLib
+ *
+ * Full documentation at
+ * http://www.lighthouse3d.com/very-simple-libs
+ *
+ ---------------------------------------------------------------*/
+
+#ifndef __VSImageLib__
+#define __VSImageLib__
+
+#include <string>
+#include <vector>
+
+#ifdef __ANDROID_API__
+#include <GLES3/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+
+class VSImageLib {
+
+public:
+
+	enum Format {
+		/// 8 bits per channel, uncompressed
+		RGBA8,
+		/// RGB, 4 bits per pixel (DXT1)
+		BC1,
+		/// RGBA, 8 bits per pixel (DXT5)
+		BC3,
+		/// one channel, 4 bits per pixel
+		BC4,
+		/// two channels, 8 bits per pixel, for normal maps
+		BC5,
+		/// RGBA, 8 bits per pixel, better quality than BC3
+		BC7
+	};
+
+	/// one level of an image, rows from the bottom up as in OpenGL
+	struct Level {
+		unsigned int width, height;
+		std::vector<unsigned char> data;
+	};
+
+	/// an image with its mip chain, level zero is the largest
+	struct Image {
+		Format format;
+		std::vector<Level> levels;
+	};
+
+	/// returns the bytes taken by a level
+	static size_t getLevelSize(Format format, unsigned int width, unsigned int height);
+
+	/// returns true if all the pixels of an RGBA8 level are opaque
+	static bool isOpaque(const Level &level);
+
+	enum MipFilter {
+		/// average of 2x2 pixels
+		MIP_BOX,
+		/// Kaiser windowed sinc, 8x8 pixels, keeps more detail
+		MIP_KAISER
+	};
+
+	struct MipOptions {
+		MipFilter filter;
+		/// RGB is sRGB encoded, filtering is done in linear space
+		bool sRGB;
+		/** alpha test reference. The fraction of pixels passing
+		  * the test in level zero is kept in all levels, so that
+		  * cut outs do not fade with distance. Zero disables it
+		*/
+		float alphaCoverage;
+
+		MipOptions() {
+			filter = MIP_BOX;
+			sRGB = false;
+			alphaCoverage = 0.0f;
+		}
+	};
+
+	/** Replaces the levels of an RGBA8 image, after level zero,
+	  * with levels down to 1x1. Levels are computed from the
+	  * previous one in floating point, with rows split among the threads
+	  * \param maxThreads zero uses all hardware threads
+	*/
+	static void buildMipChain(Image &image, const MipOptions &options = MipOptions(),
+						unsigned int maxThreads = 0);
+
+	/// options used by loadRGBATexture for the mip chains
+	static void setMipOptions(const MipOptions &options);
+	static const MipOptions &getMipOptions();
+	/// a short description of the options, to use in cache keys
+	static std::string getMipOptionsTag(const MipOptions &options);
+
+	/** Compresses all the levels of an RGBA8 image. Blocks are
+	  * split among the threads. BC4 takes the red channel, and
+	  * BC5 the red and green channels. Other images, and RGBA8
+	  * targets, are copied with their own format
+	  * \param maxThreads zero uses all hardware threads
+	*/
+	static void compress(const Image &source, Format format, Image &result,
+						unsigned int maxThreads = 0);
+
+	/** Writes an image to a DDS file, with the DX10 header
+	  * \return false if the file could not be written
+	*/
+	static bool saveDDS(const std::string &filename, const Image &image);
+	/** Reads a DDS file written by saveDDS, or with the
+	  * DXT1, DXT5, ATI1 and ATI2 codes
+	  * \return false if the file is missing or the format is not supported
+	*/
+	static bool loadDDS(const std::string &filename, Image &image);
+
+	/** Sets the directory for the compressed textures cache.
+	  * An empty name, the default, disables the cache
+	*/
+	static void setCacheDirectory(const std::string &dir);
+	static const std::string &getCacheDirectory();
+	/** returns the cache file for a source image, keyed by the
+	  * contents of the source and the tag, or an empty string if
+	  * the cache is disabled
+	  * \param tag anything else the result depends on, such as the format
+	*/
+	static std::string getCacheFile(const void *source, size_t size, const std::string &tag);
+
+#ifndef __ANDROID_API__
+	/// returns the OpenGL internal format
+	static GLenum getGLFormat(Format format);
+	/// returns true if the context can sample the format
+	static bool isSupported(Format format);
+	/** uploads all the levels to the bound texture of a target
+	  * (GL_TEXTURE_2D or a cube map face). GL_TEXTURE_2D textures
+	  * are immutable, allocated with glTexStorage2D, when the
+	  * context supports it
+	*/
+	static void upload(GLenum target, const Image &image);
+#endif
+
+protected:
+
+	static std::string sCacheDirectory;
+	static MipOptions sMipOptions;
+
+	/** filters a floating point RGBA level to half its size,
+	  * in each dimension larger than one
+	*/
+	static void downsample(const std::vector<float> &src, unsigned int width, unsigned int height,
+						MipFilter filter, std::vector<float> &dst,
+						unsigned int dstWidth, unsigned int dstHeight, unsigned int maxThreads);
+
+	/// copies a 4x4 block, repeating the last row and column at the borders
+	static void fetchBlock(const Level &level, unsigned int bx, unsigned int by,
+						unsigned char block[64]);
+
+	static void encodeBC1(const unsigned char block[64], unsigned char *out);
+	/// one channel, c is the channel index
+	static void encodeBC4(const unsigned char block[64], int c, unsigned char *out);
+	static void encodeBC7(const unsigned char block[64], unsigned char *out);
+};
+
+#endif
@@ -12,6 +12,10 @@
  * placement and projection definition for programmers
  * working with OpenGL core versions.
  *
+ * \version 0.2.5
+ *		Added frustum plane extraction and the model space camera position
+ *		The matrix stacks are allocated through VSMemoryLib
+ *
  * \version 0.2.4 (22-11-2016)
  *		Added a method to perform point matrix multiplication
 
@@ -349,6 +353,23 @@ class VSMathLib {
 		*/
 		void multPointMatrix(float *point, MatrixTypes aType, float *res);
 
+		/** Extracts the six frustum planes from PROJ_VIEW_MODEL, hence
+		  * in the space of the current MODEL matrix. Planes are normalized
+		  * and point inwards: a point p is inside when
+		  * a*p.x + b*p.y + c*p.z + d >= 0 for all planes.
+		  *
+		  * \param planes a float[24] with left, right, bottom, top,
+		  *		near and far planes as (a, b, c, d)
+		*/
+		void extractFrustumPlanes(float *planes);
+
+		/** Computes the camera position in the space of the current
+		  * MODEL matrix, from the inverse of VIEW_MODEL
+		  *
+		  * \param res a float[3]
+		*/
+		void getModelSpaceCamera(float *res);
+
 		/** vector cross product res = a x b
 		  * Note: memory for the result must be allocatted by the caller
 		  * 
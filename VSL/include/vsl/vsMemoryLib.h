@@ -0,0 +1,148 @@
+/** ----------------------------------------------------------
+ * \class VSMemoryLib
+ *
+ * Lighthouse3D
+ *
+ * VSMemoryLib - Very Simple Memory Library
+ *
+ * \version 0.1.0
+ *		Initial Release
+ *
+ * This lib is the source of the CPU memory allocated by the
+ * other libs for their own buffers. The allocation functions
+ * can be replaced by the application, and the allocations are
+ * counted.
+ *
+ * Temporary data, such as the arrays built while loading a
+ * model or a sentence, comes from a scratch arena instead: a
+ * linear allocator, one per thread, that is rewound at the end
+ * of each load. The arena keeps its memory, so that loads after
+ * the first one do not allocate at all.
+ *
+ *	{
+ *		VSMemoryLib::ScratchScope scope;
+ *		float *p = VSMemoryLib::scratchArray<float>(n);
+ *		...
+ *	} // p is released here
+ *
+ * Full documentation at
+ * http://www.lighthouse3d.com/very-simple-libs
+ *
+ ---------------------------------------------------------------*/
+
+#ifndef __VSMemoryLib__
+#define __VSMemoryLib__
+
+#include <stddef.h>
+#include <vector>
+
+
+class VSMemoryLib {
+
+public:
+
+	/// the functions that provide the memory, user is passed back to them
+	struct Allocator {
+		void *(*allocate)(size_t size, void *user);
+		void (*release)(void *ptr, void *user);
+		void *user;
+	};
+
+	/** Sets the functions used for all the allocations. Memory
+	  * allocated before must be released with the same functions,
+	  * so this should be called before using the other libs.
+	  * NULL functions restore malloc and free
+	*/
+	static void setAllocator(const Allocator &allocator);
+
+	/** Allocates memory aligned to 16 bytes
+	  * \return NULL if there is no memory left
+	*/
+	static void *allocate(size_t size);
+	/// releases memory from allocate, NULL is ignored
+	static void release(void *ptr);
+
+	template <typename T>
+	static T *allocateArray(size_t count) {
+		return (T *)allocate(count * sizeof(T));
+	}
+
+	/** Allocates from the scratch arena of the calling thread.
+	  * The memory is valid until the enclosing ScratchScope ends
+	  * \param alignment a power of two, at most 16
+	  * \return NULL if there is no memory left
+	*/
+	static void *scratch(size_t size, size_t alignment = 16);
+
+	template <typename T>
+	static T *scratchArray(size_t count) {
+		return (T *)scratch(count * sizeof(T), sizeof(T) < 16 ? sizeof(T) : 16);
+	}
+
+	/** Marks the arena of the calling thread, and rewinds it to
+	  * the mark when destroyed. Scopes can be nested
+	*/
+	class ScratchScope {
+
+	public:
+		ScratchScope();
+		~ScratchScope();
+
+	private:
+		size_t mBlock, mOffset, mUsedBefore;
+	};
+
+	/// frees the arena of the calling thread, outside of any scope
+	static void releaseScratch();
+
+	struct Stats {
+		/// calls to allocate and release
+		unsigned long long allocations, releases;
+		/// bytes allocated and not released, and their maximum
+		size_t bytes, peakBytes;
+		/// bytes taken by the arenas of all threads
+		size_t scratchCapacity;
+		/// the most scratch memory used by a single load
+		size_t scratchPeak;
+		/// outermost scopes that ended
+		unsigned long long scratchResets;
+	};
+
+	/// returns the counters, for all threads
+	static Stats getStats();
+	/// sets the peaks to the current values
+	static void resetPeaks();
+
+protected:
+
+	/// a block of an arena
+	struct Block {
+		unsigned char *data;
+		size_t size;
+	};
+
+	/// the arena of a thread, blocks are used in order
+	struct Arena {
+		std::vector<Block> blocks;
+		/// the block in use, and the first free byte in it
+		size_t current, offset;
+		/// bytes used in the blocks before the current one
+		size_t usedBefore;
+		/// open scopes
+		unsigned int depth;
+
+		Arena();
+		~Arena();
+	};
+
+	static Arena &getArena();
+	/** allocates a block, and makes it current
+	  * \return false if there is no memory left
+	*/
+	static bool addBlock(Arena &arena, size_t minSize);
+	/// merges the blocks into one with their total size
+	static void coalesce(Arena &arena);
+	static void updatePeak(size_t used);
+};
+
+#endif
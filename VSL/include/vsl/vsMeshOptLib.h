@@ -0,0 +1,151 @@
+/** ----------------------------------------------------------
+ * \class VSMeshOptLib
+ *
+ * Lighthouse3D
+ *
+ * VSMeshOptLib - Very Simple Mesh Optimization Library
+ *
+ * \version 0.1.0
+ *		Initial Release
+ *
+ * This lib provides CPU side algorithms to process
+ * indexed triangle meshes, such as simplification.
+ * It does not issue OpenGL calls and its functions can be
+ * called from any thread.
+ *
+ * Full documentation at
+ * http://www.lighthouse3d.com/very-simple-libs
+ *
+ ---------------------------------------------------------------*/
+
+#ifndef __VSMeshOptLib__
+#define __VSMeshOptLib__
+
+#include <vector>
+#include <stddef.h>
+
+
+class VSMeshOptLib {
+
+public:
+
+	/** Simplifies a triangle list with edge collapses ordered by
+	  * a quadric error metric (Garland and Heckbert). A collapse
+	  * moves a vertex onto one of its neighbours, so the result
+	  * indexes the original vertices and can share their buffers.
+	  * Vertices on borders, including attribute seams, are kept
+	  * in place, and collapses that flip a face are rejected.
+	  * \param positions the xyz of vertex i start at positions[i * stride]
+	  * \param numVertices the number of vertices
+	  * \param stride floats from one position to the next
+	  * \param indices three vertex indices per face
+	  * \param numIndices the number of indices
+	  * \param targetIndices stop when the result has this many indices
+	  * \param maxError stop before collapses with a larger error,
+	  *		in the units of the positions
+	  * \param result output, the simplified index list
+	  * \return the error of the result, in the units of the positions
+	*/
+	static float simplify(const float *positions, unsigned int numVertices,
+						unsigned int stride,
+						const unsigned int *indices, unsigned int numIndices,
+						unsigned int targetIndices, float maxError,
+						std::vector<unsigned int> &result);
+
+	/// a cluster of triangles, a contiguous range of an index list
+	struct Meshlet {
+		unsigned int firstIndex;
+		unsigned int numIndices;
+		/// bounding sphere
+		float center[3];
+		float radius;
+		/** normal cone, the cluster is back facing when seen from p if
+		  * dot(normalize(coneApex - p), coneAxis) >= coneCutoff
+		*/
+		float coneApex[3];
+		float coneAxis[3];
+		/// greater than 1 when the cone is too wide to cull
+		float coneCutoff;
+	};
+
+	/** Splits a triangle list into clusters of neighbouring triangles.
+	  * The triangles are reordered so that each cluster is a range
+	  * of the index list. Clusters are grown from a seed triangle,
+	  * preferring triangles that share vertices with the cluster and
+	  * face the same way.
+	  * \param indices the triangle list, reordered in place
+	  * \param maxTriangles the maximum number of triangles per cluster
+	  * \param meshlets output, the clusters with their bounds and cones
+	  * \see simplify for the remaining params
+	*/
+	static void buildMeshlets(const float *positions, unsigned int numVertices,
+						unsigned int stride,
+						unsigned int *indices, unsigned int numIndices,
+						unsigned int maxTriangles, std::vector<Meshlet> &meshlets);
+
+	/// a vertex attribute, component j of vertex i is data[i * stride + j]
+	struct VertexStream {
+		const float *data;
+		unsigned int components;
+		unsigned int stride;
+	};
+
+	/** Finds vertices that are equal in all attributes.
+	  * With a zero epsilon values are compared bitwise, otherwise
+	  * values are snapped to a grid of epsilon sized cells, and
+	  * vertices in the same cell are merged.
+	  * \param streams the vertex attributes
+	  * \param numVertices the number of vertices
+	  * \param epsilon the tolerance
+	  * \param remap output, the new index of each vertex
+	  * \param unique output, the original index of each new vertex
+	  * \return the number of unique vertices
+	*/
+	static unsigned int weldVertices(const std::vector<VertexStream> &streams,
+						unsigned int numVertices, float epsilon,
+						std::vector<unsigned int> &remap,
+						std::vector<unsigned int> &unique);
+
+	/// returns a 64 bit FNV-1a hash of a block of memory
+	static unsigned long long hash(const void *data, size_t size,
+						unsigned long long seed = 14695981039346656037ULL);
+
+	/** Computes per vertex tangents for normal mapping, in the
+	  * way of MikkTSpace: the face tangents are weighted by the
+	  * corner angles, orthogonalized against the vertex normal,
+	  * and the handedness of the frame is kept in the fourth
+	  * component, so that bitangent = w * cross(normal, tangent).
+	  * Faces are processed in parallel.
+	  * \param positions, normals, texCoords the attributes of vertex i
+	  *		start at i times the respective stride
+	  * \param indices three vertex indices per face, NULL for
+	  *		consecutive vertices
+	  * \param tangents output, four floats per vertex
+	  * \param bitangents output, three floats per vertex, may be NULL
+	  * \param maxThreads zero uses all hardware threads
+	*/
+	static void computeTangents(const float *positions, unsigned int posStride,
+						const float *normals, unsigned int normalStride,
+						const float *texCoords, unsigned int texStride,
+						unsigned int numVertices,
+						const unsigned int *indices, unsigned int numIndices,
+						float *tangents, float *bitangents,
+						unsigned int maxThreads = 0);
+
+	/** Computes the axis aligned bounding box of a set of points
+	  * \param positions the xyz of vertex i start at positions[i * stride]
+	  * \param bbMin, bbMax output, float[3]
+	*/
+	static void computeBoundingBox(const float *positions, unsigned int numVertices,
+						unsigned int stride, float *bbMin, float *bbMax);
+
+	/** Computes a bounding sphere centered on the bounding box
+	  * \param positions the xyz of vertex i start at positions[i * stride]
+	  * \param center output, float[3]
+	  * \param radius output
+	*/
+	static void computeBoundingSphere(const float *positions, unsigned int numVertices,
+						unsigned int stride, float *center, float *radius);
+};
+
+#endif
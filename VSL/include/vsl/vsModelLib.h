@@ -5,6 +5,29 @@
  *
  * VSModelLib - Very Simple Resource Model Library
  *
+ * \version 0.6
+ *		Added per instance attributes
+ *		Adjacency is built in linear time, in parallel for all meshes
+ *		Added simplified levels of detail
+ *		Added triangle clusters with culling
+ *		Meshes outside the view frustum are skipped
+ *		Vertices are welded and repeated meshes share buffers at load time
+ *		Added node instancing
+ *		Mesh buffers are reference counted and shared between models
+ *		Materials are stored in a uniform buffer and bound per mesh
+ *		Meshes can be updated in place
+ *		Import flags follow the generation mode and the import profile
+ *		Tangents are computed by the lib, optionally packed with the handedness
+ *		Render walks compact draw records instead of the meshes
+ *		Textures can be streamed by VSTextureStreamLib
+ *		Diffuse textures can be packed into texture arrays or atlases
+ *		Bound textures are marked as used for the texture memory budget
+ *		Load temporaries come from the VSMemoryLib scratch arena
+ *		Buffers can be uploaded by the VSUploadLib thread
+ *
+ * \version 0.5
+ *		Textures are shared with other resources through VSTextureLib
+ *
  * \version 0.4
  *		Added Materials from teapots.c
  *		https://www.sgi.com/products/software/opengl/examples/redbook/source/teapots.c
@@ -30,6 +53,10 @@
  * (http://www.lighthouse3d.com/very-simple-libs)
  *
  * VSResourceLib
+ * VSTextureLib
+ * VSUploadLib
+ * VSThreadLib
+ * VSMeshOptLib
  * VSMathLib 
  * VSLogLib
  * VSShaderLib
@@ -53,6 +80,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
 #include <fstream>
 
 #ifdef __ANDROID_API__
@@ -64,10 +92,12 @@
 #ifdef __VSL_MODEL_LOADING__
 #include "assimp/Importer.hpp"	//OO version Header!
 #include "assimp/postprocess.h"
+#include "assimp/config.h"
 #include "assimp/scene.h"
 #endif
 
 #include "vsResourceLib.h"
+#include "vsMeshOptLib.h"
 
 
 class VSModelLib : public VSResourceLib{
@@ -78,7 +108,10 @@ public:
 		NORMAL = 1,
 		TANGENT = 2,
 		BITANGENT = 4,
-		TEXCOORD = 8
+		TEXCOORD = 8,
+		/// a vec4 tangent, w holds the handedness, and no bitangent buffer.
+		/// Shaders compute the bitangent as cross(normal, tangent.xyz) * tangent.w
+		PACKED_TANGENT = 16
 	} Mode;
 
 	VSModelLib();
@@ -94,12 +127,298 @@ public:
 	*/
 	int getGenerationMode();
 
+	enum ImportProfile {
+		/// quick import, no mesh optimizations
+		IMPORT_FAST,
+		/// smooth normals, cache friendly triangles, cleaned up data
+		IMPORT_QUALITY
+	};
+
+	/** sets the Assimp post processing used by load. Normals, tangents
+	  * and texture coordinates are only generated if the generation
+	  * mode asks for them. The default is IMPORT_QUALITY
+	*/
+	void setImportProfile(ImportProfile profile);
+
+	/** When enabled, load also skips the attributes that are not read
+	  * by the program in use (see glUseProgram) when load is called
+	*/
+	void setProgramAttributeFilter(bool enabled);
+
+	/** When enabled, load and addTexture return at once and the
+	  * textures are streamed by VSTextureStreamLib, which must then be
+	  * updated every frame. Meshes are drawn with a placeholder until
+	  * the images arrive. Disabled by default
+	*/
+	void setTextureStreaming(bool enabled);
+
+	/** When enabled, load block compresses the textures of the model
+	  * (see VSTextureLib::acquireTexture). Compression runs on the
+	  * CPU, hence set a cache directory with
+	  * VSImageLib::setCacheDirectory to pay it once. Disabled by default
+	*/
+	void setTextureCompression(bool enabled);
+
+	/** returns false while the buffers of the last load are being
+	  * uploaded by VSUploadLib. Until then render draws nothing,
+	  * and functions that change the meshes wait for the uploads
+	*/
+	bool isReady();
+
 #if defined(__VSL_MODEL_LOADING__)
 	virtual bool load(std::string filename);
 #endif
 
 	/// implementation of the superclass abstract method
 	virtual void render(int instances = 0);
+
+	/// counters gathered during the last call to render
+	struct RenderStats {
+		unsigned int draws;
+		unsigned int textureBinds;
+		unsigned int textureBindsAvoided;
+		unsigned int textureUnbindsAvoided;
+		unsigned int materialUpdates;
+		unsigned int materialUpdatesAvoided;
+		unsigned int vaoBinds;
+		unsigned int vaoBindsAvoided;
+		unsigned int clustersDrawn;
+		unsigned int clustersCulled;
+		unsigned int meshesDrawn;
+		unsigned int meshesCulled;
+	};
+	/// returns the state change counters of the last render
+	const RenderStats &getRenderStats();
+	/** Merged mode stores all the meshes of the model in a single
+	  * vertex and index buffer and renders them with one
+	  * glMultiDrawElementsIndirect call. Meshes from other models can
+	  * be merged as well, by adding them first with addMeshes.
+	  *
+	  * Per mesh transforms and materials are stored in a shader
+	  * storage buffer bound to DRAW_DATA_BINDING, to be indexed with
+	  * gl_DrawIDARB (GL_ARB_shader_draw_parameters):
+	  *
+	  *	struct DrawData {
+	  *		mat4 transform;
+	  *		vec4 diffuse, ambient, specular, emissive;
+	  *		float shininess;
+	  *		int texCount;
+	  *		int texLayer;
+	  *		vec4 texRect;
+	  *	};
+	  *	layout(std430, binding = 0) buffer DrawDataBlock {
+	  *		DrawData draws[];
+	  *	};
+	  *
+	  * The matrices sent by VSMathLib do not include the mesh
+	  * transform, the shader must apply draws[gl_DrawIDARB].transform.
+	  * The textures of the first mesh are used for all meshes, hence
+	  * models with several textures should pack them (see packTextures).
+	  * All meshes must be indexed, share the primitive type and,
+	  * when they have tangents, the number of tangent components.
+	  * Requires GL_ARB_shader_draw_parameters.
+	  *
+	  * \param merged true to enable, false to go back to one draw per mesh
+	  * \return true if the mode is active as requested
+	*/
+	bool setMergedMode(bool merged);
+	/// returns true if the model is being rendered in merged mode
+	bool isMerged();
+	/// shader storage binding point for the merged mode draw data
+	static const GLuint DRAW_DATA_BINDING = 0;
+
+	/** Attaches a per instance attribute to the model. The values
+	  * advance once per instance (divisor 1) when calling
+	  * render(instances), so a single call draws all the copies.
+	  * Setting an attribute that already exists replaces its contents.
+	  * \param attrib the location, one of the INSTANCE_*_ATTRIB
+	  *		values in VSShaderLib::AttribType
+	  * \param components floats per instance: 1 to 4, or 16 for a mat4
+	  *		which takes four consecutive locations
+	  * \param count the number of instances
+	  * \param values count * components floats
+	  * \return false if the number of components is not supported
+	*/
+	bool setInstanceAttrib(VSShaderLib::AttribType attrib, int components,
+							unsigned int count, const float *values);
+	/** updates the values of a range of instances. The range must be
+	  * within the count given to setInstanceAttrib
+	*/
+	bool updateInstanceAttrib(VSShaderLib::AttribType attrib,
+							unsigned int first, unsigned int count, const float *values);
+	/// removes a per instance attribute from the model
+	void removeInstanceAttrib(VSShaderLib::AttribType attrib);
+	/// returns the smallest instance count of the attached attributes
+	unsigned int getInstanceCount();
+
+	/** Sets a column major mat4 per instance, in INSTANCE_MATRIX_ATTRIB.
+	  * The instance matrix is applied in the mesh space, before the
+	  * matrices in the Matrices block:
+	  *
+	  *	in mat4 instanceMatrix;
+	  *	...
+	  *	gl_Position = m_pvm * instanceMatrix * position;
+	  *	normal = normalize(m_normal * mat3(instanceMatrix) * normal);
+	  *
+	  * The normal transform assumes no non uniform scales.
+	*/
+	void setInstanceMatrices(unsigned int count, const float *matrices);
+	/// updates the matrices of a range of instances
+	void updateInstanceMatrices(unsigned int first, unsigned int count, const float *matrices);
+	/// sets a RGBA color per instance, in INSTANCE_COLOR_ATTRIB
+	void setInstanceColors(unsigned int count, const float *colors);
+	/// updates the colors of a range of instances
+	void updateInstanceColors(unsigned int first, unsigned int count, const float *colors);
+
+	/** when set, models are loaded with adjacency information and
+	  * rendered as GL_TRIANGLES_ADJACENCY. Must be called before load
+	*/
+	void setAdjacency(bool use);
+
+	/// twin value for half-edges on a boundary
+	static const unsigned int NO_TWIN = 0xFFFFFFFF;
+
+	/** Builds the half-edge twins of a triangle list. Half-edge
+	  * 3*f+k goes from vertex indices[3*f+k] to indices[3*f+(k+1)%3],
+	  * its next half-edge is 3*f+(k+1)%3. Edges shared by more than
+	  * two faces are paired in face order. Runs in linear time.
+	  * \param indices three vertex indices per face
+	  * \param numFaces the number of triangles
+	  * \param numVertices one more than the largest vertex index
+	  * \param twins output, the twin of each half-edge, or NO_TWIN
+	  * \param boundaryEdges if not NULL, receives the vertex pairs
+	  *		of the half-edges without twin
+	*/
+	static void buildHalfEdges(const unsigned int *indices, unsigned int numFaces,
+							unsigned int numVertices, std::vector<unsigned int> &twins,
+							std::vector<unsigned int> *boundaryEdges = NULL);
+
+	/** Builds an index list for GL_TRIANGLES_ADJACENCY, six indices
+	  * per face. On boundaries the adjacent vertex is replaced by
+	  * the first vertex of the edge.
+	  * \param adjIndices output, 6 * numFaces indices
+	  * \see buildHalfEdges for the remaining params
+	*/
+	static void buildAdjacency(const unsigned int *indices, unsigned int numFaces,
+							unsigned int numVertices, std::vector<unsigned int> &adjIndices,
+							std::vector<unsigned int> *boundaryEdges = NULL);
+
+	/// maximum levels of detail per mesh, full resolution included
+	static const int MAX_LODS = 5;
+
+	/// a level of detail, a range of the mesh index buffer
+	struct LOD {
+		GLuint firstIndex;
+		GLuint numIndices;
+		/// geometric error, in the units of the model
+		float error;
+	};
+
+	/** Enables the generation of simplified levels of detail for
+	  * indexed triangle meshes. Must be called before load or addMesh.
+	  * Levels share the vertex buffers of the mesh, only the
+	  * indices are added.
+	  * \param levels extra levels, from 0 (disabled) to MAX_LODS - 1
+	  * \param reduction ratio of triangles from one level to the next
+	*/
+	void setLODGeneration(int levels, float reduction = 0.5f);
+
+	/** Sets how levels are picked in render. The coarsest level whose
+	  * error, projected on screen with the current matrices, is below
+	  * pixelError is used. The projection uses the bounding sphere of
+	  * each mesh and the viewport height.
+	  * \param pixelError maximum error in pixels, zero to always
+	  *		render at full resolution
+	  * \param hysteresis fraction of pixelError: moving to a coarser
+	  *		level requires the error to be below pixelError * (1 - hysteresis),
+	  *		preventing levels from switching back and forth
+	*/
+	void setLODSelection(float pixelError, float hysteresis = 0.1f);
+	/// returns the number of levels of a mesh, full resolution included
+	int getLODCount(unsigned int mesh);
+	/// returns the level picked for a mesh in the last render
+	int getCurrentLOD(unsigned int mesh);
+
+	/** Enables splitting meshes into clusters of neighbouring
+	  * triangles, each with a bounding sphere and a normal cone.
+	  * Must be called before load or addMesh. Clusters are built for
+	  * the full resolution level of indexed triangle meshes.
+	  * \param maxTriangles triangles per cluster, 64 to 128 work
+	  *		well, zero disables clusters
+	*/
+	void setMeshletGeneration(unsigned int maxTriangles);
+	/** When enabled, render culls clusters outside the frustum
+	  * or facing away from the camera, and draws the remaining
+	  * ones with glMultiDrawElements. Instanced renders are not culled
+	*/
+	void setMeshletCulling(bool enabled);
+
+	/** When enabled, render skips meshes whose bounding box is
+	  * outside the view frustum. Instanced renders are not culled.
+	  * Enabled by default
+	*/
+	void setFrustumCulling(bool enabled);
+
+	/** Vertices equal in all attributes are welded at load time.
+	  * \param epsilon zero welds bitwise equal vertices only, larger
+	  * values weld vertices closer than epsilon, and negative values
+	  * disable welding. Must be called before load
+	*/
+	void setWeldEpsilon(float epsilon);
+
+	/** When enabled, meshes with the same contents are stored once
+	  * and share their buffers. Must be called before load.
+	  * Enabled by default
+	*/
+	void setDuplicateSharing(bool enabled);
+
+	enum TexturePacking {
+		PACK_NONE,
+		/// textures with the same format, size and levels become layers of a GL_TEXTURE_2D_ARRAY
+		PACK_ARRAY,
+		/// small textures with the same format are copied into a GL_TEXTURE_2D atlas
+		PACK_ATLAS
+	};
+
+	/** Packs the diffuse textures (unit 0) of the meshes so that
+	  * meshes with different images bind the same texture, and can
+	  * be drawn without rebinding. Each mesh gets the layer or the
+	  * rect of its image in the material:
+	  *
+	  *	uniform sampler2DArray texUnit;	// PACK_ARRAY
+	  *	color = texture(texUnit, vec3(texCoord, texLayer));
+	  *
+	  *	uniform sampler2D texUnit;		// PACK_ATLAS
+	  *	color = texture(texUnit, texRect.xy + fract(texCoord) * texRect.zw);
+	  *
+	  * Images in an atlas are apart by at least one texel at the
+	  * coarsest level, and atlases have at most 5 levels. Textures
+	  * that can not be packed keep texLayer 0 and texRect (0,0,1,1).
+	  * Textures still being streamed are not packed.
+	  * Requires glCopyImageSubData (OpenGL 4.3)
+	  * \return false if packing is not supported
+	*/
+	bool packTextures(TexturePacking packing);
+	/** sets the packing applied by load. Disabled by default
+	  * \param atlasMaxTexture the largest image, in either
+	  *		dimension, that is copied into an atlas
+	*/
+	void setTexturePacking(TexturePacking packing, unsigned int atlasMaxTexture = 512);
+
+	/** When enabled, meshes that only differ in the node transform,
+	  * such as a mesh referenced by several nodes, are drawn with a single
+	  * instanced call. The node transforms are sent per instance in
+	  * INSTANCE_MATRIX_ATTRIB, hence the shader must use instanceMatrix
+	  * as in setInstanceMatrices. Not used when render is called with
+	  * instances. Disabled by default
+	*/
+	void setNodeInstancing(bool enabled);
+
+	/** forces the draw order to be rebuilt in the next render.
+	  * Call this after changing the textures, materials, transforms
+	  * or VAOs of mMyMeshes directly
+	*/
+	void invalidateDrawOrder();
 	/// set a predefined material
 	void setMaterialColor(MaterialColors m);
 	/// set a color component for all meshes
@@ -125,26 +444,64 @@ public:
 
 public:
 
+	/** The buffers of a mesh. Meshes that draw the same geometry,
+	  * in this or in other models, share one Geometry and the
+	  * buffers are deleted with the last mesh that uses them
+	*/
+	class Geometry {
+
+	public:
+		GLuint vao, vboPos, vboNormal, vboTexCoord, vboTangent, vboBitangent, vboIndices;
+		/// vertices and indices that fit in the buffers
+		GLuint vertexCapacity, indexCapacity;
+
+		Geometry() {
+			vao = 0; vboPos = 0; vboNormal = 0; vboTexCoord = 0; vboTangent = 0; vboBitangent = 0; vboIndices = 0;
+			vertexCapacity = 0; indexCapacity = 0;
+		}
+		~Geometry();
+	};
+
 	// A model can be made of many meshes. Each is stored
 	// in the following structure
 	class MyMesh {
 
 	public:
+		/// copies of the geometry names, used when drawing
 		GLuint vao, vboPos, vboNormal, vboTexCoord, vboTangent, vboBitangent, vboIndices;
+		/// owner of the buffers
+		std::shared_ptr<Geometry> geometry;
 		GLuint texUnits[MAX_TEXTURES];
 		GLuint texTypes[MAX_TEXTURES];
+		/// slot of the material in the model's material buffer
 		GLuint uniformBlockIndex;
 		float transform[16];
 		int numIndices;
+		int numVertices;
 		bool hasIndices;
 		unsigned int type;
+		/// floats per vertex in the tangent buffer, 3 or 4
+		int tangentComponents;
 		struct Material mat;
+		/// levels of detail, level zero is full resolution
+		LOD lods[MAX_LODS];
+		int numLODs;
+		int currentLOD;
+		/// bounds in the mesh space, before transform is applied
+		float bbMin[3], bbMax[3];
+		float boundCenter[3];
+		float boundRadius;
+		/// range of the model's cluster list
+		unsigned int firstMeshlet;
+		unsigned int numMeshlets;
 
 		MyMesh() {
 			vao = 0; vboPos = 0; vboNormal = 0; vboTexCoord = 0; vboTangent = 0; vboBitangent = 0; vboIndices = 0;
 			numIndices = 0;
+			numVertices = 0;
 			hasIndices = false;
 			type = GL_TRIANGLES;
+			tangentComponents = 3;
 			float cD[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
 			memcpy(mat.diffuse, cD, sizeof(float) * 4);
 			float cA[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
@@ -154,20 +511,32 @@ public:
 			float cE[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
 			memcpy(mat.emissive, cE, sizeof(float) * 4);
 
-			for (int i = 0; i < MAX_TEXTURES; ++i)
+			for (int i = 0; i < MAX_TEXTURES; ++i) {
 				texUnits[i] = 0;
+				texTypes[i] = 0;
+			}
+			uniformBlockIndex = 0;
 			mat.shininess = 128.0;
 			mat.texCount = 0;
+			for (int i = 0; i < MAX_LODS; ++i) {
+				lods[i].firstIndex = 0;
+				lods[i].numIndices = 0;
+				lods[i].error = 0.0f;
+			}
+			numLODs = 0;
+			currentLOD = 0;
+			boundCenter[0] = 0.0f; boundCenter[1] = 0.0f; boundCenter[2] = 0.0f;
+			boundRadius = 0.0f;
+			for (int i = 0; i < 3; ++i) {
+				bbMin[i] = 0.0f;
+				bbMax[i] = 0.0f;
+			}
+			firstMeshlet = 0;
+			numMeshlets = 0;
 		}
 
 	};
 
-	struct HalfEdge {
-		GLuint vertex;
-		struct HalfEdge *next;
-		struct HalfEdge *twin;
-	};
-
 	/// the mesh collection
 	std::vector<MyMesh> mMyMeshes;
 
@@ -175,10 +544,272 @@ public:
 	int addMesh(size_t nump, float *p, float *n, float *tc, float *tang, float *bitan, size_t numInd, unsigned int *indices);
 	void setMesh(int i, size_t nump, float *p, float *n, float *tc, float *tang, float *bitan, size_t numInd, unsigned int *indices);
 
+	/** Replaces the contents of a mesh keeping its buffers. Buffers
+	  * only grow, doubling their capacity, when the data does not fit,
+	  * and the previous contents are orphaned so that the update does
+	  * not wait for the draws in flight. NULL attributes keep their
+	  * contents, and must not be NULL if the number of vertices grows.
+	  * Tangents are computed when the mode requires them and tang is NULL,
+	  * on the current indices if indices is NULL.
+	  * Meshes without buffers, or sharing them with other meshes, are
+	  * built from scratch. Levels of detail and clusters are dropped.
+	  * In merged mode call setMergedMode again after updates.
+	  * \return false if the mesh does not exist, an attribute is missing,
+	  * or the current indices do not fit the new vertices
+	*/
+	bool updateMesh(int i, size_t nump, float *p, float *n, float *tc, float *tang, float *bitan, size_t numInd, unsigned int *indices);
+	/// replaces count vertices of an attribute, starting at vertex first
+	bool updateMeshVertices(int i, VSShaderLib::AttribType attrib, size_t first, size_t count, const float *values);
+	/// replaces count indices, starting at index first
+	bool updateMeshIndices(int i, size_t first, size_t count, const unsigned int *indices);
+
 protected:
+	/** sort keys of half-edge e for buildHalfEdges: 0 its direction,
+	  * 1 its highest vertex, 2 its lowest vertex
+	*/
+	static unsigned int edgeKey(const unsigned int *indices, unsigned int e, int key);
 	void buildVAO(MyMesh &m, size_t nump, float *p, float *n, float *tc, float *tang, float *bitan, size_t numInd, unsigned int *indices);
+	/** sets tang and bitan to the tangent space the mode asks for,
+	  * computing it when missing, or NULL if it is not wanted.
+	  * Computed data is stored in tangData and bitanData
+	  * \param generate false if the faces are unknown
+	  * \return the number of floats per tangent
+	*/
+	int prepareTangents(size_t nump, const float *p, const float *n, const float *tc,
+						size_t numInd, const unsigned int *ind, bool generate,
+						float *&tang, float *&bitan,
+						std::vector<float> &tangData, std::vector<float> &bitanData);
+	/// floats per vertex in the tangent buffers created in the current mode
+	int getTangentComponents();
+	/// makes a new Geometry the owner of the buffers of a mesh
+	static void ownGeometry(MyMesh &m);
+	/** writes data at the start of a buffer, orphaning the previous
+	  * storage. The buffer is created if needed, and left bound
+	*/
+	static void streamBuffer(GLenum target, GLuint &buffer, GLsizeiptr capacity,
+						GLsizeiptr size, const void *data);
+	/// creates the vertex array of a mesh from its buffers, and gives it to the geometry
+	void buildMeshVAO(MyMesh &m);
+	/** builds the vertex arrays of the meshes loaded through VSUploadLib
+	  * once their buffers are complete
+	  * \param block wait for the uploads
+	  * \return false if the uploads are not done
+	*/
+	bool completeUpload(bool block);
 	int mFlagMode;
 
+	/// mesh indices sorted by texture set, material and VAO
+	std::vector<unsigned int> mDrawOrder;
+	/// false when the meshes changed since the order was built
+	bool mDrawOrderValid;
+
+	/// textures bound by a mesh, per unit
+	struct TextureSet {
+		GLuint units[MAX_TEXTURES];
+		GLuint types[MAX_TEXTURES];
+	};
+
+	/** What render needs from each mesh, in draw order, one array
+	  * per field so that the draw loop reads memory linearly.
+	  * Materials, texture sets and transforms are stored once and
+	  * referenced by index. Meshes with levels of detail or clusters
+	  * are flagged, and only those are read from mMyMeshes
+	*/
+	struct DrawRecords {
+		std::vector<GLuint> vao;
+		std::vector<GLenum> type;
+		std::vector<GLsizei> count;
+		std::vector<unsigned char> indexed;
+		/// index in materials, also the material buffer slot
+		std::vector<unsigned int> material;
+		/// index in textureSets
+		std::vector<unsigned int> textures;
+		/// index of a matrix in transforms
+		std::vector<unsigned int> transform;
+		/// true if the mesh has levels of detail or clusters
+		std::vector<unsigned char> detailed;
+
+		std::vector<Material> materials;
+		std::vector<TextureSet> textureSets;
+		/// 16 floats per matrix
+		std::vector<float> transforms;
+	};
+	DrawRecords mDraw;
+	/// fills mDraw from the meshes, in draw order
+	void buildDrawRecords();
+	/// true if drawing the mesh selects levels of detail or clusters
+	static bool isDetailed(const MyMesh &m);
+	/// counters for the last render
+	RenderStats mRenderStats;
+	/// sorts the meshes to minimize state changes
+	void buildDrawOrder();
+
+	/// the materials of the meshes, one aligned slot per distinct material
+	GLuint mMaterialBuffer;
+	/// distance between slots, and size of the material block
+	GLsizei mMaterialStride, mMaterialSize;
+	/// binding point of the material block
+	GLuint mMaterialBinding;
+	/// false when the materials changed since the buffer was built
+	bool mMaterialBufferValid;
+	/** bakes the materials with the layout of the material block,
+	  * and sets the slot of each mesh in uniformBlockIndex. Requires
+	  * a program with the block to be prepared
+	*/
+	void buildMaterialBuffer();
+
+	/// per draw data for the merged mode, std430 layout
+	struct MergedDrawData {
+		float transform[16];
+		struct Material mat;
+	};
+
+	/// indirect draw command as defined by OpenGL
+	struct DrawElementsIndirectCommand {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLuint baseVertex;
+		GLuint baseInstance;
+	};
+
+	/// the buffers shared by all meshes in merged mode
+	struct MergedGeometry {
+		GLuint vao, vboPos, vboNormal, vboTexCoord, vboTangent, vboBitangent, vboIndices;
+		GLuint indirectBuffer, drawDataBuffer;
+		GLuint drawCount;
+		GLenum type;
+		std::vector<DrawElementsIndirectCommand> commands;
+	} mMerged;
+	bool mMergedMode;
+
+	/// copies all meshes into the merged buffers
+	bool buildMergedGeometry();
+	/// uploads transforms and materials to the draw data buffer
+	void updateMergedDrawData();
+	void deleteMergedGeometry();
+	void renderMerged(int instances);
+
+	/// a per instance vertex buffer
+	struct InstanceAttrib {
+		GLuint vbo;
+		/// 1 to 4, or 16 for a mat4
+		int components;
+		unsigned int count;
+	};
+	std::map<VSShaderLib::AttribType, InstanceAttrib> mInstanceAttribs;
+	/** sets the instance attributes in the bound VAO. VAOs can be
+	  * shared with other models, so the attributes are only set
+	  * while the model draws with them
+	*/
+	void bindInstanceAttribs();
+	/// disables the instance attributes, and the node transforms, in the bound VAO
+	void unbindInstanceAttribs(bool nodeMatrices);
+
+	int mLODLevels;
+	float mLODReduction;
+	float mLODPixelError;
+	float mLODHysteresis;
+	/** computes the bounding sphere and levels of detail of a mesh.
+	  * Level indices are appended to lodIndices, starting with
+	  * the original ones. Can be called from any thread
+	*/
+	void buildLODs(MyMesh &m, const float *pos, unsigned int stride, unsigned int numVertices,
+					const unsigned int *indices, unsigned int numIndices,
+					std::vector<unsigned int> &lodIndices);
+	/// computes the bounding box and sphere of a mesh
+	static void computeBounds(MyMesh &m, const float *pos, unsigned int stride,
+					unsigned int numVertices);
+	/// picks the level to render a mesh with the current matrices
+	int selectLOD(MyMesh &m, float viewportHeight);
+
+	bool mFrustumCulling;
+	/** mesh boxes in the model space, in draw order, packed four at
+	  * a time as centers x, y, z and extents x, y, z
+	*/
+	std::vector<float> mCullBoxes;
+	/// frustum test result per entry of the draw order
+	std::vector<unsigned char> mVisible;
+	/// fills mCullBoxes, called when the draw order is built
+	void buildCullBoxes();
+	/// tests the boxes against the current frustum, four at a time
+	void cullMeshes();
+
+	unsigned int mMeshletTriangles;
+	bool mMeshletCulling;
+	/// the clusters of all meshes
+	std::vector<VSMeshOptLib::Meshlet> mMeshlets;
+	/// clusters in ranges no longer used, at most
+	size_t mMeshletsFreed;
+	/// clears the cluster range of a mesh, the range is reclaimed later
+	void dropMeshlets(MyMesh &m);
+	/// removes the ranges that no mesh uses from mMeshlets
+	void compactMeshlets();
+	/// index ranges of the visible clusters, reused every frame
+	std::vector<GLsizei> mClusterCounts;
+	std::vector<const GLvoid *> mClusterOffsets;
+	/** culls the clusters of a mesh with the current matrices
+	  * and fills the range lists
+	  * \return the number of ranges to draw
+	*/
+	unsigned int cullMeshlets(const MyMesh &m);
+
+	/// state left by the previous draw in a render call
+	struct BoundState {
+		GLuint tex[MAX_TEXTURES], type[MAX_TEXTURES];
+		/// index in mDraw.materials, -1 if none
+		GLint material;
+		/// true if the material is a slot of the material buffer
+		bool materialSlot;
+		/// index in mDraw.transforms, -1 if none
+		GLint transform;
+		GLuint vao;
+		bool vaoBound;
+		/// the node transforms are set in the bound VAO
+		bool nodeMatrices;
+	};
+	void resetBoundState(BoundState &state);
+	/** sets the material, textures and VAO of an entry of the draw
+	  * order, skipping redundant changes
+	*/
+	void bindDrawState(unsigned int k, BoundState &state);
+	/// unbinds the textures and VAO
+	void releaseBoundState(BoundState &state);
+
+	bool mNodeInstancing;
+	/// the node transforms, in draw order
+	GLuint mNodeTransforms;
+	/// first draw order entry of each instanced draw, plus the end
+	std::vector<unsigned int> mNodeGroups;
+	/// groups the draw order and uploads the transforms
+	void buildNodeInstances();
+	void renderNodeInstances(BoundState &state, bool cull);
+
+	float mWeldEpsilon;
+	bool mShareDuplicates;
+
+	TexturePacking mTexturePacking;
+	unsigned int mAtlasMaxTexture;
+	/// a diffuse texture considered for packing
+	struct PackSource {
+		GLuint texture;
+		GLenum format;
+		bool compressed;
+		GLsizei width, height, levels;
+		/// result
+		GLuint packed;
+		GLenum target;
+		int layer;
+		float rect[4];
+	};
+	/// builds a texture array for sources with the same format, size and levels
+	void packArray(std::vector<PackSource *> &group);
+	/// places a group of sources with the same format in atlases
+	void packAtlases(std::vector<PackSource *> &group);
+	/// builds an atlas with the sources already placed in it
+	void buildAtlas(std::vector<PackSource *> &sources, GLsizei width, GLsizei height,
+					GLsizei levels, const std::vector<unsigned int> &x, const std::vector<unsigned int> &y);
+
 
 private:
 	/// aux pre processed mesh collection
@@ -190,6 +821,17 @@ private:
 #endif
 
 	bool pUseAdjacency;
+	ImportProfile mImportProfile;
+	bool mProgramAttributeFilter;
+	bool mTextureStreaming;
+	bool mTextureCompression;
+
+	/// buffer data queued for VSUploadLib by the load in progress
+	std::shared_ptr<std::vector<std::pair<GLuint, std::vector<unsigned char> > > > mPendingBuffers;
+	/// the VSUploadLib job with the buffers of the last load, or zero
+	unsigned int mUploadTicket;
+	/// some meshes have no vertex array yet
+	bool mVAOsPending;
 
 #if defined(__VSL_TEXTURE_LOADING__)
 
@@ -200,10 +842,30 @@ private:
 
 	// Load models from file
 	bool loadTextures(const aiScene *scene, std::string prefix);
+	/** sets the texture of a unit in all meshes, and gives back
+	  * the textures the unit held that no mesh uses anymore
+	*/
+	void replaceUnitTexture(unsigned int unit, GLuint textureID, GLenum textureType);
 #endif
 
 #if defined(__VSL_MODEL_LOADING__)
-	void genVAOsAndUniformBuffer(const aiScene *sc);
+	/// the attributes that load generates and uploads (see enum Mode)
+	int getLoadMode();
+	/** returns the Assimp flags for the profile and mode
+	  * \param removed output, aiComponent flags to remove from the meshes
+	*/
+	unsigned int getImportFlags(int mode, int &removed);
+	void genVAOsAndUniformBuffer(const aiScene *sc, int mode);
+	/// sets the contents of a new buffer, or queues them for VSUploadLib
+	void uploadBuffer(GLuint buffer, size_t size, const void *data);
+	/// copies the welded vertices of an assimp attribute to res, unique.size() * components floats
+	static void gatherVertices(const float *data, unsigned int components,
+						const std::vector<unsigned int> &unique, float *res);
+	/// true if two welded meshes have the same buffers
+	static bool sameMeshContents(const aiMesh *a, const std::vector<unsigned int> &uniqueA,
+						const std::vector<unsigned int> &facesA,
+						const aiMesh *b, const std::vector<unsigned int> &uniqueB,
+						const std::vector<unsigned int> &facesB);
 	void recursive_walk_for_matrices(const aiScene *sc,
 						const aiNode* nd);
 
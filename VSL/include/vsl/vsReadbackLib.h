@@ -0,0 +1,183 @@
+/** ----------------------------------------------------------
+ * \class VSReadbackLib
+ *
+ * Lighthouse3D
+ *
+ * VSReadbackLib - Very Simple Readback Library
+ *
+ * \version 0.1.0
+ *		Initial Release
+ *
+ * This lib reads rendered frames back without stalling the GPU.
+ * Each capture issues glReadPixels into a ring of pixel pack
+ * buffers, and the frames are handed to a callback a few frames
+ * later, once their fences have signalled. Frames can optionally
+ * be converted, rows flipped or channels reordered, by a worker
+ * thread.
+ *
+ * The application must call update once per frame, with the
+ * context current. The callback is called from update, in
+ * capture order, and should hand the data off rather than
+ * process it. All functions, and the destructor, must be called
+ * from the thread that owns the context.
+ *
+ * This lib requires the following classes from VSL:
+ * (http://www.lighthouse3d.com/very-simple-libs)
+ *
+ * VSLogLib
+ *
+ * and the following third party libs:
+ *
+ * GLEW (http://glew.sourceforge.net/)
+ *
+ * Full documentation at
+ * http://www.lighthouse3d.com/very-simple-libs
+ *
+ ---------------------------------------------------------------*/
+
+#ifndef __VSReadbackLib__
+#define __VSReadbackLib__
+
+#include "vslConfig.h"
+
+#if !defined(__ANDROID_API__)
+
+#include "vsLogLib.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <utility>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include <GL/glew.h>
+
+
+class VSReadbackLib {
+
+public:
+
+	/// conversions applied by the worker, can be combined
+	enum Conversion {
+		/// RGBA, rows from the bottom up as in OpenGL
+		CONVERT_NONE = 0,
+		/// rows from the top down, as most image and video encoders expect
+		CONVERT_FLIP_ROWS = 1,
+		/// BGRA instead of RGBA
+		CONVERT_SWAP_RB = 2,
+		/// three channels instead of four
+		CONVERT_DROP_ALPHA = 4
+	};
+
+	/// a frame read back
+	struct Frame {
+		/// the count of captures when this one was issued, starting at zero
+		unsigned int number;
+		unsigned int width, height;
+		/// 4, or 3 with CONVERT_DROP_ALPHA
+		unsigned int channels;
+		/// tightly packed rows, may be swapped out by the callback
+		std::vector<unsigned char> data;
+	};
+
+	typedef std::function<void(Frame &)> Callback;
+
+	VSReadbackLib();
+	~VSReadbackLib();
+
+	/// sets the function that receives the frames
+	void setCallback(const Callback &callback);
+
+	/** Sets the conversions, a combination of Conversion flags.
+	  * Frames without conversions skip the worker
+	*/
+	void setConversion(unsigned int conversion);
+
+	/** Sets the number of pack buffers, 3 by default. Frames
+	  * are delivered up to this number of captures later
+	*/
+	void setRingSize(unsigned int buffers);
+
+	/** Reads a rectangle of the bound read framebuffer into the
+	  * ring. Waits only if all the buffers are in flight, for
+	  * the oldest one
+	*/
+	void capture(GLint x, GLint y, GLsizei width, GLsizei height);
+
+	/** Delivers the frames whose reads have completed, and those
+	  * converted by the worker. Never waits. Call once per frame
+	*/
+	void update();
+
+	/// waits for all captures, and delivers them
+	void finish();
+
+	/// returns the number of captures not delivered yet
+	unsigned int getPendingCount();
+	/// returns the number of captures that had to wait for a buffer
+	unsigned int getStallCount();
+
+	/// returns the errors found
+	std::string getErrors();
+
+protected:
+
+	VSLogLib mLogError;
+
+	/// a pack buffer of the ring
+	struct Slot {
+		GLuint buffer;
+		/// persistently mapped pointer, or NULL
+		unsigned char *ptr;
+		size_t size;
+		GLsync fence;
+		/// the frame being read into this buffer, and its conversions
+		Frame frame;
+		unsigned int conversion;
+	};
+
+	std::vector<Slot> mSlots;
+	unsigned int mRingSize;
+	/// next slot to capture into, and oldest slot in flight
+	unsigned int mHead, mTail;
+	unsigned int mInFlight;
+
+	Callback mCallback;
+	unsigned int mConversion;
+	unsigned int mCaptures;
+	unsigned int mStalls;
+	/// frames handed to the worker and not delivered yet
+	unsigned int mConverting;
+
+	/// shared with the worker
+	std::mutex mMutex;
+	std::condition_variable mCond;
+	std::deque<std::pair<std::shared_ptr<Frame>, unsigned int> > mQueue;
+	std::deque<std::shared_ptr<Frame> > mConverted;
+	bool mStop;
+	std::thread mWorker;
+
+	void workerLoop();
+	/// applies the conversions to a frame
+	static void convert(Frame &frame, unsigned int conversion);
+
+	/** copies the oldest frame in flight out of its buffer.
+	  * \return false if the read is not complete and block is false
+	*/
+	bool collect(bool block);
+	/// passes a frame to the worker or to the callback
+	void deliver(std::shared_ptr<Frame> frame, unsigned int conversion);
+	/// calls the callback with the frames converted by the worker
+	void deliverConverted(bool block);
+
+	void allocateSlot(Slot &slot, size_t size);
+	void deleteSlots();
+};
+
+#endif
+
+#endif
@@ -0,0 +1,150 @@
+/** ----------------------------------------------------------
+ * \class VSRenderTargetLib
+ *
+ * Lighthouse3D
+ *
+ * VSRenderTargetLib - Very Simple Render Target Library
+ *
+ * \version 0.1.0
+ *		Initial Release
+ *
+ * This lib keeps a pool of framebuffers with their color and depth
+ * textures, looked up by size, formats and samples. Released
+ * targets are handed out again to later passes with the same
+ * description, in the same frame or in the next ones, so that
+ * passes that do not overlap share memory, and a frame that
+ * repeats the passes of the previous one allocates nothing.
+ *
+ * The application should call update once per frame. Targets
+ * that have not been used for a few frames are then deleted.
+ *
+ * This lib requires the following classes from VSL:
+ * (http://www.lighthouse3d.com/very-simple-libs)
+ *
+ * VSLogLib
+ *
+ * and the following third party libs:
+ *
+ * GLEW (http://glew.sourceforge.net/)
+ *
+ * Full documentation at
+ * http://www.lighthouse3d.com/very-simple-libs
+ *
+ ---------------------------------------------------------------*/
+
+#ifndef __VSRenderTargetLib__
+#define __VSRenderTargetLib__
+
+#include "vslConfig.h"
+
+#if !defined(__ANDROID_API__)
+
+#include "vsLogLib.h"
+
+#include <string>
+#include <map>
+
+#include <GL/glew.h>
+
+
+class VSRenderTargetLib {
+
+public:
+
+	/// describes a render target
+	struct Desc {
+		GLsizei width, height;
+		/// internal format of the color texture, zero for none
+		GLenum colorFormat;
+		/// internal format of the depth texture, zero for none
+		GLenum depthFormat;
+		/// zero for single sampled textures
+		GLsizei samples;
+
+		Desc(GLsizei aWidth = 0, GLsizei aHeight = 0, GLenum aColorFormat = GL_RGBA8,
+			GLenum aDepthFormat = GL_DEPTH24_STENCIL8, GLsizei aSamples = 0) :
+			width(aWidth), height(aHeight), colorFormat(aColorFormat),
+			depthFormat(aDepthFormat), samples(aSamples) {
+		}
+
+		bool operator==(const Desc &d) const {
+			return width == d.width && height == d.height && colorFormat == d.colorFormat &&
+				depthFormat == d.depthFormat && samples == d.samples;
+		}
+	};
+
+	/// a framebuffer and its attachments
+	struct Target {
+		GLuint fbo;
+		/// GL_TEXTURE_2D, or GL_TEXTURE_2D_MULTISAMPLE with samples
+		GLuint color, depth;
+		Desc desc;
+	};
+
+	/** Returns a target for the description, reusing a released
+	  * one when there is one. The target is owned by the caller
+	  * until released, across frames if needed
+	  * \return NULL if the framebuffer is not complete
+	*/
+	static const Target *acquire(const Desc &desc);
+
+	/** Returns a target to the pool. Its contents may be
+	  * overwritten by the next pass that acquires it
+	*/
+	static void release(const Target *target);
+
+	/** Deletes the released targets not acquired in the last
+	  * frames. Call once per frame
+	*/
+	static void update();
+
+	/// sets the frames a released target is kept, 3 by default
+	static void setMaxIdleFrames(unsigned int frames);
+
+	/// deletes all the released targets
+	static void trim();
+
+	/// returns the bytes taken by the textures of the pool
+	static size_t getMemory();
+	/// returns the number of targets, released or not
+	static unsigned int getTargetCount();
+	/** returns the number of targets created so far. A frame
+	  * that repeats the passes of the previous one adds none
+	*/
+	static unsigned int getAllocationCount();
+
+	/// returns the bytes per pixel of an internal format
+	static unsigned int getFormatSize(GLenum internalFormat);
+
+	/// returns the errors found
+	static std::string getErrors();
+
+protected:
+
+	static VSLogLib sLogError;
+
+	struct Entry {
+		Target target;
+		bool inUse;
+		/// the frame when it was last acquired
+		unsigned int lastUsed;
+		size_t bytes;
+	};
+
+	/// by framebuffer name
+	static std::map<GLuint, Entry> sTargets;
+	static unsigned int sFrame;
+	static unsigned int sMaxIdleFrames;
+	static size_t sMemory;
+	static unsigned int sAllocations;
+
+	/// creates a framebuffer and its textures
+	static bool create(const Desc &desc, Target &target);
+	/// creates an attachment texture
+	static GLuint createTexture(GLenum internalFormat, const Desc &desc);
+	static void destroy(Entry &entry);
+};
+
+#endif
+
+#endif
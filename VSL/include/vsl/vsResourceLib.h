@@ -15,6 +15,8 @@
  * VSMathLib 
  * VSLogLib
  * VSShaderLib
+ * VSImageLib
+ * VSUploadLib
  *
  * and the following third party libs:
  *
@@ -35,6 +37,8 @@
 #include <vector>
 #include <map>
 #include <fstream>
+#include <memory>
+#include <mutex>
 
 
 #ifdef __ANDROID_API__
@@ -61,6 +65,10 @@
 #include "vsMathLib.h"
 // vsLogLib is required for logging errors and model info
 #include "vsLogLib.h"
+// VSImageLib compresses textures
+#include "vsImageLib.h"
+// VSUploadLib defines textures in the uploader thread
+#include "vsUploadLib.h"
 // VSShaderLib is required to enable and set the 
 // semantic of the vertex arrays
 #include "vsShaderLib.h"
@@ -86,6 +94,21 @@ public:
 		float emissive[4];
 		float shininess;
 		int texCount;
+		/// layer of the diffuse texture when it is a texture array
+		int texLayer;
+		float pad;
+		/** rect of the diffuse texture in an atlas, offset in
+		  * xy and scale in zw. (0, 0, 1, 1) for whole textures
+		*/
+		float texRect[4];
+
+		/// the texture fields default to a whole texture
+		Material() {
+			texLayer = 0;
+			pad = 0.0f;
+			texRect[0] = 0.0f; texRect[1] = 0.0f;
+			texRect[2] = 1.0f; texRect[3] = 1.0f;
+		}
 	};
 
 	/// material semantics
@@ -96,7 +119,9 @@ public:
 		SPECULAR,
 		EMISSIVE,
 		SHININESS,
-		TEX_COUNT
+		TEX_COUNT,
+		TEX_LAYER,
+		TEX_RECT
 	} MaterialComponent;
 
 	enum MaterialColors {
@@ -148,12 +173,31 @@ public:
 	virtual void setTexture(unsigned int unit, unsigned int textureID,
 							GLenum textureType = GL_TEXTURE_2D) {};
 
+	/** loads an image into a 2D texture
+	  * \param mipmap if true the mip chain is built with the
+	  *		options set in VSImageLib::setMipOptions
+	  * \param compress if true the texture is block compressed by
+	  *		VSImageLib (BC7, or BC1/BC3), and stored in its cache
+	  *		directory, if set, to be loaded directly next time
+	*/
 	static unsigned int loadRGBATexture(std::string filename, bool mipmap = true,
 										bool compress = false,
 										GLenum aFilter = GL_LINEAR, GLenum aRepMode = GL_REPEAT);
 	static unsigned int loadCubeMapTexture(	std::string posX, std::string negX,
 											   std::string posY, std::string negY,
 											   std::string posZ, std::string negZ);
+#if !defined(__ANDROID_API__)
+	/** Decodes an image, builds the mip chain and compresses it,
+	  * or reads the result from the VSImageLib cache. Issues no
+	  * OpenGL calls and can be called from any thread
+	  * \param format RGBA8, BC7, or BC1 which turns into BC3 for
+	  *		images with transparency
+	  * \param info output, a message for the log
+	  * \return false if the image could not be loaded
+	*/
+	static bool decodeImage(const std::string &filename, bool mipmap, VSImageLib::Format format,
+							VSImageLib::Image &image, std::string &info);
+#endif
 #endif
 	/// const to ease future upgrades
 	static const int MAX_TEXTURES = 8;
@@ -189,6 +233,30 @@ protected:
 
 	/// set the material uniforms
 	void setMaterial(Material &aMat);
+	/** returns the address of a material field
+	  * \param size output, the size of the field in bytes
+	*/
+	static void *getMaterialField(Material &aMat, MaterialSemantics field, int &size);
+
+#if defined(__VSL_TEXTURE_LOADING__) && !defined(__ANDROID_API__)
+	/** creates a 2D texture with the levels of an image, through
+	  * VSUploadLib. The levels are moved out of the image
+	*/
+	static GLuint createTexture(VSImageLib::Image &image, GLenum aFilter, GLenum aRepMode);
+	/// DevIL is not thread safe
+	static std::mutex sDevILMutex;
+	static bool sDevILReady;
+#endif
+
+	/// textures from VSTextureLib referenced by this resource
+	std::vector<GLuint> mHeldTextures;
+	/** keeps a registry reference to be released when the
+	  * resource is destroyed. The reference is not incremented,
+	  * it is transferred from the caller
+	*/
+	void holdTexture(GLuint textureID);
+	/// gives back a reference taken with holdTexture, if any
+	void releaseTexture(GLuint textureID);
 
 
 	std::map<std::string, MaterialSemantics> mMatSemanticMap;
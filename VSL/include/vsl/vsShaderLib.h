@@ -11,6 +11,14 @@
  * This class aims at making life simpler
  * when using shaders and uniforms
  *
+ * version 0.2.4
+ *		Added queries for block bindings and offsets
+ *		Added a query for the attributes read by a program
+ *		Temporary buffers come from VSMemoryLib
+ *
+ * version 0.2.3
+ *		Added per instance attribute locations
+ *
  * version 0.2.2
  *		Added image load store types
  *
@@ -64,7 +72,13 @@ public:
 		VERTEX_ATTRIB1,
 		VERTEX_ATTRIB2,
 		VERTEX_ATTRIB3,
-		VERTEX_ATTRIB4
+		VERTEX_ATTRIB4,
+		/// per instance mat4, takes four locations (9 to 12)
+		INSTANCE_MATRIX_ATTRIB,
+		/// per instance color
+		INSTANCE_COLOR_ATTRIB = INSTANCE_MATRIX_ATTRIB + 4,
+		INSTANCE_ATTRIB1,
+		INSTANCE_ATTRIB2
 	};
 
 	/// Types of Shaders
@@ -157,6 +171,20 @@ public:
 								std::string uniformName,
 								int arrayIndex, 
 								void * value);
+	/** gets the binding point and the size of a block
+	  * \return false if the block is not in any program
+	*/
+	static bool getBlockBinding(std::string name, GLuint &bindingIndex, int &size);
+	/// returns the offset of a uniform inside a block, -1 if not found
+	static int getBlockUniformOffset(std::string blockName, std::string uniformName);
+	/** binds the block's own buffer to its binding point, after
+	  * another buffer has been bound there
+	*/
+	static void bindBlockBuffer(std::string name);
+	/** returns a bit mask with the locations of the vertex
+	  * attributes that a linked program reads
+	*/
+	static unsigned int getActiveAttribLocations(GLuint program);
 
 	/// returns the program index
 	GLuint getProgramIndex();
@@ -0,0 +1,261 @@
+/** ----------------------------------------------------------
+ * \class VSTextureLib
+ *
+ * Lighthouse3D
+ *
+ * VSTextureLib - Very Simple Texture Library
+ *
+ * \version 0.1.1
+ *		Textures can be streamed by VSTextureStreamLib
+ *		Textures built from other textures, such as arrays, can be registered
+ *		Memory budget, least recently used textures lose their top levels
+ *		Textures defined by the VSUploadLib thread are measured once ready
+ *
+ * \version 0.1.0
+ *		Initial Release
+ *
+ * This lib keeps a process wide registry of the textures loaded
+ * from image files. Textures are identified by the canonical path
+ * of the image(s) and the parameters used to load them, so that
+ * two resources asking for the same image share a single
+ * OpenGL texture. Textures are reference counted and deleted
+ * when the last user releases them.
+ *
+ * The registry also tracks the memory taken by the textures and
+ * can keep it within a budget (see setBudget).
+ *
+ * This lib requires the following classes from VSL:
+ * (http://www.lighthouse3d.com/very-simple-libs)
+ *
+ * VSResourceLib
+ * VSTextureStreamLib
+ * VSImageLib
+ * VSLogLib
+ *
+ * and the following third party libs:
+ *
+ * GLEW (http://glew.sourceforge.net/),
+ * DevIL (http://openil.sourceforge.net/)
+ *
+ * Full documentation at
+ * http://www.lighthouse3d.com/very-simple-libs
+ *
+ ---------------------------------------------------------------*/
+
+#ifndef __VSTextureLib__
+#define __VSTextureLib__
+
+#include "vslConfig.h"
+
+#include "vsImageLib.h"
+#include "vsLogLib.h"
+
+#include <string>
+#include <map>
+#include <vector>
+
+#ifdef __ANDROID_API__
+#include <GLES3/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+
+class VSTextureLib {
+
+public:
+
+#if defined(__VSL_TEXTURE_LOADING__)
+
+	/** Returns a 2D texture for an image file. The image is only
+	  * loaded if there is no texture for the same file and parameters
+	  * in the registry. The caller owns one reference and must
+	  * call release when done with it.
+	  * \return the texture name, or zero if the image could not be loaded
+	*/
+	static GLuint acquireTexture(std::string filename, bool mipmap = true,
+						bool compress = false,
+						GLenum aFilter = GL_LINEAR, GLenum aRepMode = GL_REPEAT);
+
+	/// same as acquireTexture, for cube maps
+	static GLuint acquireCubeMapTexture(std::string posX, std::string negX,
+						std::string posY, std::string negY,
+						std::string posZ, std::string negZ);
+
+#if !defined(__ANDROID_API__)
+	/** same as acquireTexture, but the image is loaded by
+	  * VSTextureStreamLib. The texture is returned at once and is
+	  * filled in by VSTextureStreamLib::update. Shares the registry
+	  * entries of acquireTexture
+	*/
+	static GLuint acquireTextureAsync(std::string filename, bool mipmap = true,
+						bool compress = false,
+						GLenum aFilter = GL_LINEAR, GLenum aRepMode = GL_REPEAT);
+
+	/// same as acquireTextureAsync, for cube maps
+	static GLuint acquireCubeMapTextureAsync(std::string posX, std::string negX,
+						std::string posY, std::string negY,
+						std::string posZ, std::string negZ);
+#endif
+#endif
+
+	/** returns a key for a texture built from other textures, made
+	  * from their keys, so that the same sources give the same key
+	  * \param kind how the sources are combined, and its parameters
+	*/
+	static std::string getPackedKey(const std::string &kind, const std::vector<GLuint> &sources);
+	/// returns the texture registered with a key, with a new reference, or zero
+	static GLuint acquirePacked(const std::string &key);
+	/** registers a texture built by the caller, who owns
+	  * the first reference
+	  * \param target GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY
+	*/
+	static GLuint registerPacked(const std::string &key, GLuint textureID, GLenum target);
+
+	/// adds a reference to a registered texture. Unknown textures are ignored
+	static void retain(GLuint textureID);
+
+	/** Removes a reference to a registered texture. The texture is
+	  * deleted when no references are left. Unknown textures are ignored
+	*/
+	static void release(GLuint textureID);
+
+	/// returns true if the texture is managed by the registry
+	static bool isRegistered(GLuint textureID);
+
+	/// returns the number of references to a texture, zero if unknown
+	static int getRefCount(GLuint textureID);
+
+	/// returns the number of textures in the registry
+	static size_t getTextureCount();
+
+	/// returns the absolute path of a file, with symbolic links resolved
+	static std::string getCanonicalPath(std::string filename);
+
+#if !defined(__ANDROID_API__)
+	/** Sets a budget, in bytes, for the memory taken by the registered
+	  * textures. Zero, the default, disables it.
+	  *
+	  * 2D textures loaded by acquireTexture while a budget is set are
+	  * managed: when the textures exceed the budget, the least recently
+	  * used ones lose their top levels, down to setMinResidentSize, and
+	  * are reloaded from their files once they are bound again.
+	  * Other textures are counted, but kept whole. Streamed textures
+	  * are counted once complete.
+	  * \param restorePerUpdate bytes reloaded per call to updateResidency
+	*/
+	static void setBudget(size_t bytes, size_t restorePerUpdate = 16 << 20);
+	static size_t getBudget();
+	/// managed textures keep at least this size, in texels, 64 by default
+	static void setMinResidentSize(unsigned int texels);
+
+	/** Call once per frame, after rendering. Reloads the managed
+	  * textures bound since the last call, and reduces the least
+	  * recently used ones until the budget is met. Textures bound
+	  * since the last call are not reduced
+	*/
+	static void updateResidency();
+	/// marks a texture as used in this frame. Called by the libs when binding textures
+	static void touch(GLuint textureID);
+
+	/// returns the bytes taken by all the registered textures
+	static size_t getResidentBytes();
+	/// returns the bytes taken by a texture, all levels and faces
+	static size_t getTextureBytes(GLuint textureID);
+	/// returns the number of top levels a managed texture is missing
+	static int getDroppedLevels(GLuint textureID);
+
+	/// returns the files that could not be loaded
+	static std::string getErrors();
+	/// returns the files loaded
+	static std::string getInfo();
+#endif
+
+protected:
+
+	/// registry entry
+	struct TextureEntry {
+		/// key built from the file name(s) and load parameters
+		std::string key;
+		/// GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP or GL_TEXTURE_2D_ARRAY
+		GLenum target;
+		/// number of users
+		int refCount;
+		/// bytes in video memory
+		size_t bytes;
+		/// false for streamed textures until they are complete
+		bool measured;
+		/// frame of the last bind
+		unsigned int lastUsed;
+
+		/// managed textures are reloaded from their file
+		bool managed;
+		std::string filename;
+		bool mipmap;
+		VSImageLib::Format format;
+		/// size and levels of the whole image
+		unsigned int width, height;
+		int levels;
+		/// top levels that are not in memory
+		int dropped;
+	};
+
+	/// maps keys to texture names
+	static std::map<std::string, GLuint> sKeys;
+	/// maps texture names to registry entries
+	static std::map<GLuint, TextureEntry> sTextures;
+
+	/// adds a reference to an existing entry or registers a new texture
+	static GLuint registerTexture(const std::string &key, GLuint textureID, GLenum target);
+
+#if !defined(__ANDROID_API__)
+	static VSLogLib sLogError, sLogInfo;
+
+	static size_t sBudget;
+	static size_t sRestorePerUpdate;
+	static unsigned int sMinResidentSize;
+	/// sum of the bytes of the entries
+	static size_t sResidentBytes;
+	/// incremented by updateResidency
+	static unsigned int sFrame;
+
+	/// queries the size of the levels of a texture
+	static size_t measureTexture(GLuint textureID, GLenum target);
+	static void setEntryBytes(TextureEntry &entry, size_t bytes);
+	/// bytes of a managed texture without its top levels
+	static size_t getManagedBytes(const TextureEntry &entry, int dropped);
+	/// levels that can be dropped keeping the minimum size
+	static int getMaxDropped(const TextureEntry &entry);
+	/// drops top levels of the least recently used textures until the bytes are within target
+	static void reduceResidency(size_t target);
+	/** changes the levels in memory of a managed texture. Levels are
+	  * copied on the GPU when dropping, or read from the file
+	*/
+	static bool setDroppedLevels(GLuint textureID, TextureEntry &entry, int dropped);
+	/** respecifies the levels of the bound, mutable, 2D texture,
+	  * starting at level first of the image, and frees the levels
+	  * after them up to previousLevels
+	  * \param data the image contents, or NULL to leave them undefined
+	*/
+	static void specifyLevels(VSImageLib::Format format, unsigned int width, unsigned int height,
+						int levels, int first, int previousLevels, const VSImageLib::Image *data);
+#if defined(__VSL_TEXTURE_LOADING__)
+	/// loads an image into a mutable texture that can be managed
+	static GLuint loadManaged(const std::string &filename, bool mipmap, bool compress,
+						GLenum aFilter, GLenum aRepMode, VSImageLib::Image &image);
+#endif
+#endif
+
+#if defined(__VSL_TEXTURE_LOADING__)
+	/// registry keys
+	static std::string getTextureKey(const std::string &filename, bool mipmap, bool compress,
+						GLenum aFilter, GLenum aRepMode);
+	static std::string getCubeMapKey(std::string posX, std::string negX,
+						std::string posY, std::string negY,
+						std::string posZ, std::string negZ);
+#endif
+	/// returns the registered texture for a key, with a new reference, or zero
+	static GLuint findTexture(const std::string &key);
+};
+
+#endif
@@ -0,0 +1,213 @@
+/** ----------------------------------------------------------
+ * \class VSTextureStreamLib
+ *
+ * Lighthouse3D
+ *
+ * VSTextureStreamLib - Very Simple Texture Streaming Library
+ *
+ * \version 0.1.1
+ *		Textures can be uploaded by the VSUploadLib thread
+ *
+ * \version 0.1.0
+ *		Initial Release
+ *
+ * This lib loads textures without blocking the frame. Images are
+ * decoded, and compressed, by worker threads. The levels are then
+ * copied to a persistently mapped pixel unpack buffer ring and
+ * uploaded from there, the coarsest levels first, a few per frame.
+ * Textures are returned at once with a 1x1 grey image, and sharpen
+ * as levels arrive. When VSUploadLib is running, the levels are
+ * uploaded by its thread instead, a texture at a time.
+ *
+ * The application must call update once per frame, with the
+ * context current. All functions must be called from the thread
+ * that owns the context.
+ *
+ * This lib requires the following classes from VSL:
+ * (http://www.lighthouse3d.com/very-simple-libs)
+ *
+ * VSResourceLib
+ * VSImageLib
+ * VSUploadLib
+ * VSThreadLib
+ * VSLogLib
+ *
+ * and the following third party libs:
+ *
+ * GLEW (http://glew.sourceforge.net/),
+ * DevIL (http://openil.sourceforge.net/)
+ *
+ * Full documentation at
+ * http://www.lighthouse3d.com/very-simple-libs
+ *
+ ---------------------------------------------------------------*/
+
+#ifndef __VSTextureStreamLib__
+#define __VSTextureStreamLib__
+
+#include "vslConfig.h"
+
+#if defined(__VSL_TEXTURE_LOADING__) && !defined(__ANDROID_API__)
+
+#include "vsImageLib.h"
+#include "vsLogLib.h"
+#include "vsUploadLib.h"
+
+#include <string>
+#include <deque>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+
+
+class VSTextureStreamLib {
+
+public:
+
+	/** Queues an image file for loading and returns a texture with
+	  * a 1x1 placeholder. The parameters are the same as in
+	  * VSResourceLib::loadRGBATexture
+	  * \return the texture name, never zero
+	*/
+	static GLuint load(std::string filename, bool mipmap = true, bool compress = false,
+					GLenum aFilter = GL_LINEAR, GLenum aRepMode = GL_REPEAT);
+
+	/// same as load, for cube maps. Faces are not mipmapped nor compressed
+	static GLuint loadCubeMap(std::string posX, std::string negX,
+					std::string posY, std::string negY,
+					std::string posZ, std::string negZ);
+
+	/** Uploads the levels decoded since the last call, within the
+	  * per frame budget, and logs the loaded files. Never waits
+	  * for the worker nor the GPU. Call once per frame
+	*/
+	static void update();
+
+	/// waits for all queued textures to be decoded and uploaded
+	static void finish();
+
+	/** Stops loading a texture. Must be called before deleting a
+	  * texture that may still be pending
+	*/
+	static void cancel(GLuint textureID);
+
+	/// returns true if the texture has not been fully uploaded yet
+	static bool isPending(GLuint textureID);
+	/// returns the number of textures not fully uploaded
+	static unsigned int getPendingCount();
+
+	/** Sets the size of the pixel unpack ring, 16 MB by default.
+	  * Levels larger than the ring are uploaded from client memory
+	*/
+	static void setRingSize(size_t bytes);
+	/// sets the bytes uploaded per update, 4 MB by default
+	static void setUploadBudget(size_t bytes);
+	/** Sets the number of threads decoding textures at the same
+	  * time. Zero, the default, means half the hardware threads
+	*/
+	static void setWorkerCount(unsigned int count);
+
+	/// stops the workers and deletes the ring. Pending textures keep their placeholders
+	static void shutdown();
+
+	/// returns the files that could not be loaded
+	static std::string getErrors();
+	/// returns the files loaded
+	static std::string getInfo();
+
+protected:
+
+	static VSLogLib sLogError, sLogInfo;
+
+	/// a texture being loaded
+	struct Job {
+		GLuint texture;
+		/// GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP
+		GLenum target;
+		/// one file for 2D textures, six for cube maps
+		std::string files[6];
+		unsigned int faces;
+		bool mipmap;
+		VSImageLib::Format format;
+		GLenum filter;
+		std::atomic<bool> cancelled;
+
+		/// set by the worker
+		VSImageLib::Image images[6];
+		bool ok;
+		std::string info;
+
+		/// upload progress, levels go from the last to zero
+		bool allocated;
+		int level;
+		unsigned int face;
+		/// the VSUploadLib job that uploads the texture, if any
+		VSUploadLib::Ticket ticket;
+	};
+
+	/// a range of the ring in use by the GPU
+	struct Region {
+		size_t offset;
+		GLsync fence;
+	};
+
+	/// joins the workers at exit
+	struct Worker {
+		std::vector<std::thread> threads;
+		~Worker();
+	};
+
+	/// shared with the workers
+	static std::mutex sMutex;
+	static std::condition_variable sCond;
+	static std::deque<std::shared_ptr<Job> > sQueue;
+	static std::deque<std::shared_ptr<Job> > sDecoded;
+	/// the jobs being decoded
+	static unsigned int sBusy;
+	static unsigned int sMaxWorkers;
+	static bool sStop;
+	static Worker sWorker;
+
+	/// context thread only
+	static std::map<GLuint, std::shared_ptr<Job> > sJobs;
+	static std::deque<std::shared_ptr<Job> > sUploads;
+
+	static GLuint sRing;
+	static unsigned char *sRingPtr;
+	static size_t sRingSize;
+	static size_t sRingHead;
+	static std::deque<Region> sRegions;
+	static size_t sUploadBudget;
+
+	static void workerLoop();
+	static void decode(Job &job);
+	static GLuint queue(std::shared_ptr<Job> job, GLenum aRepMode);
+
+	/// uploads levels until the budget runs out, block waits for ring space
+	static void upload(size_t budget, bool block);
+	/// allocates the levels of the texture, and sets the filters
+	static void allocate(Job &job);
+	/// allocates and uploads all the levels, in the uploader thread
+	static void uploadAll(Job &job);
+	/** uploads the next face level of a job.
+	  * \param force use client memory if the ring is full
+	  * \return false if nothing was uploaded
+	*/
+	static bool uploadLevel(Job &job, bool force, bool block);
+	/// returns an offset in the ring, or -1 if there is no room
+	static long long allocateRing(size_t size, bool block);
+	/// frees the regions the GPU is done with
+	static void retireRegions(bool block);
+	static void createRing();
+	static void deleteRing();
+};
+
+#endif
+
+#endif
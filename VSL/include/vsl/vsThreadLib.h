@@ -0,0 +1,90 @@
+/** ----------------------------------------------------------
+ * \class VSThreadLib
+ *
+ * Lighthouse3D
+ *
+ * VSThreadLib - Very Simple Thread Library
+ *
+ * \version 0.1.0
+ *		Initial Release
+ *
+ * This lib provides helpers to spread CPU work, such as
+ * mesh processing, across the available cores.
+ * No OpenGL calls should be issued from the jobs.
+ *
+ * The worker threads are created on first use and kept until
+ * exit, so that their thread local data, such as the VSMemoryLib
+ * scratch arenas, is reused by later calls.
+ *
+ * Full documentation at
+ * http://www.lighthouse3d.com/very-simple-libs
+ *
+ ---------------------------------------------------------------*/
+
+#ifndef __VSThreadLib__
+#define __VSThreadLib__
+
+#include <functional>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+
+class VSThreadLib {
+
+public:
+
+	/** Calls job(i) for i in [0, count), using up to maxThreads
+	  * threads, the calling thread included. Returns when all
+	  * jobs are done. Jobs are handed out one at a time, so
+	  * jobs of very different sizes are balanced. Jobs may call
+	  * parallelFor as well.
+	  * \param count the number of jobs
+	  * \param job the function to call for each index
+	  * \param maxThreads zero means one per hardware thread
+	*/
+	static void parallelFor(unsigned int count,
+							const std::function<void(unsigned int)> &job,
+							unsigned int maxThreads = 0);
+
+	/// returns the number of hardware threads, at least one
+	static unsigned int getHardwareThreads();
+
+	/// returns the number of worker threads created so far
+	static unsigned int getWorkerCount();
+
+protected:
+
+	/// the jobs of a parallelFor call
+	struct Batch {
+		const std::function<void(unsigned int)> *job;
+		unsigned int count;
+		std::atomic<unsigned int> next;
+		/// workers that may join, and those that did
+		unsigned int helpers, joined;
+		/// workers still running jobs of the batch
+		unsigned int active;
+	};
+
+	/// joins the workers at exit
+	struct Pool {
+		std::vector<std::thread> threads;
+		~Pool();
+	};
+
+	static std::mutex sMutex;
+	static std::condition_variable sWork, sDone;
+	static std::deque<Batch *> sBatches;
+	static bool sStop;
+	static Pool sPool;
+
+	/// returns a batch a worker can join, or NULL
+	static Batch *findBatch();
+	static void workerLoop();
+	static void runJobs(Batch &batch);
+};
+
+#endif
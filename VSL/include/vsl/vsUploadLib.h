@@ -0,0 +1,164 @@
+/** ----------------------------------------------------------
+ * \class VSUploadLib
+ *
+ * Lighthouse3D
+ *
+ * VSUploadLib - Very Simple Upload Library
+ *
+ * \version 0.1.0
+ *		Initial Release
+ *
+ * This lib moves buffer and texture uploads off the render
+ * thread. An uploader thread, with a context that shares objects
+ * with the render context, runs the jobs in order and places a
+ * fence after each one. The render thread checks the fence before
+ * the first use of the objects created by a job.
+ *
+ * The application creates the shared context, since this depends
+ * on the windowing system, and passes a function that makes it
+ * current on the calling thread:
+ *
+ *	VSUploadLib::start([=] {
+ *		return eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, shared);
+ *	});
+ *
+ * Once started, VSModelLib buffers and the textures created by
+ * VSResourceLib, VSTextureStreamLib and thus VSFontLib are uploaded
+ * by this thread. Vertex array objects are not shared between
+ * contexts and are still created by the render thread. Without
+ * the uploader, jobs run at once in the calling thread.
+ *
+ * Functions other than start and stop must be called from the
+ * render thread.
+ *
+ * This lib requires the following classes from VSL:
+ * (http://www.lighthouse3d.com/very-simple-libs)
+ *
+ * VSLogLib
+ *
+ * and the following third party libs:
+ *
+ * GLEW (http://glew.sourceforge.net/)
+ *
+ * Full documentation at
+ * http://www.lighthouse3d.com/very-simple-libs
+ *
+ ---------------------------------------------------------------*/
+
+#ifndef __VSUploadLib__
+#define __VSUploadLib__
+
+#include "vslConfig.h"
+
+#if !defined(__ANDROID_API__)
+
+#include "vsLogLib.h"
+
+#include <string>
+#include <deque>
+#include <map>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include <GL/glew.h>
+
+
+class VSUploadLib {
+
+public:
+
+	/// identifies a job, zero is never used
+	typedef unsigned int Ticket;
+
+	/** Starts the uploader thread. The thread calls makeCurrent
+	  * first, and doneCurrent, if any, before exiting
+	  * \return false if makeCurrent failed, jobs then run in the
+	  * calling thread
+	*/
+	static bool start(const std::function<bool()> &makeCurrent,
+					const std::function<void()> &doneCurrent = std::function<void()>());
+
+	/// runs the queued jobs, and stops the uploader thread
+	static void stop();
+
+	/// returns true if the uploader thread is running
+	static bool isRunning();
+
+	/** Queues a job for the uploader thread. The job must not
+	  * touch vertex array objects nor framebuffers, as these are
+	  * not shared. Without the uploader, runs it at once
+	*/
+	static Ticket submit(const std::function<void()> &job);
+
+	/** Same as submit, for jobs that define a texture. The texture
+	  * name must have been generated by the render thread
+	*/
+	static Ticket submitTexture(GLuint textureID, const std::function<void()> &job);
+
+	/** Returns true once the job and its GL commands are done,
+	  * and its objects can be used. Never waits
+	*/
+	static bool isReady(Ticket ticket);
+	/// waits for a job to be done
+	static void wait(Ticket ticket);
+
+	/// returns true unless the texture is being defined by a job
+	static bool isTextureReady(GLuint textureID) {
+		return sTextures.empty() || checkTexture(textureID, false);
+	}
+	/// waits for the job that defines the texture, if any
+	static void waitTexture(GLuint textureID);
+
+	/// waits for all the jobs
+	static void finish();
+
+	/// returns the number of jobs not done yet
+	static unsigned int getPendingCount();
+
+	/// returns the errors found
+	static std::string getErrors();
+
+protected:
+
+	static VSLogLib sLogError;
+
+	/// a job queued or done, done jobs keep the fence until checked
+	struct Job {
+		std::function<void()> work;
+		/// the render thread commands issued before the job
+		GLsync start;
+		bool done;
+		GLsync fence;
+	};
+
+	/// joins the uploader at exit
+	struct Worker {
+		std::thread thread;
+		~Worker();
+	};
+
+	/// shared with the uploader
+	static std::mutex sMutex;
+	static std::condition_variable sCond;
+	static std::map<Ticket, Job> sJobs;
+	static std::deque<Ticket> sQueue;
+	static bool sRunning;
+	static bool sStop;
+	static Worker sWorker;
+
+	/// render thread only, textures being defined and their jobs
+	static std::map<GLuint, Ticket> sTextures;
+	static Ticket sNextTicket;
+
+	static void workerLoop(std::function<bool()> makeCurrent,
+					std::function<void()> doneCurrent, int *result);
+	/// waits on the fence of a done job, forever if block is true
+	static bool retire(Ticket ticket, bool block);
+	static bool checkTexture(GLuint textureID, bool block);
+};
+
+#endif
+
+#endif
@@ -23,13 +23,21 @@
 
 #include "vsGeometryLib.h"
 #include "vsGLInfoLib.h"
+#include "vsImageLib.h"
 #include "vsLogLib.h"
 #include "vsMathLib.h"
+#include "vsMemoryLib.h"
 #include "vsModelLib.h"
 #include "vsProfileLib.h"
+#include "vsReadbackLib.h"
+#include "vsRenderTargetLib.h"
 #include "vsResourceLib.h"
 #include "vsShaderLib.h"
 #include "vsSurfRevLib.h"
+#include "vsTextureLib.h"
+#include "vsTextureStreamLib.h"
+#include "vsThreadLib.h"
+#include "vsUploadLib.h"
 
 #ifdef  __VSL_TEXTURE_LOADING__
 #include "vsFontLib.h"
@@ -8,6 +8,9 @@ http://www.lighthouse3d.com/very-simple-libs
 
 ----------------------------------------------------*/
 #include "vsFontLib.h"
+#include "vsTextureLib.h"
+#include "vsMemoryLib.h"
+#include "vsUploadLib.h"
 
 #if defined (__VSL_FONT_LOADING__)
 
@@ -131,16 +134,18 @@ VSFontLib::load(std::string fontName)
         return content;
     }
     size_t size = (size_t)AAsset_getLength(asset);
-    content = (char*)malloc(sizeof(char)*size + 1);
+    content = VSMemoryLib::allocateArray<char>(size + 1);
     AAsset_read(asset, content, size);
     content[size] = '\0';
     __android_log_print(ANDROID_LOG_DEBUG, loc, "%s", content);
     AAsset_close(asset);
 
 	loadOK = doc.Parse(content);
+	VSMemoryLib::release(content);
 #endif
 
-	mFontTex = VSResourceLib::loadRGBATexture(st);
+	mFontTex = VSTextureLib::acquireTexture(st);
+	holdTexture(mFontTex);
 
 	if (!loadOK) {
 		VSResourceLib::sLogError.addMessage("Problem reading the XML font definition file: %s", sf.c_str());
@@ -263,10 +268,12 @@ VSFontLib::prepareSentence(unsigned int index, std::string sentence)
 	// clear previous sentence data if reusing
 	mSentences[index].clear();
 
-	// allocate temporary arrays for vertex and texture coordinates
+	// temporary arrays for vertex and texture coordinates,
+	// released when the scope ends
+	VSMemoryLib::ScratchScope scope;
 	int size = (int)sentence.length();
-	positions = (float *)malloc(sizeof(float) * size * 6 * 3);
-	texCoords = (float *)malloc(sizeof(float) * size * 6 * 2);
+	positions = VSMemoryLib::scratchArray<float>(size * 6 * 3);
+	texCoords = VSMemoryLib::scratchArray<float>(size * 6 * 2);
 
 	int i = 0;
 	for (int count = 0; count < size; count++) {
@@ -356,10 +363,6 @@ VSFontLib::prepareSentence(unsigned int index, std::string sentence)
 	// init the sentence
 	mSentences[index].initSentence(vao, buffer,size);
 
-	// delete temporary arrays
-	delete positions;
-	delete texCoords;
-
 }
 
 
@@ -368,6 +371,11 @@ VSFontLib::prepareSentence(unsigned int index, std::string sentence)
 void
 VSFontLib::renderSentence(int x, int y, unsigned int index)
 {
+#if !defined(__ANDROID_API__)
+	// the atlas may still be uploading in the VSUploadLib thread
+	if (!VSUploadLib::isTextureReady(mFontTex))
+		return;
+#endif
 	if (mSentences[index].getVAO()) {
 
 		prepareRender((float)x,(float)y);
@@ -377,6 +385,9 @@ VSFontLib::renderSentence(int x, int y, unsigned int index)
 
 		glActiveTexture(GL_TEXTURE0);
 		glBindTexture(GL_TEXTURE_2D, mFontTex);
+#if !defined(__ANDROID_API__)
+		VSTextureLib::touch(mFontTex);
+#endif
 
 		mVSML->matricesToGL();		
 		glBindVertexArray(mSentences[index].getVAO());
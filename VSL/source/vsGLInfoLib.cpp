@@ -17,6 +17,7 @@
  ---------------------------------------------------------------*/
 
 #include "vsGLInfoLib.h"
+#include "vsMemoryLib.h"
 
 // static local variables
 std::map<int, std::string> VSGLInfoLib::spInternalF;
@@ -526,6 +527,7 @@ VSGLInfoLib::getVAOInfo(unsigned int buffer) {
 void
 VSGLInfoLib::getUniformsInfo(unsigned int program) {
 
+	VSMemoryLib::ScratchScope scope;
 	addNewLine();
 
 	// is it a program ?
@@ -584,7 +586,7 @@ VSGLInfoLib::getUniformsInfo(unsigned int program) {
 		glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &activeUnif);
 
 		unsigned int *indices;
-		indices = (unsigned int *)malloc(sizeof(unsigned int) * activeUnif);
+		indices = VSMemoryLib::scratchArray<unsigned int>(activeUnif);
 		glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, (int *)indices);
 			
 		for (int k = 0; k < activeUnif; ++k) {
@@ -16,6 +16,9 @@ VSSurfRevLib VSCartesian::sSphere;
 
 bool VSCartesian::sInit = false;
 
+VSCartesian::Batch VSCartesian::sBatches[3];
+VSSurfRevLib *VSCartesian::sPrimitives[3] = { &sSphere, &sCone, &sCylinder };
+
 
 bool
 VSCartesian::Init() {
@@ -34,6 +37,57 @@ VSCartesian::VSCartesian() {}
 VSCartesian::~VSCartesian() {}
 
 
+void
+VSCartesian::addToBatch() {
+
+	for (unsigned int i = 0; i < mMyMeshes.size(); ++i) {
+
+		// all meshes come from the primitives and share their geometry
+		int p = 0;
+		while (p < 3 && mMyMeshes[i].geometry != sPrimitives[p]->mMyMeshes[0].geometry)
+			++p;
+		if (p == 3)
+			continue;
+
+		mVSML->pushMatrix(VSMathLib::MODEL);
+		mVSML->multMatrix(VSMathLib::MODEL, mMyMeshes[i].transform);
+		float *m = mVSML->get(VSMathLib::MODEL);
+		sBatches[p].matrices.insert(sBatches[p].matrices.end(), m, m + 16);
+		mVSML->popMatrix(VSMathLib::MODEL);
+
+		float *c = mMyMeshes[i].mat.diffuse;
+		sBatches[p].colors.insert(sBatches[p].colors.end(), c, c + 4);
+	}
+}
+
+
+void
+VSCartesian::renderBatch() {
+
+	if (!sInit)
+		return;
+
+	// the model matrix is already in the instance matrices
+	VSMathLib *vsml = VSMathLib::getInstance();
+	vsml->pushMatrix(VSMathLib::MODEL);
+	vsml->loadIdentity(VSMathLib::MODEL);
+
+	for (int p = 0; p < 3; ++p) {
+
+		Batch &b = sBatches[p];
+		unsigned int count = (unsigned int)(b.matrices.size() / 16);
+		if (count == 0)
+			continue;
+		sPrimitives[p]->setInstanceMatrices(count, &b.matrices[0]);
+		sPrimitives[p]->setInstanceColors(count, &b.colors[0]);
+		sPrimitives[p]->render(count);
+		b.matrices.clear();
+		b.colors.clear();
+	}
+	vsml->popMatrix(VSMathLib::MODEL);
+}
+
+
 
 /* -------------------------------------------------
 				POINT
@@ -488,7 +542,7 @@ VSPolyLine::prepare() {
 	size_t numP = mPolyLine.size();
 	if (mLoop)
 		numP++;
-	buildVAO(mMyMeshes[0], numP, (float *)&(pp[0]), NULL, NULL, NULL, NULL, 0, NULL);
+	updateMesh(0, numP, (float *)&(pp[0]), NULL, NULL, NULL, NULL, 0, NULL);
 
 	memcpy(mMyMeshes[0].transform, sIdentityMatrix, sizeof(float) * 16);
 	mMyMeshes[0].type = GL_LINE_STRIP;
@@ -599,7 +653,7 @@ VSDashedArc::prepare() {
 	p.push_back(mRadius * sin(angRad)); p.push_back(0); p.push_back(mRadius * cos(angRad)); p.push_back(1.0f);
 
 	mMyMeshes.resize(1);
-	buildVAO(mMyMeshes[0], p.size() / 4, &(p[0]), NULL, NULL, NULL, NULL, 0, NULL);
+	updateMesh(0, p.size() / 4, &(p[0]), NULL, NULL, NULL, NULL, 0, NULL);
 
 	memcpy(mMyMeshes[0].transform, sIdentityMatrix, sizeof(float) * 16);
 	mMyMeshes[0].type = GL_LINES;
@@ -758,7 +812,7 @@ VSCubicCurve::prepareCurve(int numPts) {
 	}
 
 	mMyMeshes.resize(1);
-	buildVAO(mMyMeshes[0], p.size() / 4, &(p[0]), NULL, NULL, NULL, NULL, 0, NULL);
+	updateMesh(0, p.size() / 4, &(p[0]), NULL, NULL, NULL, NULL, 0, NULL);
 
 	memcpy(mMyMeshes[0].transform, sIdentityMatrix, sizeof(float) * 16);
 	mMyMeshes[0].type = GL_LINE_STRIP;
@@ -1097,7 +1151,7 @@ VSCubicPatch::prepare() {
 		}
 	}
 	mMyMeshes.resize(1);
-	buildVAO(mMyMeshes[0], p.size()/4, &(p[0]), &(n[0]), &(tc[0]), &(tang[0]), &(bitang[0]), ind.size(), &(ind[0]));
+	updateMesh(0, p.size()/4, &(p[0]), &(n[0]), &(tc[0]), &(tang[0]), &(bitang[0]), ind.size(), &(ind[0]));
 
 	memcpy(mMyMeshes[0].transform, sIdentityMatrix, sizeof(float) * 16);
 	mMyMeshes[0].type = GL_TRIANGLES;
@@ -0,0 +1,789 @@
+/** ----------------------------------------------------------
+ * \class VSImageLib
+ *
+ * Lighthouse3D
+ *
+ * VSImageLib - Very Simple Image Library
+ *
+ * \version 0.1.1
+ *		Mip chains with Kaiser and sRGB correct filters, and alpha coverage
+ *		Textures are allocated with glTexStorage2D when available
+ *
+ * \version 0.1.0
+ *		Initial Release
+ *
+ * This lib provides CPU side image processing for textures:
+ * block compression (BC1, BC3, BC4, BC5 and BC7), mip chains,
+ * and DDS files to cache the results.
+ *
+ * Full documentation at
+ * http://www.lighthouse3d.com/very-simple-libs
+ *
+ ---------------------------------------------------------------*/
+
+#include "vsImageLib.h"
+#include "vsThreadLib.h"
+#include "vsMeshOptLib.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define __VSL_SSE__
+#endif
+
+
+std::string VSImageLib::sCacheDirectory = "";
+VSImageLib::MipOptions VSImageLib::sMipOptions;
+
+
+size_t
+VSImageLib::getLevelSize(Format format, unsigned int width, unsigned int height) {
+
+	if (format == RGBA8)
+		return (size_t)width * height * 4;
+
+	size_t blocks = (size_t)((width + 3) / 4) * ((height + 3) / 4);
+	if (format == BC1 || format == BC4)
+		return blocks * 8;
+	return blocks * 16;
+}
+
+
+bool
+VSImageLib::isOpaque(const Level &level) {
+
+	for (size_t i = 3; i < level.data.size(); i += 4)
+		if (level.data[i] != 255)
+			return false;
+	return true;
+}
+
+
+static float
+srgbToLinear(float c) {
+
+	return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+
+static float
+linearToSrgb(float c) {
+
+	return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+}
+
+
+// zero order modified Bessel function of the first kind
+static float
+besselI0(float x) {
+
+	float sum = 1.0f, term = 1.0f;
+	for (int k = 1; k < 16; ++k) {
+		term *= (x * 0.5f / k) * (x * 0.5f / k);
+		sum += term;
+	}
+	return sum;
+}
+
+
+void
+VSImageLib::downsample(const std::vector<float> &src, unsigned int width, unsigned int height,
+						MipFilter filter, std::vector<float> &dst,
+						unsigned int dstWidth, unsigned int dstHeight, unsigned int maxThreads) {
+
+	// taps relative to pixel 2x, for a dimension that halves
+	int first, taps;
+	float weights[8];
+	if (filter == MIP_BOX) {
+		first = 0;
+		taps = 2;
+		weights[0] = weights[1] = 0.5f;
+	}
+	else {
+		// sinc windowed by Kaiser (alpha 4), radius 2 destination pixels
+		first = -3;
+		taps = 8;
+		float sum = 0.0f;
+		for (int k = 0; k < taps; ++k) {
+			float t = (first + k - 0.5f) * 0.5f;
+			float x = t / 2.0f;
+			float sinc = sinf(3.14159265f * t) / (3.14159265f * t);
+			weights[k] = sinc * besselI0(4.0f * sqrtf(std::max(0.0f, 1.0f - x * x))) / besselI0(4.0f);
+			sum += weights[k];
+		}
+		for (int k = 0; k < taps; ++k)
+			weights[k] /= sum;
+	}
+	float one = 1.0f;
+
+	// horizontal pass, then vertical, both with four channels at a time
+	std::vector<float> tmp((size_t)dstWidth * height * 4);
+	bool halveX = width > 1, halveY = height > 1;
+
+	VSThreadLib::parallelFor(height, [&](unsigned int y) {
+
+		const float *row = &src[(size_t)y * width * 4];
+		for (unsigned int x = 0; x < dstWidth; ++x) {
+			int n = halveX ? taps : 1, base = halveX ? (int)x * 2 + first : (int)x;
+			const float *w = halveX ? weights : &one;
+#if defined(__VSL_SSE__)
+			__m128 acc = _mm_setzero_ps();
+			for (int k = 0; k < n; ++k) {
+				int sx = std::min(std::max(base + k, 0), (int)width - 1);
+				acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(row + sx * 4)));
+			}
+			_mm_storeu_ps(&tmp[((size_t)y * dstWidth + x) * 4], acc);
+#else
+			float acc[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (int k = 0; k < n; ++k) {
+				int sx = std::min(std::max(base + k, 0), (int)width - 1);
+				for (int c = 0; c < 4; ++c)
+					acc[c] += w[k] * row[sx * 4 + c];
+			}
+			memcpy(&tmp[((size_t)y * dstWidth + x) * 4], acc, sizeof(acc));
+#endif
+		}
+	}, maxThreads);
+
+	dst.resize((size_t)dstWidth * dstHeight * 4);
+	VSThreadLib::parallelFor(dstHeight, [&](unsigned int y) {
+
+		int n = halveY ? taps : 1, base = halveY ? (int)y * 2 + first : (int)y;
+		const float *w = halveY ? weights : &one;
+		for (unsigned int x = 0; x < dstWidth; ++x) {
+#if defined(__VSL_SSE__)
+			__m128 acc = _mm_setzero_ps();
+			for (int k = 0; k < n; ++k) {
+				int sy = std::min(std::max(base + k, 0), (int)height - 1);
+				acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[k]),
+								_mm_loadu_ps(&tmp[((size_t)sy * dstWidth + x) * 4])));
+			}
+			// the negative lobes can leave the range
+			acc = _mm_min_ps(_mm_max_ps(acc, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+			_mm_storeu_ps(&dst[((size_t)y * dstWidth + x) * 4], acc);
+#else
+			float acc[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (int k = 0; k < n; ++k) {
+				int sy = std::min(std::max(base + k, 0), (int)height - 1);
+				for (int c = 0; c < 4; ++c)
+					acc[c] += w[k] * tmp[((size_t)sy * dstWidth + x) * 4 + c];
+			}
+			// the negative lobes can leave the range
+			for (int c = 0; c < 4; ++c)
+				dst[((size_t)y * dstWidth + x) * 4 + c] = std::min(std::max(acc[c], 0.0f), 1.0f);
+#endif
+		}
+	}, maxThreads);
+}
+
+
+// fraction of the pixels with alpha * scale at least ref
+static float
+alphaCoverage(const std::vector<float> &pixels, float scale, float ref) {
+
+	size_t count = pixels.size() / 4, passed = 0;
+	for (size_t i = 0; i < count; ++i)
+		if (pixels[i * 4 + 3] * scale >= ref)
+			passed++;
+	return count ? (float)passed / count : 0.0f;
+}
+
+
+void
+VSImageLib::buildMipChain(Image &image, const MipOptions &options, unsigned int maxThreads) {
+
+	if (image.format != RGBA8 || image.levels.empty())
+		return;
+	image.levels.resize(1);
+
+	float decode[256];
+	for (int i = 0; i < 256; ++i)
+		decode[i] = options.sRGB ? srgbToLinear(i / 255.0f) : i / 255.0f;
+
+	// levels are filtered from the previous one, kept in floating point
+	const Level &top = image.levels[0];
+	unsigned int width = top.width, height = top.height;
+	std::vector<float> current((size_t)width * height * 4), next;
+	for (size_t i = 0; i < top.data.size(); ++i)
+		current[i] = (i % 4 == 3) ? top.data[i] / 255.0f : decode[top.data[i]];
+
+	float coverage = 0.0f;
+	if (options.alphaCoverage > 0.0f)
+		coverage = alphaCoverage(current, 1.0f, options.alphaCoverage);
+
+	while (width > 1 || height > 1) {
+
+		Level dst;
+		dst.width = std::max(1u, width / 2);
+		dst.height = std::max(1u, height / 2);
+		downsample(current, width, height, options.filter, next, dst.width, dst.height, maxThreads);
+		current.swap(next);
+		width = dst.width;
+		height = dst.height;
+
+		// scale alpha to pass the test as often as in level zero
+		float scale = 1.0f;
+		if (options.alphaCoverage > 0.0f) {
+			float lo = 0.0f, hi = 4.0f;
+			for (int iter = 0; iter < 12; ++iter) {
+				scale = (lo + hi) * 0.5f;
+				if (alphaCoverage(current, scale, options.alphaCoverage) < coverage)
+					lo = scale;
+				else
+					hi = scale;
+			}
+		}
+
+		dst.data.resize(getLevelSize(RGBA8, width, height));
+		for (size_t i = 0; i < dst.data.size(); ++i) {
+			float v = current[i];
+			if (i % 4 == 3)
+				v = std::min(v * scale, 1.0f);
+			else if (options.sRGB)
+				v = linearToSrgb(v);
+			dst.data[i] = (unsigned char)(v * 255.0f + 0.5f);
+		}
+		image.levels.push_back(dst);
+	}
+}
+
+
+void
+VSImageLib::setMipOptions(const MipOptions &options) {
+
+	sMipOptions = options;
+}
+
+
+const VSImageLib::MipOptions &
+VSImageLib::getMipOptions() {
+
+	return sMipOptions;
+}
+
+
+std::string
+VSImageLib::getMipOptionsTag(const MipOptions &options) {
+
+	char tag[64];
+	snprintf(tag, 64, "|%s%s|%g", options.filter == MIP_BOX ? "box" : "kaiser",
+			options.sRGB ? "|srgb" : "", options.alphaCoverage);
+	return tag;
+}
+
+
+void
+VSImageLib::fetchBlock(const Level &level, unsigned int bx, unsigned int by,
+						unsigned char block[64]) {
+
+	for (unsigned int y = 0; y < 4; ++y) {
+		unsigned int sy = std::min(by * 4 + y, level.height - 1);
+		for (unsigned int x = 0; x < 4; ++x) {
+			unsigned int sx = std::min(bx * 4 + x, level.width - 1);
+			memcpy(block + (y * 4 + x) * 4, &level.data[(sy * level.width + sx) * 4], 4);
+		}
+	}
+}
+
+
+// principal axis of a set of points, by power iteration on the covariance
+static void
+principalAxis(const unsigned char block[64], int channels, float mean[4], float axis[4]) {
+
+	float minV[4], maxV[4];
+	for (int c = 0; c < channels; ++c) {
+		mean[c] = 0.0f;
+		minV[c] = 255.0f;
+		maxV[c] = 0.0f;
+	}
+	for (int i = 0; i < 16; ++i) {
+		for (int c = 0; c < channels; ++c) {
+			float v = block[i * 4 + c];
+			mean[c] += v;
+			minV[c] = std::min(minV[c], v);
+			maxV[c] = std::max(maxV[c], v);
+		}
+	}
+	float cov[4][4];
+	for (int c = 0; c < channels; ++c) {
+		mean[c] /= 16.0f;
+		for (int d = 0; d < channels; ++d)
+			cov[c][d] = 0.0f;
+	}
+	for (int i = 0; i < 16; ++i) {
+		for (int c = 0; c < channels; ++c)
+			for (int d = c; d < channels; ++d)
+				cov[c][d] += (block[i * 4 + c] - mean[c]) * (block[i * 4 + d] - mean[d]);
+	}
+	for (int c = 0; c < channels; ++c)
+		for (int d = 0; d < c; ++d)
+			cov[c][d] = cov[d][c];
+
+	for (int c = 0; c < channels; ++c)
+		axis[c] = maxV[c] - minV[c];
+	for (int iter = 0; iter < 8; ++iter) {
+		float next[4], len = 0.0f;
+		for (int c = 0; c < channels; ++c) {
+			next[c] = 0.0f;
+			for (int d = 0; d < channels; ++d)
+				next[c] += cov[c][d] * axis[d];
+			len = std::max(len, fabsf(next[c]));
+		}
+		if (len < 1e-6f)
+			break;
+		for (int c = 0; c < channels; ++c)
+			axis[c] = next[c] / len;
+	}
+	float len = 0.0f;
+	for (int c = 0; c < channels; ++c)
+		len += axis[c] * axis[c];
+	len = sqrtf(len);
+	for (int c = 0; c < channels; ++c)
+		axis[c] = len > 0.0f ? axis[c] / len : 0.0f;
+}
+
+
+// the points at both ends of the block along the principal axis
+static void
+axisEndpoints(const unsigned char block[64], int channels, float e0[4], float e1[4]) {
+
+	float mean[4], axis[4];
+	principalAxis(block, channels, mean, axis);
+
+	float tMin = 0.0f, tMax = 0.0f;
+	for (int i = 0; i < 16; ++i) {
+		float t = 0.0f;
+		for (int c = 0; c < channels; ++c)
+			t += (block[i * 4 + c] - mean[c]) * axis[c];
+		tMin = std::min(tMin, t);
+		tMax = std::max(tMax, t);
+	}
+	for (int c = 0; c < channels; ++c) {
+		e0[c] = std::min(255.0f, std::max(0.0f, mean[c] + tMax * axis[c]));
+		e1[c] = std::min(255.0f, std::max(0.0f, mean[c] + tMin * axis[c]));
+	}
+}
+
+
+void
+VSImageLib::encodeBC1(const unsigned char block[64], unsigned char *out) {
+
+	float e0[4], e1[4];
+	axisEndpoints(block, 3, e0, e1);
+
+	unsigned int c[2];
+	const float *e[2] = { e0, e1 };
+	for (int k = 0; k < 2; ++k)
+		c[k] = ((unsigned int)(e[k][0] * 31.0f / 255.0f + 0.5f) << 11) |
+				((unsigned int)(e[k][1] * 63.0f / 255.0f + 0.5f) << 5) |
+				(unsigned int)(e[k][2] * 31.0f / 255.0f + 0.5f);
+	// the four color mode requires c0 > c1
+	if (c[0] < c[1])
+		std::swap(c[0], c[1]);
+
+	int palette[4][3];
+	for (int k = 0; k < 2; ++k) {
+		int r = (c[k] >> 11) & 31, g = (c[k] >> 5) & 63, b = c[k] & 31;
+		palette[k][0] = (r << 3) | (r >> 2);
+		palette[k][1] = (g << 2) | (g >> 4);
+		palette[k][2] = (b << 3) | (b >> 2);
+	}
+	for (int j = 0; j < 3; ++j) {
+		palette[2][j] = (2 * palette[0][j] + palette[1][j]) / 3;
+		palette[3][j] = (palette[0][j] + 2 * palette[1][j]) / 3;
+	}
+
+	uint32_t indices = 0;
+	if (c[0] != c[1]) {
+		for (int i = 0; i < 16; ++i) {
+			int best = 0, bestDist = 1 << 30;
+			for (int k = 0; k < 4; ++k) {
+				int dist = 0;
+				for (int j = 0; j < 3; ++j) {
+					int d = block[i * 4 + j] - palette[k][j];
+					dist += d * d;
+				}
+				if (dist < bestDist) {
+					bestDist = dist;
+					best = k;
+				}
+			}
+			indices |= (uint32_t)best << (i * 2);
+		}
+	}
+	out[0] = c[0] & 255; out[1] = c[0] >> 8;
+	out[2] = c[1] & 255; out[3] = c[1] >> 8;
+	for (int k = 0; k < 4; ++k)
+		out[4 + k] = (indices >> (k * 8)) & 255;
+}
+
+
+void
+VSImageLib::encodeBC4(const unsigned char block[64], int c, unsigned char *out) {
+
+	int a0 = 0, a1 = 255;
+	for (int i = 0; i < 16; ++i) {
+		a0 = std::max(a0, (int)block[i * 4 + c]);
+		a1 = std::min(a1, (int)block[i * 4 + c]);
+	}
+	out[0] = (unsigned char)a0;
+	out[1] = (unsigned char)a1;
+
+	// a0 > a1 selects the eight value ramp
+	uint64_t indices = 0;
+	if (a0 != a1) {
+		int ramp[8] = { a0, a1 };
+		for (int k = 2; k < 8; ++k)
+			ramp[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+		for (int i = 0; i < 16; ++i) {
+			int v = block[i * 4 + c], best = 0;
+			for (int k = 1; k < 8; ++k)
+				if (abs(ramp[k] - v) < abs(ramp[best] - v))
+					best = k;
+			indices |= (uint64_t)best << (i * 3);
+		}
+	}
+	for (int k = 0; k < 6; ++k)
+		out[2 + k] = (indices >> (k * 8)) & 255;
+}
+
+
+// writes bits from the least significant one
+struct BitWriter {
+	unsigned char *out;
+	int pos;
+
+	void write(unsigned int value, int bits) {
+		for (int i = 0; i < bits; ++i, ++pos)
+			if ((value >> i) & 1)
+				out[pos >> 3] |= 1 << (pos & 7);
+	}
+};
+
+
+void
+VSImageLib::encodeBC7(const unsigned char block[64], unsigned char *out) {
+
+	// mode 6: one subset, RGBA endpoints with 7 bits plus a
+	// shared bit each, and 4 bit indices
+	float e[2][4];
+	axisEndpoints(block, 4, e[0], e[1]);
+
+	int q[2][4], p[2];
+	for (int k = 0; k < 2; ++k) {
+		float bestErr = 1e30f;
+		for (int bit = 0; bit < 2; ++bit) {
+			int v[4];
+			float err = 0.0f;
+			for (int c = 0; c < 4; ++c) {
+				v[c] = std::min(127, std::max(0, (int)floorf((e[k][c] - bit) * 0.5f + 0.5f)));
+				float d = (float)(v[c] * 2 + bit) - e[k][c];
+				err += d * d;
+			}
+			if (err < bestErr) {
+				bestErr = err;
+				memcpy(q[k], v, sizeof(v));
+				p[k] = bit;
+			}
+		}
+	}
+
+	static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+	int palette[16][4];
+	for (int c = 0; c < 4; ++c) {
+		int a = q[0][c] * 2 + p[0], b = q[1][c] * 2 + p[1];
+		for (int k = 0; k < 16; ++k)
+			palette[k][c] = ((64 - weights[k]) * a + weights[k] * b + 32) >> 6;
+	}
+
+	int indices[16];
+	for (int i = 0; i < 16; ++i) {
+		int best = 0, bestDist = 1 << 30;
+		for (int k = 0; k < 16; ++k) {
+			int dist = 0;
+			for (int c = 0; c < 4; ++c) {
+				int d = block[i * 4 + c] - palette[k][c];
+				dist += d * d;
+			}
+			if (dist < bestDist) {
+				bestDist = dist;
+				best = k;
+			}
+		}
+		indices[i] = best;
+	}
+
+	// the first index is stored without its top bit
+	if (indices[0] & 8) {
+		for (int c = 0; c < 4; ++c)
+			std::swap(q[0][c], q[1][c]);
+		std::swap(p[0], p[1]);
+		for (int i = 0; i < 16; ++i)
+			indices[i] = 15 - indices[i];
+	}
+
+	memset(out, 0, 16);
+	BitWriter bits = { out, 0 };
+	bits.write(1 << 6, 7);
+	for (int c = 0; c < 4; ++c) {
+		bits.write(q[0][c], 7);
+		bits.write(q[1][c], 7);
+	}
+	bits.write(p[0], 1);
+	bits.write(p[1], 1);
+	bits.write(indices[0], 3);
+	for (int i = 1; i < 16; ++i)
+		bits.write(indices[i], 4);
+}
+
+
+void
+VSImageLib::compress(const Image &source, Format format, Image &result,
+						unsigned int maxThreads) {
+
+	// compressed sources are copied, and keep their format
+	if (format == RGBA8 || source.format != RGBA8) {
+		result.format = source.format;
+		result.levels = source.levels;
+		return;
+	}
+
+	result.format = format;
+	result.levels.resize(source.levels.size());
+
+	size_t blockSize = getLevelSize(format, 4, 4);
+	for (size_t l = 0; l < source.levels.size(); ++l) {
+
+		const Level &src = source.levels[l];
+		Level &dst = result.levels[l];
+		dst.width = src.width;
+		dst.height = src.height;
+		dst.data.resize(getLevelSize(format, src.width, src.height));
+
+		// one job per row of blocks
+		unsigned int blocksX = (src.width + 3) / 4, blocksY = (src.height + 3) / 4;
+		VSThreadLib::parallelFor(blocksY, [&](unsigned int by) {
+
+			unsigned char block[64];
+			for (unsigned int bx = 0; bx < blocksX; ++bx) {
+				fetchBlock(src, bx, by, block);
+				unsigned char *out = &dst.data[(by * blocksX + bx) * blockSize];
+				switch (format) {
+					case BC1: encodeBC1(block, out); break;
+					case BC3: encodeBC4(block, 3, out); encodeBC1(block, out + 8); break;
+					case BC4: encodeBC4(block, 0, out); break;
+					case BC5: encodeBC4(block, 0, out); encodeBC4(block, 1, out + 8); break;
+					case BC7: encodeBC7(block, out); break;
+					default: break;
+				}
+			}
+		}, maxThreads);
+	}
+}
+
+
+static const uint32_t DDS_MAGIC = 0x20534444;
+static uint32_t
+fourCC(const char *s) {
+
+	return (uint32_t)s[0] | ((uint32_t)s[1] << 8) | ((uint32_t)s[2] << 16) | ((uint32_t)s[3] << 24);
+}
+
+
+// DXGI_FORMAT values
+static const uint32_t DXGI_R8G8B8A8_UNORM = 28, DXGI_BC1_UNORM = 71, DXGI_BC3_UNORM = 77,
+					DXGI_BC4_UNORM = 80, DXGI_BC5_UNORM = 83, DXGI_BC7_UNORM = 98;
+
+
+bool
+VSImageLib::saveDDS(const std::string &filename, const Image &image) {
+
+	if (image.levels.empty())
+		return false;
+
+	static const uint32_t dxgi[] = { DXGI_R8G8B8A8_UNORM, DXGI_BC1_UNORM, DXGI_BC3_UNORM,
+									DXGI_BC4_UNORM, DXGI_BC5_UNORM, DXGI_BC7_UNORM };
+	const Level &top = image.levels[0];
+
+	// DDS_HEADER, then DDS_HEADER_DXT10
+	uint32_t header[31 + 5];
+	memset(header, 0, sizeof(header));
+	header[0] = 124;
+	// caps, height, width, pixel format, mip count, linear size
+	header[1] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;
+	header[2] = top.height;
+	header[3] = top.width;
+	header[4] = (uint32_t)getLevelSize(image.format, top.width, top.height);
+	header[6] = (uint32_t)image.levels.size();
+	header[18] = 32;
+	header[19] = 0x4;
+	header[20] = fourCC("DX10");
+	// texture, mipmap, complex
+	header[26] = 0x1000 | (image.levels.size() > 1 ? 0x400000 | 0x8 : 0);
+	header[31] = dxgi[image.format];
+	header[32] = 3;
+	header[34] = 1;
+
+	FILE *f = fopen(filename.c_str(), "wb");
+	if (f == NULL)
+		return false;
+	bool ok = fwrite(&DDS_MAGIC, 4, 1, f) == 1 &&
+			fwrite(header, sizeof(header), 1, f) == 1;
+	for (size_t l = 0; l < image.levels.size() && ok; ++l)
+		ok = fwrite(&image.levels[l].data[0], image.levels[l].data.size(), 1, f) == 1;
+	fclose(f);
+
+	// do not leave partial files in the cache
+	if (!ok)
+		remove(filename.c_str());
+	return ok;
+}
+
+
+bool
+VSImageLib::loadDDS(const std::string &filename, Image &image) {
+
+	FILE *f = fopen(filename.c_str(), "rb");
+	if (f == NULL)
+		return false;
+
+	uint32_t magic = 0, header[31];
+	bool ok = fread(&magic, 4, 1, f) == 1 && magic == DDS_MAGIC &&
+			fread(header, sizeof(header), 1, f) == 1 && header[0] == 124 &&
+			(header[19] & 0x4);
+
+	uint32_t code = ok ? header[20] : 0;
+	if (ok && code == fourCC("DX10")) {
+		uint32_t dx10[5] = { 0, 0, 0, 0, 0 };
+		ok = fread(dx10, sizeof(dx10), 1, f) == 1 && dx10[1] == 3 && dx10[3] == 1;
+		code = dx10[0];
+	}
+	if (code == fourCC("DXT1") || code == DXGI_BC1_UNORM)
+		image.format = BC1;
+	else if (code == fourCC("DXT5") || code == DXGI_BC3_UNORM)
+		image.format = BC3;
+	else if (code == fourCC("ATI1") || code == fourCC("BC4U") || code == DXGI_BC4_UNORM)
+		image.format = BC4;
+	else if (code == fourCC("ATI2") || code == fourCC("BC5U") || code == DXGI_BC5_UNORM)
+		image.format = BC5;
+	else if (code == DXGI_BC7_UNORM)
+		image.format = BC7;
+	else if (code == DXGI_R8G8B8A8_UNORM)
+		image.format = RGBA8;
+	else
+		ok = false;
+
+	unsigned int width = ok ? header[3] : 0, height = ok ? header[2] : 0;
+	unsigned int levels = ok ? std::max(1u, header[6]) : 0;
+	image.levels.resize(levels);
+	for (unsigned int l = 0; l < levels && ok; ++l) {
+		Level &level = image.levels[l];
+		level.width = width;
+		level.height = height;
+		level.data.resize(getLevelSize(image.format, width, height));
+		ok = fread(&level.data[0], level.data.size(), 1, f) == 1;
+		width = std::max(1u, width / 2);
+		height = std::max(1u, height / 2);
+	}
+	fclose(f);
+
+	if (!ok)
+		image.levels.clear();
+	return ok && levels > 0;
+}
+
+
+void
+VSImageLib::setCacheDirectory(const std::string &dir) {
+
+	sCacheDirectory = dir;
+}
+
+
+const std::string &
+VSImageLib::getCacheDirectory() {
+
+	return sCacheDirectory;
+}
+
+
+std::string
+VSImageLib::getCacheFile(const void *source, size_t size, const std::string &tag) {
+
+	if (sCacheDirectory == "")
+		return "";
+
+	unsigned long long key = VSMeshOptLib::hash(tag.data(), tag.size());
+	key = VSMeshOptLib::hash(source, size, key);
+	char name[32];
+	snprintf(name, 32, "/%016llx.dds", key);
+	return sCacheDirectory + name;
+}
+
+
+#ifndef __ANDROID_API__
+
+GLenum
+VSImageLib::getGLFormat(Format format) {
+
+	switch (format) {
+		case BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		case BC4: return GL_COMPRESSED_RED_RGTC1;
+		case BC5: return GL_COMPRESSED_RG_RGTC2;
+		case BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+		default: return GL_RGBA8;
+	}
+}
+
+
+bool
+VSImageLib::isSupported(Format format) {
+
+	switch (format) {
+		case BC1:
+		case BC3: return GLEW_EXT_texture_compression_s3tc != 0;
+		case BC4:
+		case BC5: return GLEW_VERSION_3_0 || GLEW_ARB_texture_compression_rgtc;
+		case BC7: return GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+		default: return true;
+	}
+}
+
+
+void
+VSImageLib::upload(GLenum target, const Image &image) {
+
+	if (image.levels.empty())
+		return;
+
+	GLenum internalFormat = getGLFormat(image.format);
+	bool immutable = target == GL_TEXTURE_2D && (GLEW_VERSION_4_2 || GLEW_ARB_texture_storage);
+	if (immutable)
+		glTexStorage2D(target, (GLsizei)image.levels.size(), internalFormat,
+					image.levels[0].width, image.levels[0].height);
+
+	for (size_t l = 0; l < image.levels.size(); ++l) {
+		const Level &level = image.levels[l];
+		if (immutable && image.format == RGBA8)
+			glTexSubImage2D(target, (GLint)l, 0, 0, level.width, level.height,
+						GL_RGBA, GL_UNSIGNED_BYTE, &level.data[0]);
+		else if (immutable)
+			glCompressedTexSubImage2D(target, (GLint)l, 0, 0, level.width, level.height,
+						internalFormat, (GLsizei)level.data.size(), &level.data[0]);
+		else if (image.format == RGBA8)
+			glTexImage2D(target, (GLint)l, internalFormat, level.width, level.height, 0,
+						GL_RGBA, GL_UNSIGNED_BYTE, &level.data[0]);
+		else
+			glCompressedTexImage2D(target, (GLint)l, internalFormat, level.width, level.height, 0,
+						(GLsizei)level.data.size(), &level.data[0]);
+	}
+}
+
+#endif
@@ -11,6 +11,7 @@ http://www.lighthouse3d.com/very-simple-libs
 
 #include "vsMathLib.h"
 #include "vsShaderLib.h"
+#include "vsMemoryLib.h"
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -119,7 +120,7 @@ VSMathLib::setUniformArrayIndexName(ComputedMatrixTypes matType,
 void 
 VSMathLib::pushMatrix(MatrixTypes aType) {
 
-	float *aux = (float *)malloc(sizeof(float) * 16);
+	float *aux = VSMemoryLib::allocateArray<float>(16);
 	memcpy(aux, mMatrix[aType], sizeof(float) * 16);
 	mMatrixStack[aType].push_back(aux);
 }
@@ -133,7 +134,7 @@ VSMathLib::popMatrix(MatrixTypes aType) {
 		float *m = mMatrixStack[aType][mMatrixStack[aType].size()-1];
 		memcpy(mMatrix[aType], m, sizeof(float) * 16);
 		mMatrixStack[aType].pop_back();
-		free(m);
+		VSMemoryLib::release(m);
 	}
 }
 
@@ -805,6 +806,41 @@ VSMathLib::multPointMatrix(float *point, MatrixTypes aType, float *res) {
 }
 
 
+// Gribb-Hartmann plane extraction, rows of PVM combined
+void
+VSMathLib::extractFrustumPlanes(float *planes) {
+
+	computeDerivedMatrix(PROJ_VIEW_MODEL);
+	float *m = mCompMatrix[PROJ_VIEW_MODEL];
+
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 4; ++j) {
+			planes[(i * 2) * 4 + j] = m[j * 4 + 3] + m[j * 4 + i];
+			planes[(i * 2 + 1) * 4 + j] = m[j * 4 + 3] - m[j * 4 + i];
+		}
+	}
+	for (int p = 0; p < 6; ++p) {
+		float l = length(&planes[p * 4]);
+		if (l > 0.0f)
+			for (int j = 0; j < 4; ++j)
+				planes[p * 4 + j] /= l;
+	}
+}
+
+
+void
+VSMathLib::getModelSpaceCamera(float *res) {
+
+	computeDerivedMatrix(VIEW_MODEL);
+	float inv[16];
+	memcpy(inv, mCompMatrix[VIEW_MODEL], 16 * sizeof(float));
+	invert(inv);
+	res[0] = inv[12];
+	res[1] = inv[13];
+	res[2] = inv[14];
+}
+
+
 // Compute res = M * point
 void
 VSMathLib::multMatrixPoint(ComputedMatrixTypes aType, float *point, float *res) {
@@ -0,0 +1,280 @@
+/** ----------------------------------------------------------
+ * \class VSMemoryLib
+ *
+ * Lighthouse3D
+ *
+ * VSMemoryLib - Very Simple Memory Library
+ *
+ * \version 0.1.0
+ *		Initial Release
+ *
+ * This lib is the source of the CPU memory allocated by the
+ * other libs for their own buffers, and provides a scratch
+ * arena per thread for temporary data.
+ *
+ * Full documentation at
+ * http://www.lighthouse3d.com/very-simple-libs
+ *
+ ---------------------------------------------------------------*/
+
+#include "vsMemoryLib.h"
+
+#include <atomic>
+#include <stdlib.h>
+
+
+// room before each allocation for its size, keeps the alignment
+#define HEADER_SIZE 16
+// the smallest arena block
+#define MIN_BLOCK_SIZE (64 << 10)
+
+
+static void *
+defaultAllocate(size_t size, void *) {
+
+	return malloc(size);
+}
+
+
+static void
+defaultRelease(void *ptr, void *) {
+
+	free(ptr);
+}
+
+
+static VSMemoryLib::Allocator sAllocator = { defaultAllocate, defaultRelease, NULL };
+
+static std::atomic<unsigned long long> sAllocations(0), sReleases(0), sScratchResets(0);
+static std::atomic<size_t> sBytes(0), sPeakBytes(0), sScratchCapacity(0), sScratchPeak(0);
+
+
+static void
+raise(std::atomic<size_t> &peak, size_t value) {
+
+	size_t current = peak.load();
+	while (value > current && !peak.compare_exchange_weak(current, value))
+		;
+}
+
+
+void
+VSMemoryLib::setAllocator(const Allocator &allocator) {
+
+	if (allocator.allocate == NULL || allocator.release == NULL) {
+		sAllocator.allocate = defaultAllocate;
+		sAllocator.release = defaultRelease;
+		sAllocator.user = NULL;
+	}
+	else
+		sAllocator = allocator;
+}
+
+
+void *
+VSMemoryLib::allocate(size_t size) {
+
+	// malloc alignment is enough for the header to keep 16 bytes
+	unsigned char *ptr = (unsigned char *)sAllocator.allocate(size + HEADER_SIZE, sAllocator.user);
+	if (ptr == NULL)
+		return NULL;
+	*(size_t *)ptr = size;
+
+	sAllocations++;
+	raise(sPeakBytes, sBytes += size);
+	return ptr + HEADER_SIZE;
+}
+
+
+void
+VSMemoryLib::release(void *ptr) {
+
+	if (ptr == NULL)
+		return;
+	unsigned char *block = (unsigned char *)ptr - HEADER_SIZE;
+	sBytes -= *(size_t *)block;
+	sReleases++;
+	sAllocator.release(block, sAllocator.user);
+}
+
+
+VSMemoryLib::Arena::Arena() :
+	current(0),
+	offset(0),
+	usedBefore(0),
+	depth(0) {
+
+}
+
+
+VSMemoryLib::Arena::~Arena() {
+
+	for (size_t i = 0; i < blocks.size(); ++i) {
+		sScratchCapacity -= blocks[i].size;
+		VSMemoryLib::release(blocks[i].data);
+	}
+}
+
+
+VSMemoryLib::Arena &
+VSMemoryLib::getArena() {
+
+	// the worker threads of VSThreadLib get their own
+	static thread_local Arena arena;
+	return arena;
+}
+
+
+void *
+VSMemoryLib::scratch(size_t size, size_t alignment) {
+
+	Arena &arena = getArena();
+
+	// blocks are 16 byte aligned, so offsets can be aligned instead
+	size_t aligned = (arena.offset + alignment - 1) & ~(alignment - 1);
+	while (arena.current >= arena.blocks.size() ||
+			aligned + size > arena.blocks[arena.current].size) {
+		if (arena.current + 1 < arena.blocks.size()) {
+			// a block left over from a previous scope
+			arena.usedBefore += arena.offset;
+			arena.current++;
+		}
+		else if (!addBlock(arena, size))
+			return NULL;
+		arena.offset = 0;
+		aligned = 0;
+	}
+
+	void *ptr = arena.blocks[arena.current].data + aligned;
+	arena.offset = aligned + size;
+	updatePeak(arena.usedBefore + arena.offset);
+	return ptr;
+}
+
+
+bool
+VSMemoryLib::addBlock(Arena &arena, size_t minSize) {
+
+	// the arena at least doubles when it grows
+	size_t size = MIN_BLOCK_SIZE;
+	if (!arena.blocks.empty())
+		size = arena.blocks.back().size * 2;
+	while (size < minSize)
+		size *= 2;
+
+	Block block;
+	block.data = (unsigned char *)allocate(size);
+	if (block.data == NULL)
+		return false;
+	block.size = size;
+	sScratchCapacity += size;
+
+	if (!arena.blocks.empty() && arena.current < arena.blocks.size())
+		arena.usedBefore += arena.offset;
+	arena.blocks.push_back(block);
+	arena.current = arena.blocks.size() - 1;
+	return true;
+}
+
+
+void
+VSMemoryLib::coalesce(Arena &arena) {
+
+	if (arena.blocks.size() < 2)
+		return;
+
+	size_t total = 0;
+	for (size_t i = 0; i < arena.blocks.size(); ++i)
+		total += arena.blocks[i].size;
+
+	// without memory for the merged block, the blocks are kept
+	Block block;
+	block.data = (unsigned char *)allocate(total);
+	if (block.data == NULL)
+		return;
+	block.size = total;
+
+	for (size_t i = 0; i < arena.blocks.size(); ++i)
+		release(arena.blocks[i].data);
+	arena.blocks.clear();
+	arena.blocks.push_back(block);
+}
+
+
+void
+VSMemoryLib::updatePeak(size_t used) {
+
+	raise(sScratchPeak, used);
+}
+
+
+VSMemoryLib::ScratchScope::ScratchScope() {
+
+	Arena &arena = getArena();
+	mBlock = arena.current;
+	mOffset = arena.offset;
+	mUsedBefore = arena.usedBefore;
+	arena.depth++;
+}
+
+
+VSMemoryLib::ScratchScope::~ScratchScope() {
+
+	Arena &arena = getArena();
+	arena.depth--;
+
+	if (arena.depth == 0) {
+		// the next load fits in a single block
+		coalesce(arena);
+		arena.current = 0;
+		arena.offset = 0;
+		arena.usedBefore = 0;
+		sScratchResets++;
+		return;
+	}
+
+	// blocks after the mark stay for later use
+	arena.current = mBlock;
+	arena.offset = mOffset;
+	arena.usedBefore = mUsedBefore;
+}
+
+
+void
+VSMemoryLib::releaseScratch() {
+
+	Arena &arena = getArena();
+	if (arena.depth > 0)
+		return;
+	for (size_t i = 0; i < arena.blocks.size(); ++i) {
+		sScratchCapacity -= arena.blocks[i].size;
+		release(arena.blocks[i].data);
+	}
+	arena.blocks.clear();
+	arena.current = 0;
+	arena.offset = 0;
+	arena.usedBefore = 0;
+}
+
+
+VSMemoryLib::Stats
+VSMemoryLib::getStats() {
+
+	Stats stats;
+	stats.allocations = sAllocations;
+	stats.releases = sReleases;
+	stats.bytes = sBytes;
+	stats.peakBytes = sPeakBytes;
+	stats.scratchCapacity = sScratchCapacity;
+	stats.scratchPeak = sScratchPeak;
+	stats.scratchResets = sScratchResets;
+	return stats;
+}
+
+
+void
+VSMemoryLib::resetPeaks() {
+
+	sPeakBytes = sBytes.load();
+	sScratchPeak = 0;
+}
@@ -0,0 +1,705 @@
+/** ----------------------------------------------------------
+ * \class VSMeshOptLib
+ *
+ * Lighthouse3D
+ *
+ * VSMeshOptLib - Very Simple Mesh Optimization Library
+ *
+ * \version 0.1.0
+ *		Initial Release
+ *
+ * This lib provides CPU side algorithms to process
+ * indexed triangle meshes, such as simplification.
+ *
+ * Full documentation at
+ * http://www.lighthouse3d.com/very-simple-libs
+ *
+ ---------------------------------------------------------------*/
+
+#include "vsMeshOptLib.h"
+#include "vsThreadLib.h"
+
+#include <algorithm>
+#include <queue>
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <stdint.h>
+
+
+// Symmetric 4x4 matrix, upper triangle stored by rows
+struct Quadric {
+	double a[10];
+};
+
+
+static void
+quadricAddPlane(Quadric &q, double a, double b, double c, double d) {
+
+	q.a[0] += a * a; q.a[1] += a * b; q.a[2] += a * c; q.a[3] += a * d;
+	q.a[4] += b * b; q.a[5] += b * c; q.a[6] += b * d;
+	q.a[7] += c * c; q.a[8] += c * d;
+	q.a[9] += d * d;
+}
+
+
+static double
+quadricEval(const Quadric &q1, const Quadric &q2, const float *p) {
+
+	double a[10];
+	for (int i = 0; i < 10; ++i)
+		a[i] = q1.a[i] + q2.a[i];
+
+	double x = p[0], y = p[1], z = p[2];
+	double r = a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+			+ a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+			+ a[7] * z * z + 2 * a[8] * z
+			+ a[9];
+	return r < 0.0 ? 0.0 : r;
+}
+
+
+static void
+faceNormal(const float *p0, const float *p1, const float *p2, double *n) {
+
+	double u[3], v[3];
+	for (int i = 0; i < 3; ++i) {
+		u[i] = p1[i] - p0[i];
+		v[i] = p2[i] - p0[i];
+	}
+	n[0] = u[1] * v[2] - u[2] * v[1];
+	n[1] = u[2] * v[0] - u[0] * v[2];
+	n[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+
+// A candidate collapse, from -> to. The stamps tell whether
+// the vertices changed after the candidate was queued
+struct Collapse {
+	double cost;
+	unsigned int from, to;
+	unsigned int stampFrom, stampTo;
+
+	bool operator < (const Collapse &c) const {
+		return cost > c.cost;
+	}
+};
+
+
+float
+VSMeshOptLib::simplify(const float *positions, unsigned int numVertices,
+					unsigned int stride,
+					const unsigned int *indices, unsigned int numIndices,
+					unsigned int targetIndices, float maxError,
+					std::vector<unsigned int> &result) {
+
+	unsigned int numFaces = numIndices / 3;
+	std::vector<unsigned int> faces(indices, indices + numFaces * 3);
+	std::vector<bool> faceAlive(numFaces, true);
+	unsigned int aliveFaces = numFaces;
+
+#define POS(v) (positions + (size_t)(v) * stride)
+
+	// one plane per face, unweighted so that the
+	// error is a squared distance
+	std::vector<Quadric> quadrics(numVertices);
+	for (unsigned int v = 0; v < numVertices; ++v)
+		for (int i = 0; i < 10; ++i)
+			quadrics[v].a[i] = 0.0;
+
+	std::vector<std::vector<unsigned int> > vertexFaces(numVertices);
+	for (unsigned int f = 0; f < numFaces; ++f) {
+
+		const unsigned int *t = &faces[f * 3];
+		double n[3];
+		faceNormal(POS(t[0]), POS(t[1]), POS(t[2]), n);
+		double len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (len > 0.0) {
+			n[0] /= len; n[1] /= len; n[2] /= len;
+			double d = -(n[0] * POS(t[0])[0] + n[1] * POS(t[0])[1] + n[2] * POS(t[0])[2]);
+			for (int k = 0; k < 3; ++k)
+				quadricAddPlane(quadrics[t[k]], n[0], n[1], n[2], d);
+		}
+		for (int k = 0; k < 3; ++k)
+			vertexFaces[t[k]].push_back(f);
+	}
+
+	// edges used by a single face are borders or seams,
+	// their vertices are locked
+	std::vector<unsigned long long> edges;
+	edges.reserve(numFaces * 3);
+	for (unsigned int e = 0; e < numFaces * 3; ++e) {
+		unsigned long long a = faces[e], b = faces[e - e % 3 + (e + 1) % 3];
+		edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+	}
+	std::sort(edges.begin(), edges.end());
+
+	std::vector<bool> locked(numVertices, false);
+	for (size_t i = 0; i < edges.size(); ) {
+		size_t j = i + 1;
+		while (j < edges.size() && edges[j] == edges[i])
+			++j;
+		if (j - i == 1) {
+			locked[(unsigned int)(edges[i] >> 32)] = true;
+			locked[(unsigned int)(edges[i] & 0xFFFFFFFF)] = true;
+		}
+		i = j;
+	}
+
+	std::vector<unsigned int> stamp(numVertices, 0);
+	std::vector<bool> removed(numVertices, false);
+	std::priority_queue<Collapse> heap;
+
+	// queues the cheapest direction of an edge
+	auto pushEdge = [&](unsigned int a, unsigned int b) {
+
+		Collapse c;
+		c.cost = DBL_MAX;
+		if (!locked[a]) {
+			c.cost = quadricEval(quadrics[a], quadrics[b], POS(b));
+			c.from = a; c.to = b;
+		}
+		if (!locked[b]) {
+			double cost = quadricEval(quadrics[a], quadrics[b], POS(a));
+			if (cost < c.cost) {
+				c.cost = cost;
+				c.from = b; c.to = a;
+			}
+		}
+		if (c.cost == DBL_MAX)
+			return;
+		c.stampFrom = stamp[c.from];
+		c.stampTo = stamp[c.to];
+		heap.push(c);
+	};
+
+	for (unsigned int e = 0; e < numFaces * 3; ++e) {
+		unsigned int a = faces[e], b = faces[e - e % 3 + (e + 1) % 3];
+		if (a < b)
+			pushEdge(a, b);
+	}
+
+	double maxCost = (double)maxError * maxError;
+	double appliedCost = 0.0;
+	unsigned int targetFaces = targetIndices / 3;
+
+	while (aliveFaces > targetFaces && !heap.empty()) {
+
+		Collapse c = heap.top();
+		heap.pop();
+
+		if (c.cost > maxCost)
+			break;
+		unsigned int u = c.from, v = c.to;
+		if (removed[u] || removed[v] || stamp[u] != c.stampFrom || stamp[v] != c.stampTo)
+			continue;
+
+		// reject collapses that flip faces
+		bool flips = false;
+		for (size_t i = 0; i < vertexFaces[u].size() && !flips; ++i) {
+
+			unsigned int f = vertexFaces[u][i];
+			unsigned int *t = &faces[f * 3];
+			if (!faceAlive[f] || t[0] == v || t[1] == v || t[2] == v)
+				continue;
+
+			const float *p[3], *q[3];
+			for (int k = 0; k < 3; ++k) {
+				p[k] = POS(t[k]);
+				q[k] = (t[k] == u) ? POS(v) : POS(t[k]);
+			}
+			double n0[3], n1[3];
+			faceNormal(p[0], p[1], p[2], n0);
+			faceNormal(q[0], q[1], q[2], n1);
+			if (n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0.0)
+				flips = true;
+		}
+		if (flips)
+			continue;
+
+		for (size_t i = 0; i < vertexFaces[u].size(); ++i) {
+
+			unsigned int f = vertexFaces[u][i];
+			if (!faceAlive[f])
+				continue;
+			unsigned int *t = &faces[f * 3];
+			if (t[0] == v || t[1] == v || t[2] == v) {
+				faceAlive[f] = false;
+				aliveFaces--;
+			}
+			else {
+				for (int k = 0; k < 3; ++k)
+					if (t[k] == u)
+						t[k] = v;
+				vertexFaces[v].push_back(f);
+			}
+		}
+		std::vector<unsigned int>().swap(vertexFaces[u]);
+		removed[u] = true;
+
+		for (int i = 0; i < 10; ++i)
+			quadrics[v].a[i] += quadrics[u].a[i];
+		stamp[v]++;
+		appliedCost = std::max(appliedCost, c.cost);
+
+		// drop dead faces and requeue the edges around v
+		std::vector<unsigned int> &vf = vertexFaces[v];
+		std::vector<unsigned int> neighbours;
+		size_t alive = 0;
+		for (size_t i = 0; i < vf.size(); ++i) {
+			if (!faceAlive[vf[i]])
+				continue;
+			vf[alive++] = vf[i];
+			const unsigned int *t = &faces[vf[i] * 3];
+			for (int k = 0; k < 3; ++k)
+				if (t[k] != v)
+					neighbours.push_back(t[k]);
+		}
+		vf.resize(alive);
+		std::sort(neighbours.begin(), neighbours.end());
+		neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+		for (size_t i = 0; i < neighbours.size(); ++i)
+			pushEdge(v, neighbours[i]);
+	}
+#undef POS
+
+	result.clear();
+	result.reserve(aliveFaces * 3);
+	for (unsigned int f = 0; f < numFaces; ++f) {
+		if (faceAlive[f])
+			result.insert(result.end(), &faces[f * 3], &faces[f * 3] + 3);
+	}
+	return (float)sqrt(appliedCost);
+}
+
+
+void
+VSMeshOptLib::computeTangents(const float *positions, unsigned int posStride,
+						const float *normals, unsigned int normalStride,
+						const float *texCoords, unsigned int texStride,
+						unsigned int numVertices,
+						const unsigned int *indices, unsigned int numIndices,
+						float *tangents, float *bitangents,
+						unsigned int maxThreads) {
+
+	if (indices == NULL)
+		numIndices = numVertices;
+	unsigned int numFaces = numIndices / 3;
+	const unsigned int chunk = 4096;
+	unsigned int faceChunks = (numFaces + chunk - 1) / chunk;
+	unsigned int vertexChunks = (numVertices + chunk - 1) / chunk;
+
+	// face tangent and bitangent directions, and the angle at each corner
+	std::vector<float> faceT(numFaces * 3), faceB(numFaces * 3), angles(numFaces * 3);
+	VSThreadLib::parallelFor(faceChunks, [&](unsigned int c) {
+
+		unsigned int last = std::min(numFaces, (c + 1) * chunk);
+		for (unsigned int f = c * chunk; f < last; ++f) {
+
+			unsigned int v[3];
+			for (int k = 0; k < 3; ++k)
+				v[k] = indices ? indices[f * 3 + k] : f * 3 + k;
+			const float *p[3], *uv[3];
+			for (int k = 0; k < 3; ++k) {
+				p[k] = positions + (size_t)v[k] * posStride;
+				uv[k] = texCoords + (size_t)v[k] * texStride;
+			}
+
+			float e1[3], e2[3];
+			for (int k = 0; k < 3; ++k) {
+				e1[k] = p[1][k] - p[0][k];
+				e2[k] = p[2][k] - p[0][k];
+			}
+			float du1 = uv[1][0] - uv[0][0], dv1 = uv[1][1] - uv[0][1];
+			float du2 = uv[2][0] - uv[0][0], dv2 = uv[2][1] - uv[0][1];
+			float det = du1 * dv2 - du2 * dv1;
+			// faces without a texture mapping do not contribute
+			float r = fabsf(det) > 1e-20f ? 1.0f / det : 0.0f;
+
+			float *t = &faceT[f * 3], *b = &faceB[f * 3];
+			float lt = 0.0f, lb = 0.0f;
+			for (int k = 0; k < 3; ++k) {
+				t[k] = (e1[k] * dv2 - e2[k] * dv1) * r;
+				b[k] = (e2[k] * du1 - e1[k] * du2) * r;
+				lt += t[k] * t[k];
+				lb += b[k] * b[k];
+			}
+			lt = lt > 0.0f ? 1.0f / sqrtf(lt) : 0.0f;
+			lb = lb > 0.0f ? 1.0f / sqrtf(lb) : 0.0f;
+			for (int k = 0; k < 3; ++k) {
+				t[k] *= lt;
+				b[k] *= lb;
+			}
+
+			for (int k = 0; k < 3; ++k) {
+				const float *a = p[k], *n1 = p[(k + 1) % 3], *n2 = p[(k + 2) % 3];
+				float x[3], y[3], lx = 0.0f, ly = 0.0f, d = 0.0f;
+				for (int j = 0; j < 3; ++j) {
+					x[j] = n1[j] - a[j];
+					y[j] = n2[j] - a[j];
+					lx += x[j] * x[j];
+					ly += y[j] * y[j];
+					d += x[j] * y[j];
+				}
+				float l = sqrtf(lx * ly);
+				angles[f * 3 + k] = l > 0.0f ? acosf(std::max(-1.0f, std::min(1.0f, d / l))) : 0.0f;
+			}
+		}
+	}, maxThreads);
+
+	// corners of each vertex, as a counting sort
+	std::vector<unsigned int> offsets(numVertices + 1, 0), corners(numFaces * 3);
+	for (unsigned int i = 0; i < numFaces * 3; ++i)
+		offsets[(indices ? indices[i] : i) + 1]++;
+	for (unsigned int v = 0; v < numVertices; ++v)
+		offsets[v + 1] += offsets[v];
+	{
+		std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for (unsigned int i = 0; i < numFaces * 3; ++i)
+			corners[fill[indices ? indices[i] : i]++] = i;
+	}
+
+	VSThreadLib::parallelFor(vertexChunks, [&](unsigned int c) {
+
+		unsigned int last = std::min(numVertices, (c + 1) * chunk);
+		for (unsigned int v = c * chunk; v < last; ++v) {
+
+			float t[3] = { 0.0f, 0.0f, 0.0f }, b[3] = { 0.0f, 0.0f, 0.0f };
+			for (unsigned int k = offsets[v]; k < offsets[v + 1]; ++k) {
+				unsigned int f = corners[k] / 3;
+				float w = angles[corners[k]];
+				for (int j = 0; j < 3; ++j) {
+					t[j] += faceT[f * 3 + j] * w;
+					b[j] += faceB[f * 3 + j] * w;
+				}
+			}
+
+			// Gram-Schmidt against the normal
+			const float *n = normals + (size_t)v * normalStride;
+			float d = n[0] * t[0] + n[1] * t[1] + n[2] * t[2];
+			for (int j = 0; j < 3; ++j)
+				t[j] -= n[j] * d;
+			float l = t[0] * t[0] + t[1] * t[1] + t[2] * t[2];
+			if (l < 1e-12f) {
+				// any direction perpendicular to the normal
+				float a[3] = { 1.0f, 0.0f, 0.0f };
+				if (fabsf(n[0]) > 0.9f) {
+					a[0] = 0.0f;
+					a[1] = 1.0f;
+				}
+				d = n[0] * a[0] + n[1] * a[1] + n[2] * a[2];
+				for (int j = 0; j < 3; ++j)
+					t[j] = a[j] - n[j] * d;
+				l = t[0] * t[0] + t[1] * t[1] + t[2] * t[2];
+			}
+			l = 1.0f / sqrtf(l);
+			for (int j = 0; j < 3; ++j)
+				t[j] *= l;
+
+			float nxt[3] = { n[1] * t[2] - n[2] * t[1],
+							n[2] * t[0] - n[0] * t[2],
+							n[0] * t[1] - n[1] * t[0] };
+			float w = (nxt[0] * b[0] + nxt[1] * b[1] + nxt[2] * b[2]) < 0.0f ? -1.0f : 1.0f;
+
+			float *res = tangents + (size_t)v * 4;
+			res[0] = t[0]; res[1] = t[1]; res[2] = t[2]; res[3] = w;
+			if (bitangents) {
+				float *bt = bitangents + (size_t)v * 3;
+				for (int j = 0; j < 3; ++j)
+					bt[j] = nxt[j] * w;
+			}
+		}
+	}, maxThreads);
+}
+
+
+void
+VSMeshOptLib::computeBoundingBox(const float *positions, unsigned int numVertices,
+						unsigned int stride, float *bbMin, float *bbMax) {
+
+	if (numVertices == 0) {
+		for (int k = 0; k < 3; ++k)
+			bbMin[k] = bbMax[k] = 0.0f;
+		return;
+	}
+
+	for (int k = 0; k < 3; ++k)
+		bbMin[k] = bbMax[k] = positions[k];
+
+	for (unsigned int i = 1; i < numVertices; ++i) {
+		const float *p = positions + (size_t)i * stride;
+		for (int k = 0; k < 3; ++k) {
+			bbMin[k] = std::min(bbMin[k], p[k]);
+			bbMax[k] = std::max(bbMax[k], p[k]);
+		}
+	}
+}
+
+
+void
+VSMeshOptLib::computeBoundingSphere(const float *positions, unsigned int numVertices,
+						unsigned int stride, float *center, float *radius) {
+
+	if (numVertices == 0) {
+		center[0] = center[1] = center[2] = 0.0f;
+		*radius = 0.0f;
+		return;
+	}
+
+	float bbMin[3], bbMax[3];
+	computeBoundingBox(positions, numVertices, stride, bbMin, bbMax);
+	for (int k = 0; k < 3; ++k)
+		center[k] = (bbMin[k] + bbMax[k]) * 0.5f;
+
+	float r2 = 0.0f;
+	for (unsigned int i = 0; i < numVertices; ++i) {
+		const float *p = positions + (size_t)i * stride;
+		float d[3] = { p[0] - center[0], p[1] - center[1], p[2] - center[2] };
+		r2 = std::max(r2, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+	}
+	*radius = sqrtf(r2);
+}
+
+
+void
+VSMeshOptLib::buildMeshlets(const float *positions, unsigned int numVertices,
+						unsigned int stride,
+						unsigned int *indices, unsigned int numIndices,
+						unsigned int maxTriangles, std::vector<Meshlet> &meshlets) {
+
+	meshlets.clear();
+	unsigned int numFaces = numIndices / 3;
+	if (numFaces == 0 || maxTriangles == 0)
+		return;
+
+#define POS(v) (positions + (size_t)(v) * stride)
+
+	// unit face normals
+	std::vector<float> normals(numFaces * 3);
+	for (unsigned int f = 0; f < numFaces; ++f) {
+		double n[3];
+		faceNormal(POS(indices[f * 3]), POS(indices[f * 3 + 1]), POS(indices[f * 3 + 2]), n);
+		double len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		for (int k = 0; k < 3; ++k)
+			normals[f * 3 + k] = len > 0.0 ? (float)(n[k] / len) : 0.0f;
+	}
+
+	// faces around each vertex, compressed rows
+	std::vector<unsigned int> first(numVertices + 1, 0), vertexFaces(numFaces * 3);
+	for (unsigned int i = 0; i < numFaces * 3; ++i)
+		first[indices[i] + 1]++;
+	for (unsigned int v = 0; v < numVertices; ++v)
+		first[v + 1] += first[v];
+	std::vector<unsigned int> fill(first.begin(), first.end() - 1);
+	for (unsigned int i = 0; i < numFaces * 3; ++i)
+		vertexFaces[fill[indices[i]]++] = i / 3;
+
+	std::vector<bool> used(numFaces, false);
+	// vertex -> last cluster that used it
+	std::vector<unsigned int> vertexCluster(numVertices, 0xFFFFFFFF);
+	// face -> last cluster whose frontier holds it
+	std::vector<unsigned int> faceFrontier(numFaces, 0xFFFFFFFF);
+	std::vector<unsigned int> order;
+	order.reserve(numFaces);
+	std::vector<unsigned int> frontier, cluster;
+	unsigned int seed = 0;
+
+	while (order.size() < numFaces) {
+
+		while (used[seed])
+			seed++;
+
+		unsigned int id = (unsigned int)meshlets.size();
+		float axis[3] = { 0.0f, 0.0f, 0.0f };
+		cluster.clear();
+		frontier.clear();
+		frontier.push_back(seed);
+		faceFrontier[seed] = id;
+
+		while (cluster.size() < maxTriangles && !frontier.empty()) {
+
+			// pick the frontier face sharing most vertices,
+			// ties broken by the normal
+			size_t best = 0;
+			float bestScore = -FLT_MAX;
+			for (size_t i = 0; i < frontier.size(); ++i) {
+				unsigned int f = frontier[i];
+				float score = 0.0f;
+				for (int k = 0; k < 3; ++k)
+					if (vertexCluster[indices[f * 3 + k]] == id)
+						score += 1.0f;
+				score += normals[f * 3] * axis[0] + normals[f * 3 + 1] * axis[1] +
+						normals[f * 3 + 2] * axis[2];
+				if (score > bestScore) {
+					bestScore = score;
+					best = i;
+				}
+			}
+			unsigned int f = frontier[best];
+			frontier[best] = frontier.back();
+			frontier.pop_back();
+			if (used[f])
+				continue;
+
+			used[f] = true;
+			cluster.push_back(f);
+			float len = 0.0f;
+			for (int k = 0; k < 3; ++k) {
+				axis[k] = axis[k] * (cluster.size() - 1) + normals[f * 3 + k];
+				len += axis[k] * axis[k];
+			}
+			len = sqrtf(len);
+			for (int k = 0; k < 3; ++k)
+				axis[k] = len > 0.0f ? axis[k] / len : 0.0f;
+
+			for (int k = 0; k < 3; ++k) {
+				unsigned int v = indices[f * 3 + k];
+				if (vertexCluster[v] == id)
+					continue;
+				vertexCluster[v] = id;
+				for (unsigned int j = first[v]; j < first[v + 1]; ++j) {
+					unsigned int g = vertexFaces[j];
+					if (!used[g] && faceFrontier[g] != id) {
+						faceFrontier[g] = id;
+						frontier.push_back(g);
+					}
+				}
+			}
+		}
+
+		Meshlet m;
+		m.firstIndex = (unsigned int)order.size() * 3;
+		m.numIndices = (unsigned int)cluster.size() * 3;
+
+		// bounding sphere of the cluster vertices
+		std::vector<float> pos;
+		pos.reserve(cluster.size() * 9);
+		for (size_t i = 0; i < cluster.size(); ++i)
+			for (int k = 0; k < 3; ++k)
+				pos.insert(pos.end(), POS(indices[cluster[i] * 3 + k]), POS(indices[cluster[i] * 3 + k]) + 3);
+		computeBoundingSphere(&pos[0], (unsigned int)cluster.size() * 3, 3, m.center, &m.radius);
+
+		// normal cone
+		float axisLen = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+		float minDot = 1.0f;
+		for (size_t i = 0; i < cluster.size(); ++i) {
+			const float *n = &normals[cluster[i] * 3];
+			minDot = std::min(minDot, n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2]);
+		}
+		for (int k = 0; k < 3; ++k)
+			m.coneAxis[k] = axis[k];
+
+		if (axisLen == 0.0f || minDot <= 0.1f) {
+			m.coneCutoff = 2.0f;
+			for (int k = 0; k < 3; ++k)
+				m.coneApex[k] = m.center[k];
+		}
+		else {
+			// move the apex back so that the cone contains all triangle planes
+			float maxT = 0.0f;
+			for (size_t i = 0; i < cluster.size(); ++i) {
+				const float *n = &normals[cluster[i] * 3];
+				const float *p0 = POS(indices[cluster[i] * 3]);
+				float d[3] = { m.center[0] - p0[0], m.center[1] - p0[1], m.center[2] - p0[2] };
+				float dn = d[0] * n[0] + d[1] * n[1] + d[2] * n[2];
+				float an = axis[0] * n[0] + axis[1] * n[1] + axis[2] * n[2];
+				maxT = std::max(maxT, dn / an);
+			}
+			for (int k = 0; k < 3; ++k)
+				m.coneApex[k] = m.center[k] - axis[k] * maxT;
+			m.coneCutoff = sqrtf(1.0f - minDot * minDot);
+		}
+		meshlets.push_back(m);
+		order.insert(order.end(), cluster.begin(), cluster.end());
+	}
+#undef POS
+
+	std::vector<unsigned int> reordered(numFaces * 3);
+	for (unsigned int i = 0; i < numFaces; ++i)
+		for (int k = 0; k < 3; ++k)
+			reordered[i * 3 + k] = indices[order[i] * 3 + k];
+	memcpy(indices, &reordered[0], numFaces * 3 * sizeof(unsigned int));
+}
+
+
+unsigned long long
+VSMeshOptLib::hash(const void *data, size_t size, unsigned long long seed) {
+
+	const unsigned char *bytes = (const unsigned char *)data;
+	unsigned long long h = seed;
+	for (size_t i = 0; i < size; ++i) {
+		h ^= bytes[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+
+unsigned int
+VSMeshOptLib::weldVertices(const std::vector<VertexStream> &streams,
+						unsigned int numVertices, float epsilon,
+						std::vector<unsigned int> &remap,
+						std::vector<unsigned int> &unique) {
+
+	remap.resize(numVertices);
+	unique.clear();
+
+	// the key of a vertex, the raw bits or the grid cell of each value
+	unsigned int keySize = 0;
+	for (size_t s = 0; s < streams.size(); ++s)
+		keySize += streams[s].components;
+
+	// cells are 64 bit, and clamped, so that small epsilons do not overflow
+	const double maxCell = 4.0e18;
+	std::vector<int64_t> keys((size_t)numVertices * keySize);
+	for (unsigned int v = 0; v < numVertices; ++v) {
+		int64_t *key = &keys[(size_t)v * keySize];
+		for (size_t s = 0; s < streams.size(); ++s) {
+			const float *src = streams[s].data + (size_t)v * streams[s].stride;
+			for (unsigned int c = 0; c < streams[s].components; ++c, ++key) {
+				if (epsilon > 0.0f) {
+					double cell = floor(src[c] / (double)epsilon + 0.5);
+					// NaN goes to the lowest cell
+					if (!(cell > -maxCell))
+						cell = -maxCell;
+					else if (cell > maxCell)
+						cell = maxCell;
+					*key = (int64_t)cell;
+				}
+				else {
+					uint32_t bits;
+					memcpy(&bits, &src[c], sizeof(float));
+					*key = bits;
+				}
+			}
+		}
+	}
+
+	// open addressing hash table of unique vertices
+	unsigned int tableSize = 1;
+	while (tableSize < numVertices * 2)
+		tableSize *= 2;
+	std::vector<unsigned int> table(tableSize, 0xFFFFFFFF);
+
+	for (unsigned int v = 0; v < numVertices; ++v) {
+
+		const int64_t *key = &keys[(size_t)v * keySize];
+		unsigned int slot = (unsigned int)hash(key, keySize * sizeof(int64_t)) & (tableSize - 1);
+
+		while (true) {
+			unsigned int u = table[slot];
+			if (u == 0xFFFFFFFF) {
+				table[slot] = v;
+				remap[v] = (unsigned int)unique.size();
+				unique.push_back(v);
+				break;
+			}
+			if (memcmp(key, &keys[(size_t)u * keySize], keySize * sizeof(int64_t)) == 0) {
+				remap[v] = remap[u];
+				break;
+			}
+			slot = (slot + 1) & (tableSize - 1);
+		}
+	}
+	return (unsigned int)unique.size();
+}
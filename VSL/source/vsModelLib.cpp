@@ -35,6 +35,22 @@
  ---------------------------------------------------------------*/
 
 #include "vsModelLib.h"
+#include "vsTextureLib.h"
+#include "vsTextureStreamLib.h"
+#include "vsThreadLib.h"
+#include "vsUploadLib.h"
+#include "vsMeshOptLib.h"
+#include "vsMemoryLib.h"
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define __VSL_SSE__
+#endif
+#include <string.h>
 
 #ifdef __ANDROID_API__
 #include <android/log.h>
@@ -44,9 +60,21 @@ static const char* kTAG = "vsModelLib.cpp";
 #endif
 
 
+// bound to const references, hence defined
+const unsigned int VSModelLib::NO_TWIN;
+
 
 
-VSModelLib::VSModelLib():pUseAdjacency(false) {
+
+VSModelLib::VSModelLib():mDrawOrderValid(false),
+	mMaterialBuffer(0), mMaterialStride(0), mMaterialSize(0), mMaterialBinding(0),
+	mMaterialBufferValid(false), mMergedMode(false),
+	mLODLevels(0), mLODReduction(0.5f), mLODPixelError(1.0f), mLODHysteresis(0.1f),
+	mFrustumCulling(true), mMeshletTriangles(0), mMeshletCulling(false), mMeshletsFreed(0),
+	mNodeInstancing(false), mNodeTransforms(0), mWeldEpsilon(0.0f), mShareDuplicates(true),
+	mTexturePacking(PACK_NONE), mAtlasMaxTexture(512),
+	pUseAdjacency(false), mImportProfile(IMPORT_QUALITY), mProgramAttributeFilter(false),
+	mTextureStreaming(false), mTextureCompression(false), mUploadTicket(0), mVAOsPending(false) {
 
 #if defined(__VSL_MODEL_LOADING__)
 
@@ -55,29 +83,92 @@ VSModelLib::VSModelLib():pUseAdjacency(false) {
 	mMyMeshes.reserve(10);
 	mMyMeshesAux.reserve(10);
 	mFlagMode = NORMAL | TEXCOORD;
+	memset(&mRenderStats, 0, sizeof(RenderStats));
+	mMerged.vao = 0; mMerged.vboPos = 0; mMerged.vboNormal = 0; mMerged.vboTexCoord = 0;
+	mMerged.vboTangent = 0; mMerged.vboBitangent = 0; mMerged.vboIndices = 0;
+	mMerged.indirectBuffer = 0; mMerged.drawDataBuffer = 0;
+	mMerged.drawCount = 0;
+	mMerged.type = GL_TRIANGLES;
 }
 
 
 VSModelLib::~VSModelLib() {
 
-	for (unsigned int i = 0; i < mMyMeshes.size(); ++i) {
-		glDeleteVertexArrays(1,&(mMyMeshes[i].vao));
-		glDeleteBuffers(1, &(mMyMeshes[i].vboPos));
-		glDeleteBuffers(1, &(mMyMeshes[i].vboNormal));
-		glDeleteBuffers(1, &(mMyMeshes[i].vboTangent));
-		glDeleteBuffers(1, &(mMyMeshes[i].vboBitangent));
-		glDeleteBuffers(1, &(mMyMeshes[i].vboTexCoord));
-		glDeleteBuffers(1, &(mMyMeshes[i].vboIndices));
-
-#if  defined(_VSL_TEXTURE_WITH_DEVIL) || defined(__ANDROID_API__)
-
-		for (int t = 0; t < MAX_TEXTURES; ++t ) {
-			glDeleteTextures(1,&(mMyMeshes[i].texUnits[t]));
-		}
+	// the geometry is deleted with its last mesh, and
+	// textures are released by VSResourceLib's destructor
+#if !defined(__ANDROID_API__)
+	VSUploadLib::wait(mUploadTicket);
 #endif
-		glDeleteBuffers(1,&(mMyMeshes[i].uniformBlockIndex));
-	}
 	mMyMeshes.clear();
+	if (mMaterialBuffer)
+		glDeleteBuffers(1, &mMaterialBuffer);
+	deleteMergedGeometry();
+	if (mNodeTransforms)
+		glDeleteBuffers(1, &mNodeTransforms);
+
+	std::map<VSShaderLib::AttribType, InstanceAttrib>::iterator iter;
+	for (iter = mInstanceAttribs.begin(); iter != mInstanceAttribs.end(); ++iter)
+		glDeleteBuffers(1, &(iter->second.vbo));
+}
+
+
+VSModelLib::Geometry::~Geometry() {
+
+	if (vao)
+		glDeleteVertexArrays(1, &vao);
+	GLuint buffers[6] = { vboPos, vboNormal, vboTexCoord, vboTangent, vboBitangent, vboIndices };
+	glDeleteBuffers(6, buffers);
+}
+
+
+void
+VSModelLib::ownGeometry(MyMesh &m) {
+
+	m.geometry = std::make_shared<Geometry>();
+	m.geometry->vao = m.vao;
+	m.geometry->vboPos = m.vboPos;
+	m.geometry->vboNormal = m.vboNormal;
+	m.geometry->vboTexCoord = m.vboTexCoord;
+	m.geometry->vboTangent = m.vboTangent;
+	m.geometry->vboBitangent = m.vboBitangent;
+	m.geometry->vboIndices = m.vboIndices;
+	m.geometry->vertexCapacity = m.numVertices;
+	m.geometry->indexCapacity = m.hasIndices ? m.numIndices : 0;
+}
+
+
+void
+VSModelLib::setImportProfile(ImportProfile profile) {
+
+	mImportProfile = profile;
+}
+
+
+void
+VSModelLib::setProgramAttributeFilter(bool enabled) {
+
+	mProgramAttributeFilter = enabled;
+}
+
+
+void
+VSModelLib::setTextureStreaming(bool enabled) {
+
+	mTextureStreaming = enabled;
+}
+
+
+void
+VSModelLib::setTextureCompression(bool enabled) {
+
+	mTextureCompression = enabled;
+}
+
+
+bool
+VSModelLib::isReady() {
+
+	return completeUpload(false);
 }
 
 
@@ -112,12 +203,18 @@ VSModelLib::load(std::string filename) {
 			  filename.c_str());
 		return false;
 	}
-	mScene = importer.ReadFile( filename,
-					aiProcessPreset_TargetRealtime_Quality);
+	int mode = getLoadMode();
+	int removed;
+	unsigned int flags = getImportFlags(mode, removed);
+	importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, removed);
+	mScene = importer.ReadFile( filename, flags);
 	//aiProcessPreset_TargetRealtime_MaxQuality
 #else
-	mScene = s_Importer->ReadFile( filename,
-								aiProcessPreset_TargetRealtime_Quality);
+	int mode = getLoadMode();
+	int removed;
+	unsigned int flags = getImportFlags(mode, removed);
+	s_Importer->SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, removed);
+	mScene = s_Importer->ReadFile( filename, flags);
 	LOGD("Assimp done");
 #endif
 	// If the import failed, report it
@@ -126,6 +223,15 @@ VSModelLib::load(std::string filename) {
 					filename.c_str());
 		return false;
 	}
+	// the temporary arrays of the load are released at the end
+	VSMemoryLib::ScratchScope scope;
+	// the buffers of a previous load are complete before they are replaced
+	completeUpload(true);
+#if !defined(__ANDROID_API__)
+	if (VSUploadLib::isRunning())
+		mPendingBuffers = std::make_shared<std::vector<std::pair<GLuint, std::vector<unsigned char> > > >();
+#endif
+
 	// Get prefix for texture loading
 	size_t index = filename.find_last_of("/\\");
 	std::string prefix = filename.substr(0, index+1);
@@ -138,7 +244,25 @@ VSModelLib::load(std::string filename) {
 
 #endif
 
-	genVAOsAndUniformBuffer(mScene);
+	genVAOsAndUniformBuffer(mScene, mode);
+#if !defined(__ANDROID_API__)
+	if (mPendingBuffers) {
+		std::shared_ptr<std::vector<std::pair<GLuint, std::vector<unsigned char> > > > buffers;
+		buffers.swap(mPendingBuffers);
+		mUploadTicket = VSUploadLib::submit([buffers] {
+			for (size_t i = 0; i < buffers->size(); ++i) {
+				std::vector<unsigned char> &contents = (*buffers)[i].second;
+				glBindBuffer(GL_COPY_WRITE_BUFFER, (*buffers)[i].first);
+				glBufferData(GL_COPY_WRITE_BUFFER, contents.size(), &contents[0], GL_STATIC_DRAW);
+				std::vector<unsigned char>().swap(contents);
+			}
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		});
+		mVAOsPending = true;
+	}
+#endif
+	if (mTexturePacking != PACK_NONE)
+		packTextures(mTexturePacking);
 
 	// determine bounding box
 	aiVector3t<float> min, max;
@@ -208,62 +332,1677 @@ VSModelLib::load(std::string filename) {
 void
 VSModelLib::render (int instances) {
 
+	// nothing is drawn until the uploaded buffers are complete
+	if (!completeUpload(false))
+		return;
+
+	if (mMergedMode) {
+		renderMerged(instances);
+		return;
+	}
+
+	if (!mDrawOrderValid || mDrawOrder.size() != mMyMeshes.size())
+		buildDrawOrder();
+	if (!mMaterialBufferValid)
+		buildMaterialBuffer();
+
+	memset(&mRenderStats, 0, sizeof(RenderStats));
+
+	// state set by the previous draw. Nothing is assumed
+	// about the state prior to the call
+	BoundState state;
+	resetBoundState(state);
+	// queried when the first mesh with levels of detail is drawn
+	float viewportHeight = -1.0f;
+
+	// instance attributes may move the meshes anywhere
+	bool cull = mFrustumCulling && instances == 0;
+	if (cull)
+		cullMeshes();
+
 	mVSML->pushMatrix(VSMathLib::MODEL);
-	//mVSML->scale(mScaleToUnitCube, mScaleToUnitCube, mScaleToUnitCube);
-	//mVSML->translate(-mCenter[0], -mCenter[1], -mCenter[2]);
-	for (unsigned int i = 0; i < mMyMeshes.size(); ++i) {
 
-		mVSML->pushMatrix(VSMathLib::MODEL);
-		mVSML->multMatrix(VSMathLib::MODEL,
-						  mMyMeshes[i].transform);
-		// send matrices to shaders
-		mVSML->matricesToGL();
+	if (mNodeInstancing && instances == 0 && mNodeTransforms != 0) {
+		renderNodeInstances(state, cull);
+		releaseBoundState(state);
+		mVSML->popMatrix(VSMathLib::MODEL);
+		return;
+	}
 
-		// set material
-		setMaterial(mMyMeshes[i].mat);
+	// the model matrix is only sent when the transform changes
+	mVSML->pushMatrix(VSMathLib::MODEL);
 
-#if defined(__VSL_TEXTURE_LOADING__)
+	for (unsigned int k = 0; k < mDrawOrder.size(); ++k) {
 
-		// bind texture
-		for (unsigned int j = 0; j < VSResourceLib::MAX_TEXTURES; ++j) {
-			if (mMyMeshes[i].texUnits[j] != 0) {
-				glActiveTexture(GL_TEXTURE0 + j);
-				glBindTexture(mMyMeshes[i].texTypes[j],
-						mMyMeshes[i].texUnits[j]);
-			}
+		if (cull && !mVisible[k]) {
+			mRenderStats.meshesCulled++;
+			continue;
 		}
-#endif
-		// bind VAO
-		glBindVertexArray(mMyMeshes[i].vao);
-		if (mMyMeshes[i].hasIndices) {
-			if (instances == 0)
-				glDrawElements(mMyMeshes[i].type,
-					mMyMeshes[i].numIndices, GL_UNSIGNED_INT, 0);
-			else
-				glDrawElementsInstanced(mMyMeshes[i].type,
-					mMyMeshes[i].numIndices, GL_UNSIGNED_INT, 0, instances);
+		mRenderStats.meshesDrawn++;
+
+		GLint transform = (GLint)mDraw.transform[k];
+		if (state.transform != transform) {
+			mVSML->popMatrix(VSMathLib::MODEL);
+			mVSML->pushMatrix(VSMathLib::MODEL);
+			mVSML->multMatrix(VSMathLib::MODEL, &mDraw.transforms[transform * 16]);
+			// send matrices to shaders
+			mVSML->matricesToGL();
+			state.transform = transform;
 		}
-		else {
+
+		bindDrawState(k, state);
+
+		GLenum type = mDraw.type[k];
+		if (!mDraw.indexed[k]) {
 			if (instances == 0)
-				glDrawArrays(mMyMeshes[i].type, 0, mMyMeshes[i].numIndices);
+				glDrawArrays(type, 0, mDraw.count[k]);
 			else
-				glDrawArraysInstanced(mMyMeshes[i].type, 0, mMyMeshes[i].numIndices, 0);
+				glDrawArraysInstanced(type, 0, mDraw.count[k], instances);
+			mRenderStats.draws++;
+			continue;
+		}
+
+		GLsizei count = mDraw.count[k];
+		const GLvoid *first = 0;
+		if (mDraw.detailed[k]) {
+			MyMesh &mesh = mMyMeshes[mDrawOrder[k]];
+			int level = 0;
+			if (mesh.numLODs > 1 && type == GL_TRIANGLES && mLODPixelError > 0.0f) {
+				if (viewportHeight < 0.0f) {
+					GLint vp[4];
+					glGetIntegerv(GL_VIEWPORT, vp);
+					viewportHeight = (float)vp[3];
+				}
+				level = selectLOD(mesh, viewportHeight);
+				const LOD &lod = mesh.lods[level];
+				count = lod.numIndices;
+				first = (const GLvoid *)(lod.firstIndex * sizeof(unsigned int));
+			}
+			// clusters only exist for the full resolution level
+			if (mMeshletCulling && mesh.numMeshlets > 0 && level == 0 &&
+					type == GL_TRIANGLES && instances == 0) {
+				unsigned int ranges = cullMeshlets(mesh);
+				if (ranges > 0) {
+#ifdef __ANDROID_API__
+					for (unsigned int r = 0; r < ranges; ++r)
+						glDrawElements(type, mClusterCounts[r],
+							GL_UNSIGNED_INT, mClusterOffsets[r]);
+#else
+					glMultiDrawElements(type, &mClusterCounts[0],
+						GL_UNSIGNED_INT, &mClusterOffsets[0], ranges);
+#endif
+					mRenderStats.draws++;
+				}
+				continue;
+			}
+		}
+		if (instances == 0)
+			glDrawElements(type, count, GL_UNSIGNED_INT, first);
+		else
+			glDrawElementsInstanced(type, count, GL_UNSIGNED_INT, first, instances);
+		mRenderStats.draws++;
+	}
+
+	mVSML->popMatrix(VSMathLib::MODEL);
+	releaseBoundState(state);
+	mVSML->popMatrix(VSMathLib::MODEL);
+}
+
+
+void
+VSModelLib::renderNodeInstances(BoundState &state, bool cull) {
+
+	// the node transforms are per instance, the model
+	// matrix is the same for all draws
+	mVSML->matricesToGL();
+
+	float viewportHeight = -1.0f;
+	std::vector<int> levels;
+
+	for (unsigned int g = 0; g + 1 < mNodeGroups.size(); ++g) {
+
+		unsigned int begin = mNodeGroups[g], end = mNodeGroups[g + 1];
+		const MyMesh &mesh = mMyMeshes[mDrawOrder[begin]];
+
+		// pick a level per node, instances are drawn in runs
+		// of visible nodes with the same level
+		levels.assign(end - begin, 0);
+		for (unsigned int k = begin; k < end; ++k) {
+			if (cull && !mVisible[k]) {
+				levels[k - begin] = -1;
+				mRenderStats.meshesCulled++;
+				continue;
+			}
+			mRenderStats.meshesDrawn++;
+			if (!mDraw.detailed[k])
+				continue;
+			MyMesh &node = mMyMeshes[mDrawOrder[k]];
+			if (node.numLODs > 1 && node.type == GL_TRIANGLES && mLODPixelError > 0.0f) {
+				if (viewportHeight < 0.0f) {
+					GLint vp[4];
+					glGetIntegerv(GL_VIEWPORT, vp);
+					viewportHeight = (float)vp[3];
+				}
+				mVSML->pushMatrix(VSMathLib::MODEL);
+				mVSML->multMatrix(VSMathLib::MODEL, &mDraw.transforms[mDraw.transform[k] * 16]);
+				levels[k - begin] = selectLOD(node, viewportHeight);
+				mVSML->popMatrix(VSMathLib::MODEL);
+			}
+		}
+
+		unsigned int k = begin;
+		while (k < end) {
+			int level = levels[k - begin];
+			unsigned int run = k + 1;
+			while (run < end && levels[run - begin] == level)
+				run++;
+			if (level >= 0) {
+				bindDrawState(begin, state);
+				// the transforms are stored in draw order
+				glBindBuffer(GL_ARRAY_BUFFER, mNodeTransforms);
+				for (int c = 0; c < 4; ++c) {
+					GLuint loc = VSShaderLib::INSTANCE_MATRIX_ATTRIB + c;
+					glEnableVertexAttribArray(loc);
+					glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float),
+						(const GLvoid *)((k * 16 + c * 4) * sizeof(float)));
+					glVertexAttribDivisor(loc, 1);
+				}
+				glBindBuffer(GL_ARRAY_BUFFER, 0);
+				state.nodeMatrices = true;
+
+				GLsizei instances = run - k;
+				if (mesh.hasIndices) {
+					const LOD &lod = mesh.lods[level];
+					GLsizei count = mesh.numLODs > 1 ? lod.numIndices : mesh.numIndices;
+					const GLvoid *first = (const GLvoid *)(mesh.numLODs > 1 ?
+									lod.firstIndex * sizeof(unsigned int) : 0);
+					glDrawElementsInstanced(mesh.type, count, GL_UNSIGNED_INT,
+									first, instances);
+				}
+				else
+					glDrawArraysInstanced(mesh.type, 0, mesh.numIndices, instances);
+				mRenderStats.draws++;
+			}
+			k = run;
 		}
+	}
+
+}
+
+
+void
+VSModelLib::resetBoundState(BoundState &state) {
+
+	for (int j = 0; j < MAX_TEXTURES; ++j) {
+		state.tex[j] = 0;
+		state.type[j] = 0;
+	}
+	state.material = -1;
+	state.materialSlot = false;
+	state.transform = -1;
+	state.vao = 0;
+	state.vaoBound = false;
+	state.nodeMatrices = false;
+}
+
+
+void
+VSModelLib::bindDrawState(unsigned int k, BoundState &state) {
+
+	// materials are stored once, equal indices are equal materials
+	GLint material = (GLint)mDraw.material[k];
+	if (state.material == material)
+		mRenderStats.materialUpdatesAvoided++;
+	// baked materials: bind the slot, no data is sent
+	else if (mMaterialBuffer != 0) {
+		glBindBufferRange(GL_UNIFORM_BUFFER, mMaterialBinding, mMaterialBuffer,
+					material * mMaterialStride, mMaterialSize);
+		state.material = material;
+		state.materialSlot = true;
+		mRenderStats.materialUpdates++;
+	}
+	else {
+		setMaterial(mDraw.materials[material]);
+		state.material = material;
+		mRenderStats.materialUpdates++;
+	}
 
 #if defined(__VSL_TEXTURE_LOADING__)
-		for (unsigned int j = 0; j < VSResourceLib::MAX_TEXTURES; ++j) {
-			if (mMyMeshes[i].texUnits[j] != 0) {
+
+	// bind textures that are not already bound, and unbind the
+	// units this set does not use. Textures are not unbound between
+	// draws that use the same unit
+	const TextureSet &set = mDraw.textureSets[mDraw.textures[k]];
+	for (unsigned int j = 0; j < VSResourceLib::MAX_TEXTURES; ++j) {
+		GLuint tex = set.units[j];
+#if !defined(__ANDROID_API__)
+		if (tex != 0) {
+			VSTextureLib::touch(tex);
+			// textures still defined by the uploader are not sampled
+			if (!VSUploadLib::isTextureReady(tex))
+				tex = 0;
+		}
+#endif
+		if (tex == 0) {
+			if (state.tex[j] != 0) {
 				glActiveTexture(GL_TEXTURE0 + j);
-				glBindTexture(mMyMeshes[i].texTypes[j], 0);
+				glBindTexture(state.type[j], 0);
+				state.tex[j] = 0;
 			}
+			continue;
+		}
+		// the unit stays bound from the previous draw
+		if (state.tex[j] != 0)
+			mRenderStats.textureUnbindsAvoided++;
+		if (state.tex[j] == tex && state.type[j] == set.types[j]) {
+			mRenderStats.textureBindsAvoided++;
+		}
+		else {
+			glActiveTexture(GL_TEXTURE0 + j);
+			if (state.tex[j] != 0 && state.type[j] != set.types[j])
+				glBindTexture(state.type[j], 0);
+			glBindTexture(set.types[j], tex);
+			state.tex[j] = tex;
+			state.type[j] = set.types[j];
+			mRenderStats.textureBinds++;
 		}
+	}
 #endif
-		mVSML->popMatrix(VSMathLib::MODEL);
+	// bind VAO
+	GLuint vao = mDraw.vao[k];
+	if (state.vaoBound && state.vao == vao)
+		mRenderStats.vaoBindsAvoided++;
+	else {
+		if (state.vaoBound)
+			unbindInstanceAttribs(state.nodeMatrices);
+		state.nodeMatrices = false;
+		glBindVertexArray(vao);
+		bindInstanceAttribs();
+		state.vao = vao;
+		state.vaoBound = true;
+		mRenderStats.vaoBinds++;
+	}
+}
+
+
+void
+VSModelLib::releaseBoundState(BoundState &state) {
+
+#if defined(__VSL_TEXTURE_LOADING__)
+	// leave the texture units as they were found
+	for (unsigned int j = 0; j < VSResourceLib::MAX_TEXTURES; ++j) {
+		if (state.tex[j] != 0) {
+			glActiveTexture(GL_TEXTURE0 + j);
+			glBindTexture(state.type[j], 0);
+		}
 	}
+#endif
+	// setMaterial writes to the block's own buffer
+	if (state.materialSlot)
+		VSShaderLib::bindBlockBuffer(sMaterialBlockName);
+	if (state.vaoBound)
+		unbindInstanceAttribs(state.nodeMatrices);
 	glBindVertexArray(0);
-	mVSML->popMatrix(VSMathLib::MODEL);
+	resetBoundState(state);
+}
+
+
+void
+VSModelLib::buildDrawOrder() {
+
+	mDrawOrder.resize(mMyMeshes.size());
+	for (unsigned int i = 0; i < mDrawOrder.size(); ++i)
+		mDrawOrder[i] = i;
+
+	// the program is the same for all the meshes in a render call,
+	// hence the sort key is (texture set, material, VAO)
+	const std::vector<MyMesh> &meshes = mMyMeshes;
+	std::stable_sort(mDrawOrder.begin(), mDrawOrder.end(),
+		[&meshes](unsigned int a, unsigned int b) {
+
+			const MyMesh &ma = meshes[a], &mb = meshes[b];
+			int c = memcmp(ma.texUnits, mb.texUnits, sizeof(ma.texUnits));
+			if (c == 0) {
+				for (int j = 0; j < MAX_TEXTURES && c == 0; ++j) {
+					if (ma.texUnits[j] != 0)
+						c = (int)ma.texTypes[j] - (int)mb.texTypes[j];
+				}
+			}
+			if (c == 0)
+				c = memcmp(&ma.mat, &mb.mat, sizeof(Material));
+			if (c != 0)
+				return c < 0;
+			return ma.vao < mb.vao;
+		});
+
+	buildDrawRecords();
+	buildCullBoxes();
+	if (mNodeInstancing)
+		buildNodeInstances();
+	// materials may have changed as well
+	mMaterialBufferValid = false;
+	mDrawOrderValid = true;
+}
+
+
+void
+VSModelLib::buildDrawRecords() {
+
+	size_t count = mDrawOrder.size();
+	mDraw.vao.resize(count);
+	mDraw.type.resize(count);
+	mDraw.count.resize(count);
+	mDraw.indexed.resize(count);
+	mDraw.material.resize(count);
+	mDraw.textures.resize(count);
+	mDraw.transform.resize(count);
+	mDraw.detailed.resize(count);
+	mDraw.materials.clear();
+	mDraw.textureSets.clear();
+	mDraw.transforms.clear();
+
+	// materials, texture sets and transforms are stored once
+	std::map<std::string, unsigned int> materials, textureSets, transforms;
+	for (size_t k = 0; k < count; ++k) {
+
+		MyMesh &m = mMyMeshes[mDrawOrder[k]];
+		mDraw.vao[k] = m.vao;
+		mDraw.type[k] = m.type;
+		mDraw.count[k] = m.numIndices;
+		mDraw.indexed[k] = m.hasIndices;
+		mDraw.detailed[k] = isDetailed(m);
+
+		std::string key((const char *)&m.mat, sizeof(Material));
+		std::map<std::string, unsigned int>::iterator iter = materials.find(key);
+		if (iter == materials.end()) {
+			iter = materials.insert(std::make_pair(key, (unsigned int)mDraw.materials.size())).first;
+			mDraw.materials.push_back(m.mat);
+		}
+		mDraw.material[k] = iter->second;
+		m.uniformBlockIndex = iter->second;
+
+		TextureSet set;
+		for (int j = 0; j < MAX_TEXTURES; ++j) {
+			set.units[j] = m.texUnits[j];
+			set.types[j] = m.texUnits[j] ? m.texTypes[j] : 0;
+		}
+		key.assign((const char *)&set, sizeof(TextureSet));
+		iter = textureSets.find(key);
+		if (iter == textureSets.end()) {
+			iter = textureSets.insert(std::make_pair(key, (unsigned int)mDraw.textureSets.size())).first;
+			mDraw.textureSets.push_back(set);
+		}
+		mDraw.textures[k] = iter->second;
+
+		key.assign((const char *)m.transform, 16 * sizeof(float));
+		iter = transforms.find(key);
+		if (iter == transforms.end()) {
+			iter = transforms.insert(std::make_pair(key, (unsigned int)mDraw.transforms.size() / 16)).first;
+			mDraw.transforms.insert(mDraw.transforms.end(), m.transform, m.transform + 16);
+		}
+		mDraw.transform[k] = iter->second;
+	}
+}
+
+
+bool
+VSModelLib::isDetailed(const MyMesh &m) {
+
+	return m.hasIndices &&
+		((m.numLODs > 1 && m.type == GL_TRIANGLES) || m.numMeshlets > 0);
+}
+
+
+void
+VSModelLib::buildMaterialBuffer() {
+
+	if (mMaterialBuffer) {
+		glDeleteBuffers(1, &mMaterialBuffer);
+		mMaterialBuffer = 0;
+	}
+
+	// without a block the materials are set with setMaterial. If the
+	// program with the block is not ready yet try again next time
+	int blockSize;
+	if (sMaterialBlockName == "" ||
+			!VSShaderLib::getBlockBinding(sMaterialBlockName, mMaterialBinding, blockSize)) {
+		mMaterialBufferValid = (sMaterialBlockName == "");
+		return;
+	}
+	mMaterialBufferValid = true;
+	if (mDraw.materials.empty() || blockSize <= 0)
+		return;
+
+	GLint align;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+	if (align < 1)
+		align = 256;
+	mMaterialSize = blockSize;
+	mMaterialStride = (blockSize + align - 1) / align * align;
+
+	// one slot per distinct material, as in the draw records
+	std::vector<Material> &materials = mDraw.materials;
+	// same layout as setMaterial: the whole struct, or the named fields
+	std::vector<unsigned char> data(materials.size() * mMaterialStride, 0);
+	for (unsigned int k = 0; k < materials.size(); ++k) {
+		unsigned char *slot = &data[k * mMaterialStride];
+		if (mMatSemanticMap.size() == 0)
+			memcpy(slot, &materials[k], std::min((int)sizeof(Material), blockSize));
+		else {
+			std::map<std::string, MaterialSemantics>::iterator iter;
+			for (iter = mMatSemanticMap.begin(); iter != mMatSemanticMap.end(); ++iter) {
+				int offset = VSShaderLib::getBlockUniformOffset(sMaterialBlockName, iter->first);
+				int size;
+				void *value = getMaterialField(materials[k], iter->second, size);
+				if (offset >= 0 && offset + size <= blockSize)
+					memcpy(slot + offset, value, size);
+			}
+		}
+	}
+
+	glGenBuffers(1, &mMaterialBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, mMaterialBuffer);
+#ifndef __ANDROID_API__
+	if (GLEW_ARB_buffer_storage)
+		glBufferStorage(GL_UNIFORM_BUFFER, data.size(), &data[0], 0);
+	else
+#endif
+		glBufferData(GL_UNIFORM_BUFFER, data.size(), &data[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+
+void
+VSModelLib::buildNodeInstances() {
+
+	// consecutive meshes in draw order that only differ
+	// in the transform are drawn together
+	mNodeGroups.clear();
+	for (unsigned int k = 0; k < mDrawOrder.size(); ++k) {
+
+		if (k > 0 && mDraw.vao[k - 1] == mDraw.vao[k] && mDraw.type[k - 1] == mDraw.type[k] &&
+				mDraw.count[k - 1] == mDraw.count[k] && mDraw.indexed[k - 1] == mDraw.indexed[k] &&
+				mDraw.material[k - 1] == mDraw.material[k] &&
+				mDraw.textures[k - 1] == mDraw.textures[k])
+			continue;
+		mNodeGroups.push_back(k);
+	}
+	mNodeGroups.push_back((unsigned int)mDrawOrder.size());
+
+	std::vector<float> transforms(mDrawOrder.size() * 16);
+	for (unsigned int k = 0; k < mDrawOrder.size(); ++k)
+		memcpy(&transforms[k * 16], &mDraw.transforms[mDraw.transform[k] * 16], 16 * sizeof(float));
+
+	if (mNodeTransforms == 0)
+		glGenBuffers(1, &mNodeTransforms);
+	glBindBuffer(GL_ARRAY_BUFFER, mNodeTransforms);
+	glBufferData(GL_ARRAY_BUFFER, transforms.size() * sizeof(float),
+				transforms.empty() ? NULL : &transforms[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	VSLOG(sLogInfo, "Node instancing: %d meshes in %d draws",
+				(int)mDrawOrder.size(), (int)mNodeGroups.size() - 1);
+}
+
+
+void
+VSModelLib::setNodeInstancing(bool enabled) {
+
+	mNodeInstancing = enabled;
+	mDrawOrderValid = false;
+}
+
+
+void
+VSModelLib::setWeldEpsilon(float epsilon) {
+
+	mWeldEpsilon = epsilon;
+}
+
+
+void
+VSModelLib::setDuplicateSharing(bool enabled) {
+
+	mShareDuplicates = enabled;
+}
+
+
+void
+VSModelLib::setTexturePacking(TexturePacking packing, unsigned int atlasMaxTexture) {
+
+	mTexturePacking = packing;
+	mAtlasMaxTexture = atlasMaxTexture;
+}
+
+
+bool
+VSModelLib::packTextures(TexturePacking packing) {
+
+#ifdef __ANDROID_API__
+	return packing == PACK_NONE;
+#else
+	if (packing == PACK_NONE)
+		return true;
+	if (!GLEW_VERSION_4_3 && !(GLEW_ARB_copy_image && GLEW_ARB_texture_storage)) {
+		VSLOG(sLogError, "Texture packing requires glCopyImageSubData");
+		return false;
+	}
+
+	// the distinct diffuse textures, with their level zero and mip count
+	std::vector<PackSource> sources;
+	std::map<GLuint, unsigned int> sourceIndex;
+	for (unsigned int i = 0; i < mMyMeshes.size(); ++i) {
+
+		GLuint tex = mMyMeshes[i].texUnits[0];
+		if (tex == 0 || mMyMeshes[i].texTypes[0] != GL_TEXTURE_2D || sourceIndex.count(tex))
+			continue;
+#if defined(__VSL_TEXTURE_LOADING__)
+		if (VSTextureStreamLib::isPending(tex))
+			continue;
+#endif
+		// textures defined by the uploader are read once complete
+		VSUploadLib::waitTexture(tex);
+		GLint format, compressed, width, height, maxLevel, w;
+		glBindTexture(GL_TEXTURE_2D, tex);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+		if (width == 0 || height == 0)
+			continue;
+
+		PackSource s;
+		s.texture = tex;
+		s.format = (GLenum)format;
+		s.compressed = compressed != 0;
+		s.width = width;
+		s.height = height;
+		for (s.levels = 1; s.levels <= maxLevel; ++s.levels) {
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, s.levels, GL_TEXTURE_WIDTH, &w);
+			if (w == 0)
+				break;
+		}
+		s.packed = 0;
+		s.target = GL_TEXTURE_2D;
+		s.layer = 0;
+		s.rect[0] = 0.0f; s.rect[1] = 0.0f; s.rect[2] = 1.0f; s.rect[3] = 1.0f;
+		sourceIndex[tex] = (unsigned int)sources.size();
+		sources.push_back(s);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// textures that can share a packed texture
+	std::map<std::string, std::vector<PackSource *> > groups;
+	for (unsigned int i = 0; i < sources.size(); ++i) {
+		PackSource &s = sources[i];
+		char key[64];
+		if (packing == PACK_ARRAY)
+			snprintf(key, 64, "%x|%d|%d|%d", s.format, s.width, s.height, s.levels);
+		else if (s.width <= (GLsizei)mAtlasMaxTexture && s.height <= (GLsizei)mAtlasMaxTexture)
+			snprintf(key, 64, "%x", s.format);
+		else
+			continue;
+		groups[key].push_back(&s);
+	}
+
+	std::map<std::string, std::vector<PackSource *> >::iterator iter;
+	for (iter = groups.begin(); iter != groups.end(); ++iter) {
+		if (iter->second.size() < 2)
+			continue;
+		if (packing == PACK_ARRAY)
+			packArray(iter->second);
+		else
+			packAtlases(iter->second);
+	}
+
+	// meshes switch to the packed textures
+	unsigned int packedCount = 0;
+	for (unsigned int i = 0; i < mMyMeshes.size(); ++i) {
+		MyMesh &m = mMyMeshes[i];
+		std::map<GLuint, unsigned int>::iterator src = sourceIndex.find(m.texUnits[0]);
+		if (m.texTypes[0] != GL_TEXTURE_2D || src == sourceIndex.end() || sources[src->second].packed == 0)
+			continue;
+		const PackSource &s = sources[src->second];
+		m.texUnits[0] = s.packed;
+		m.texTypes[0] = s.target;
+		m.mat.texLayer = s.layer;
+		memcpy(m.mat.texRect, s.rect, sizeof(float) * 4);
+	}
+	for (unsigned int i = 0; i < sources.size(); ++i) {
+		if (sources[i].packed != 0) {
+			releaseTexture(sources[i].texture);
+			packedCount++;
+		}
+	}
+
+	VSLOG(sLogInfo, "Packed %u of %u textures", packedCount, (unsigned int)sources.size());
+	mDrawOrderValid = false;
+	mMaterialBufferValid = false;
+	return true;
+#endif
+}
+
+
+#ifndef __ANDROID_API__
+
+void
+VSModelLib::packArray(std::vector<PackSource *> &group) {
+
+	GLint maxLayers;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+	for (size_t first = 0; first < group.size(); first += maxLayers) {
+
+		size_t count = std::min(group.size() - first, (size_t)maxLayers);
+		if (count < 2)
+			break;
+		std::vector<GLuint> textures;
+		for (size_t i = 0; i < count; ++i)
+			textures.push_back(group[first + i]->texture);
+
+		// models packing the same textures share the array
+		std::string key = VSTextureLib::getPackedKey("ARRAY", textures);
+		GLuint array = VSTextureLib::acquirePacked(key);
+		if (array == 0) {
+			const PackSource &s = *group[first];
+
+			// the sampling parameters of the first texture are kept
+			GLint magFilter, minFilter, wrapS, wrapT;
+			glBindTexture(GL_TEXTURE_2D, s.texture);
+			glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, &magFilter);
+			glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, &minFilter);
+			glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, &wrapS);
+			glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, &wrapT);
+			glBindTexture(GL_TEXTURE_2D, 0);
+
+			glGenTextures(1, &array);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+			glTexStorage3D(GL_TEXTURE_2D_ARRAY, s.levels, s.format, s.width, s.height, (GLsizei)count);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, magFilter);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, minFilter);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrapS);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrapT);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, s.levels - 1);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+			for (size_t i = 0; i < count; ++i) {
+				for (GLsizei l = 0; l < s.levels; ++l)
+					glCopyImageSubData(textures[i], GL_TEXTURE_2D, l, 0, 0, 0,
+								array, GL_TEXTURE_2D_ARRAY, l, 0, 0, (GLint)i,
+								std::max(1, s.width >> l), std::max(1, s.height >> l), 1);
+			}
+			array = VSTextureLib::registerPacked(key, array, GL_TEXTURE_2D_ARRAY);
+		}
+		holdTexture(array);
+
+		for (size_t i = 0; i < count; ++i) {
+			group[first + i]->packed = array;
+			group[first + i]->target = GL_TEXTURE_2D_ARRAY;
+			group[first + i]->layer = (int)i;
+		}
+	}
+}
+
+
+void
+VSModelLib::packAtlases(std::vector<PackSource *> &group) {
+
+	// levels common to the group, with at least one 4x4 block per
+	// image in the coarsest, and at most 5 to keep the gaps small
+	GLsizei levels = 5;
+	for (size_t i = 0; i < group.size(); ++i) {
+		GLsizei fit = 1;
+		while ((std::min(group[i]->width, group[i]->height) >> fit) >= 4)
+			fit++;
+		levels = std::min(levels, std::min(fit, group[i]->levels));
+	}
+	// positions stay texel, or block, aligned in all levels, and
+	// images are apart by a texel of the coarsest level
+	unsigned int align = (group[0]->compressed ? 4u : 1u) << (levels - 1);
+	unsigned int border = 1u << (levels - 1);
+
+	GLint maxSize;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+	maxSize = std::min(maxSize, 4096);
+
+	// shelves of images, the tallest first
+	std::vector<PackSource *> sorted(group);
+	std::sort(sorted.begin(), sorted.end(), [](const PackSource *a, const PackSource *b) {
+		if (a->height != b->height)
+			return a->height > b->height;
+		return a->texture < b->texture;
+	});
+
+	size_t first = 0;
+	while (first < sorted.size()) {
+
+		// the smallest square atlas that takes the remaining
+		// images, or as many as fit in the largest one
+		std::vector<unsigned int> x, y;
+		unsigned int size, height = 0;
+		for (size = 256; ; size *= 2) {
+			x.clear();
+			y.clear();
+			unsigned int penX = 0, penY = 0, shelf = 0;
+			for (size_t i = first; i < sorted.size(); ++i) {
+				unsigned int w = (sorted[i]->width + border + align - 1) / align * align;
+				unsigned int h = (sorted[i]->height + border + align - 1) / align * align;
+				if (penX + w > size) {
+					penY += shelf;
+					penX = 0;
+					shelf = 0;
+				}
+				if (w > size || penY + h > size)
+					break;
+				x.push_back(penX);
+				y.push_back(penY);
+				penX += w;
+				shelf = std::max(shelf, h);
+			}
+			height = penY + shelf;
+			if (first + x.size() == sorted.size() || size >= (unsigned int)maxSize)
+				break;
+		}
+
+		if (x.size() < 2)
+			break;
+		std::vector<PackSource *> placed(sorted.begin() + first, sorted.begin() + first + x.size());
+		buildAtlas(placed, size, height, levels, x, y);
+		first += x.size();
+	}
+}
+
+
+void
+VSModelLib::buildAtlas(std::vector<PackSource *> &sources, GLsizei width, GLsizei height,
+					GLsizei levels, const std::vector<unsigned int> &x, const std::vector<unsigned int> &y) {
+
+	std::vector<GLuint> textures;
+	for (size_t i = 0; i < sources.size(); ++i)
+		textures.push_back(sources[i]->texture);
+
+	// the layout only depends on the sources, so the key identifies it
+	char kind[64];
+	snprintf(kind, 64, "ATLAS|%d|%d|%d", width, height, levels);
+	std::string key = VSTextureLib::getPackedKey(kind, textures);
+	GLuint atlas = VSTextureLib::acquirePacked(key);
+
+	if (atlas == 0) {
+		const PackSource &s = *sources[0];
+
+		GLint magFilter, minFilter;
+		glBindTexture(GL_TEXTURE_2D, s.texture);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, &magFilter);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, &minFilter);
+
+		glGenTextures(1, &atlas);
+		glBindTexture(GL_TEXTURE_2D, atlas);
+		glTexStorage2D(GL_TEXTURE_2D, levels, s.format, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		// the gaps are cleared when the format allows it
+		if (!s.compressed && (GLEW_VERSION_4_4 || GLEW_ARB_clear_texture)) {
+			for (GLsizei l = 0; l < levels; ++l)
+				glClearTexImage(atlas, l, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		}
+		for (size_t i = 0; i < sources.size(); ++i) {
+			for (GLsizei l = 0; l < levels; ++l)
+				glCopyImageSubData(sources[i]->texture, GL_TEXTURE_2D, l, 0, 0, 0,
+							atlas, GL_TEXTURE_2D, l, x[i] >> l, y[i] >> l, 0,
+							std::max(1, sources[i]->width >> l), std::max(1, sources[i]->height >> l), 1);
+		}
+		atlas = VSTextureLib::registerPacked(key, atlas, GL_TEXTURE_2D);
+	}
+	holdTexture(atlas);
+
+	for (size_t i = 0; i < sources.size(); ++i) {
+		PackSource &s = *sources[i];
+		s.packed = atlas;
+		s.target = GL_TEXTURE_2D;
+		s.layer = 0;
+		s.rect[0] = (float)x[i] / width;
+		s.rect[1] = (float)y[i] / height;
+		s.rect[2] = (float)s.width / width;
+		s.rect[3] = (float)s.height / height;
+	}
+}
+
+#endif
+
+
+void
+VSModelLib::buildCullBoxes() {
+
+	unsigned int groups = ((unsigned int)mDrawOrder.size() + 3) / 4;
+	// padding entries are empty boxes at the origin
+	mCullBoxes.assign(groups * 24, 0.0f);
+	mVisible.assign(groups * 4, 1);
+
+	for (unsigned int k = 0; k < mDrawOrder.size(); ++k) {
+
+		const MyMesh &m = mMyMeshes[mDrawOrder[k]];
+		const float *t = m.transform;
+		float c[3], e[3];
+		for (int i = 0; i < 3; ++i) {
+			c[i] = (m.bbMin[i] + m.bbMax[i]) * 0.5f;
+			e[i] = (m.bbMax[i] - m.bbMin[i]) * 0.5f;
+		}
+		// transform the box to the model space, the extents
+		// grow with the absolute values of the matrix
+		float *b = &mCullBoxes[(k / 4) * 24 + k % 4];
+		for (int i = 0; i < 3; ++i) {
+			b[i * 4] = t[i] * c[0] + t[4 + i] * c[1] + t[8 + i] * c[2] + t[12 + i];
+			b[12 + i * 4] = fabsf(t[i]) * e[0] + fabsf(t[4 + i]) * e[1] + fabsf(t[8 + i]) * e[2];
+		}
+	}
+}
+
+
+void
+VSModelLib::cullMeshes() {
+
+	float planes[24];
+	mVSML->extractFrustumPlanes(planes);
+
+	unsigned int groups = (unsigned int)mCullBoxes.size() / 24;
+	for (unsigned int g = 0; g < groups; ++g) {
+
+		const float *b = &mCullBoxes[g * 24];
+#if defined(__VSL_SSE__)
+		__m128 cx = _mm_loadu_ps(b), cy = _mm_loadu_ps(b + 4), cz = _mm_loadu_ps(b + 8);
+		__m128 ex = _mm_loadu_ps(b + 12), ey = _mm_loadu_ps(b + 16), ez = _mm_loadu_ps(b + 20);
+		__m128 outside = _mm_setzero_ps();
+
+		for (int p = 0; p < 6; ++p) {
+			const float *pl = &planes[p * 4];
+			// distance of the centers plus the projected extents
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(pl[0]), cx),
+											_mm_mul_ps(_mm_set1_ps(pl[1]), cy)),
+									_mm_add_ps(_mm_mul_ps(_mm_set1_ps(pl[2]), cz),
+											_mm_set1_ps(pl[3])));
+			__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(fabsf(pl[0])), ex),
+											_mm_mul_ps(_mm_set1_ps(fabsf(pl[1])), ey)),
+									_mm_mul_ps(_mm_set1_ps(fabsf(pl[2])), ez));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+		}
+		int mask = _mm_movemask_ps(outside);
+		for (int i = 0; i < 4; ++i)
+			mVisible[g * 4 + i] = !((mask >> i) & 1);
+#else
+		for (int i = 0; i < 4; ++i) {
+			bool visible = true;
+			for (int p = 0; p < 6 && visible; ++p) {
+				const float *pl = &planes[p * 4];
+				float d = pl[0] * b[i] + pl[1] * b[4 + i] + pl[2] * b[8 + i] + pl[3];
+				float r = fabsf(pl[0]) * b[12 + i] + fabsf(pl[1]) * b[16 + i] + fabsf(pl[2]) * b[20 + i];
+				if (d + r < 0.0f)
+					visible = false;
+			}
+			mVisible[g * 4 + i] = visible;
+		}
+#endif
+	}
+}
+
+
+void
+VSModelLib::setFrustumCulling(bool enabled) {
+
+	mFrustumCulling = enabled;
+}
+
+
+void
+VSModelLib::computeBounds(MyMesh &m, const float *pos, unsigned int stride,
+					unsigned int numVertices) {
+
+	VSMeshOptLib::computeBoundingBox(pos, numVertices, stride, m.bbMin, m.bbMax);
+	VSMeshOptLib::computeBoundingSphere(pos, numVertices, stride, m.boundCenter, &m.boundRadius);
+}
+
+
+void
+VSModelLib::invalidateDrawOrder() {
+
+	mDrawOrderValid = false;
+}
+
+
+const VSModelLib::RenderStats &
+VSModelLib::getRenderStats() {
+
+	return mRenderStats;
+}
+
+
+bool
+VSModelLib::setInstanceAttrib(VSShaderLib::AttribType attrib, int components,
+							unsigned int count, const float *values) {
+
+	if (components != 16 && (components < 1 || components > 4)) {
+		VSLOG(sLogError, "Instance attribute %d: %d components not supported",
+					attrib, components);
+		return false;
+	}
+
+	GLsizeiptr size = count * components * sizeof(float);
+	std::map<VSShaderLib::AttribType, InstanceAttrib>::iterator iter =
+								mInstanceAttribs.find(attrib);
+
+	// same layout: only the storage is replaced
+	if (iter != mInstanceAttribs.end() && iter->second.components == components) {
+		glBindBuffer(GL_ARRAY_BUFFER, iter->second.vbo);
+		glBufferData(GL_ARRAY_BUFFER, size, values, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		iter->second.count = count;
+		return true;
+	}
+
+	if (iter != mInstanceAttribs.end())
+		removeInstanceAttrib(attrib);
+
+	InstanceAttrib ia;
+	ia.components = components;
+	ia.count = count;
+	glGenBuffers(1, &ia.vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, ia.vbo);
+	glBufferData(GL_ARRAY_BUFFER, size, values, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	mInstanceAttribs[attrib] = ia;
+	return true;
+}
+
+
+bool
+VSModelLib::updateInstanceAttrib(VSShaderLib::AttribType attrib,
+							unsigned int first, unsigned int count, const float *values) {
+
+	std::map<VSShaderLib::AttribType, InstanceAttrib>::iterator iter =
+								mInstanceAttribs.find(attrib);
+
+	if (iter == mInstanceAttribs.end() || first + count > iter->second.count) {
+		VSLOG(sLogError, "Instance attribute %d: invalid update range", attrib);
+		return false;
+	}
+
+	GLsizeiptr stride = iter->second.components * sizeof(float);
+	glBindBuffer(GL_ARRAY_BUFFER, iter->second.vbo);
+	glBufferSubData(GL_ARRAY_BUFFER, first * stride, count * stride, values);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return true;
+}
+
+
+void
+VSModelLib::removeInstanceAttrib(VSShaderLib::AttribType attrib) {
+
+	std::map<VSShaderLib::AttribType, InstanceAttrib>::iterator iter =
+								mInstanceAttribs.find(attrib);
+	if (iter == mInstanceAttribs.end())
+		return;
+
+	glDeleteBuffers(1, &(iter->second.vbo));
+	mInstanceAttribs.erase(iter);
+}
+
+
+unsigned int
+VSModelLib::getInstanceCount() {
+
+	if (mInstanceAttribs.size() == 0)
+		return 0;
+
+	unsigned int count = mInstanceAttribs.begin()->second.count;
+	std::map<VSShaderLib::AttribType, InstanceAttrib>::iterator iter;
+	for (iter = mInstanceAttribs.begin(); iter != mInstanceAttribs.end(); ++iter)
+		count = std::min(count, iter->second.count);
+	return count;
+}
+
+
+void
+VSModelLib::setInstanceMatrices(unsigned int count, const float *matrices) {
+
+	setInstanceAttrib(VSShaderLib::INSTANCE_MATRIX_ATTRIB, 16, count, matrices);
+}
+
+
+void
+VSModelLib::updateInstanceMatrices(unsigned int first, unsigned int count, const float *matrices) {
+
+	updateInstanceAttrib(VSShaderLib::INSTANCE_MATRIX_ATTRIB, first, count, matrices);
+}
+
+
+void
+VSModelLib::setInstanceColors(unsigned int count, const float *colors) {
+
+	setInstanceAttrib(VSShaderLib::INSTANCE_COLOR_ATTRIB, 4, count, colors);
+}
+
+
+void
+VSModelLib::updateInstanceColors(unsigned int first, unsigned int count, const float *colors) {
+
+	updateInstanceAttrib(VSShaderLib::INSTANCE_COLOR_ATTRIB, first, count, colors);
+}
+
+
+void
+VSModelLib::bindInstanceAttribs() {
+
+	if (mInstanceAttribs.size() == 0)
+		return;
+
+	std::map<VSShaderLib::AttribType, InstanceAttrib>::iterator iter;
+	for (iter = mInstanceAttribs.begin(); iter != mInstanceAttribs.end(); ++iter) {
+
+		InstanceAttrib &ia = iter->second;
+		// a mat4 is set as four vec4 columns
+		int locations = ia.components == 16 ? 4 : 1;
+		int size = ia.components == 16 ? 4 : ia.components;
+		GLsizei stride = ia.components * sizeof(float);
+
+		glBindBuffer(GL_ARRAY_BUFFER, ia.vbo);
+		for (int l = 0; l < locations; ++l) {
+			GLuint loc = iter->first + l;
+			glEnableVertexAttribArray(loc);
+			glVertexAttribPointer(loc, size, GL_FLOAT, 0, stride,
+						(void *)(l * 4 * sizeof(float)));
+			glVertexAttribDivisor(loc, 1);
+		}
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+void
+VSModelLib::unbindInstanceAttribs(bool nodeMatrices) {
+
+	std::map<VSShaderLib::AttribType, InstanceAttrib>::iterator iter;
+	for (iter = mInstanceAttribs.begin(); iter != mInstanceAttribs.end(); ++iter) {
+		int locations = iter->second.components == 16 ? 4 : 1;
+		for (int l = 0; l < locations; ++l) {
+			glDisableVertexAttribArray(iter->first + l);
+			glVertexAttribDivisor(iter->first + l, 0);
+		}
+	}
+	if (nodeMatrices) {
+		for (int c = 0; c < 4; ++c) {
+			glDisableVertexAttribArray(VSShaderLib::INSTANCE_MATRIX_ATTRIB + c);
+			glVertexAttribDivisor(VSShaderLib::INSTANCE_MATRIX_ATTRIB + c, 0);
+		}
+	}
+}
+
+
+void
+VSModelLib::setAdjacency(bool use) {
+
+	pUseAdjacency = use;
+}
+
+
+unsigned int
+VSModelLib::edgeKey(const unsigned int *indices, unsigned int e, int key) {
+
+	unsigned int a = indices[e], b = indices[e - e % 3 + (e + 1) % 3];
+	switch (key) {
+		case 0: return a > b ? 1 : 0;
+		case 1: return std::max(a, b);
+		default: return std::min(a, b);
+	}
+}
+
+
+void
+VSModelLib::buildHalfEdges(const unsigned int *indices, unsigned int numFaces,
+						unsigned int numVertices, std::vector<unsigned int> &twins,
+						std::vector<unsigned int> *boundaryEdges) {
+
+	unsigned int numEdges = numFaces * 3;
+	twins.assign(numEdges, NO_TWIN);
+
+	// sort the half-edges by (lowest vertex, highest vertex, direction)
+	// with stable counting sorts, least significant key first. A
+	// half-edge and its twin then share a run, forward edges first
+	std::vector<unsigned int> order(numEdges), sorted(numEdges), count;
+	for (unsigned int e = 0; e < numEdges; ++e)
+		order[e] = e;
+	for (int key = 0; key < 3; ++key) {
+		unsigned int range = key == 0 ? 2 : numVertices;
+		count.assign(range + 1, 0);
+		for (unsigned int i = 0; i < numEdges; ++i)
+			count[edgeKey(indices, order[i], key) + 1]++;
+		for (unsigned int k = 0; k < range; ++k)
+			count[k + 1] += count[k];
+		for (unsigned int i = 0; i < numEdges; ++i)
+			sorted[count[edgeKey(indices, order[i], key)]++] = order[i];
+		order.swap(sorted);
+	}
+
+	// within a run, the n-th forward edge is paired with the
+	// n-th backward edge, so each edge is visited once
+	unsigned int i = 0;
+	while (i < numEdges) {
+		unsigned int lo = edgeKey(indices, order[i], 2), hi = edgeKey(indices, order[i], 1);
+		unsigned int end = i + 1;
+		while (end < numEdges && edgeKey(indices, order[end], 2) == lo &&
+				edgeKey(indices, order[end], 1) == hi)
+			end++;
+		unsigned int backward = i;
+		while (backward < end && edgeKey(indices, order[backward], 0) == 0)
+			backward++;
+		// degenerate edges have no direction, and are left unpaired
+		if (lo != hi) {
+			for (unsigned int f = i, r = backward; f < backward && r < end; ++f, ++r) {
+				twins[order[f]] = order[r];
+				twins[order[r]] = order[f];
+			}
+		}
+		i = end;
+	}
+
+	if (boundaryEdges) {
+		boundaryEdges->clear();
+		for (unsigned int e = 0; e < numEdges; ++e) {
+			if (twins[e] == NO_TWIN) {
+				boundaryEdges->push_back(indices[e]);
+				boundaryEdges->push_back(indices[e - e % 3 + (e + 1) % 3]);
+			}
+		}
+	}
+}
+
+
+void
+VSModelLib::buildAdjacency(const unsigned int *indices, unsigned int numFaces,
+						unsigned int numVertices, std::vector<unsigned int> &adjIndices,
+						std::vector<unsigned int> *boundaryEdges) {
+
+	std::vector<unsigned int> twins;
+	buildHalfEdges(indices, numFaces, numVertices, twins, boundaryEdges);
+
+	adjIndices.resize(numFaces * 6);
+	for (unsigned int e = 0; e < numFaces * 3; ++e) {
+
+		adjIndices[e * 2] = indices[e];
+		// the vertex opposite to the twin, the edge start on boundaries
+		unsigned int t = twins[e];
+		adjIndices[e * 2 + 1] = (t == NO_TWIN) ? indices[e] : indices[t - t % 3 + (t + 2) % 3];
+	}
+}
+
+
+void
+VSModelLib::setLODGeneration(int levels, float reduction) {
+
+	mLODLevels = std::max(0, std::min(levels, MAX_LODS - 1));
+	mLODReduction = reduction;
+}
+
+
+void
+VSModelLib::setLODSelection(float pixelError, float hysteresis) {
+
+	mLODPixelError = pixelError;
+	mLODHysteresis = hysteresis;
+}
+
+
+int
+VSModelLib::getLODCount(unsigned int mesh) {
+
+	if (mesh >= mMyMeshes.size())
+		return 0;
+	return std::max(1, mMyMeshes[mesh].numLODs);
+}
+
+
+int
+VSModelLib::getCurrentLOD(unsigned int mesh) {
+
+	if (mesh >= mMyMeshes.size())
+		return 0;
+	return mMyMeshes[mesh].currentLOD;
+}
+
+
+void
+VSModelLib::buildLODs(MyMesh &m, const float *pos, unsigned int stride, unsigned int numVertices,
+					const unsigned int *indices, unsigned int numIndices,
+					std::vector<unsigned int> &lodIndices) {
+
+	computeBounds(m, pos, stride, numVertices);
+
+	lodIndices.assign(indices, indices + numIndices);
+	m.lods[0].firstIndex = 0;
+	m.lods[0].numIndices = numIndices;
+	m.lods[0].error = 0.0f;
+	m.numLODs = 1;
+	m.currentLOD = 0;
+
+	if (mLODLevels == 0 || numIndices < 3 || numIndices % 3 != 0)
+		return;
+
+	// each level is simplified from the previous one,
+	// so errors add up
+	std::vector<unsigned int> prev(indices, indices + numIndices), next;
+	float error = 0.0f;
+	for (int l = 1; l <= mLODLevels; ++l) {
+
+		unsigned int target = (unsigned int)(prev.size() * mLODReduction) / 3 * 3;
+		float e = VSMeshOptLib::simplify(pos, numVertices, stride,
+						&prev[0], (unsigned int)prev.size(), target, FLT_MAX, next);
+
+		// stop when borders and seams prevent further simplification
+		if (next.size() == 0 || next.size() > prev.size() * (1.0f + mLODReduction) * 0.5f)
+			break;
+
+		error += e;
+		m.lods[l].firstIndex = (GLuint)lodIndices.size();
+		m.lods[l].numIndices = (GLuint)next.size();
+		m.lods[l].error = error;
+		m.numLODs++;
+		lodIndices.insert(lodIndices.end(), next.begin(), next.end());
+		prev.swap(next);
+	}
+}
+
+
+int
+VSModelLib::selectLOD(MyMesh &m, float viewportHeight) {
+
+	float *vm = mVSML->get(VSMathLib::VIEW_MODEL);
+	float *proj = mVSML->get(VSMathLib::PROJECTION);
+
+	// largest scale of the view model matrix
+	float scale = 0.0f;
+	for (int c = 0; c < 3; ++c)
+		scale = std::max(scale, vm[c * 4] * vm[c * 4] + vm[c * 4 + 1] * vm[c * 4 + 1] +
+								vm[c * 4 + 2] * vm[c * 4 + 2]);
+	scale = sqrtf(scale);
+	float radius = m.boundRadius * scale;
+
+	float pixelsPerUnit;
+	// perspective: use the distance to the nearest point of the sphere
+	if (proj[15] == 0.0f) {
+		float center[4] = { m.boundCenter[0], m.boundCenter[1], m.boundCenter[2], 1.0f };
+		float res[4];
+		mVSML->multMatrixPoint(VSMathLib::VIEW_MODEL, center, res);
+		float dist = -res[2] - radius;
+		if (dist <= 0.0f) {
+			m.currentLOD = 0;
+			return 0;
+		}
+		pixelsPerUnit = proj[5] * 0.5f * viewportHeight / dist;
+	}
+	else
+		pixelsPerUnit = proj[5] * 0.5f * viewportHeight;
+
+	float toPixels = scale * pixelsPerUnit;
+	int lod = std::min(m.currentLOD, m.numLODs - 1);
+	while (lod > 0 && m.lods[lod].error * toPixels > mLODPixelError)
+		lod--;
+	while (lod + 1 < m.numLODs &&
+			m.lods[lod + 1].error * toPixels <= mLODPixelError * (1.0f - mLODHysteresis))
+		lod++;
+
+	m.currentLOD = lod;
+	return lod;
+}
+
+
+void
+VSModelLib::setMeshletGeneration(unsigned int maxTriangles) {
+
+	mMeshletTriangles = maxTriangles;
+}
+
+
+void
+VSModelLib::setMeshletCulling(bool enabled) {
+
+	mMeshletCulling = enabled;
+}
+
+
+unsigned int
+VSModelLib::cullMeshlets(const MyMesh &m) {
+
+	float planes[24], cam[3];
+	mVSML->extractFrustumPlanes(planes);
+	mVSML->getModelSpaceCamera(cam);
+
+	mClusterCounts.clear();
+	mClusterOffsets.clear();
+	GLuint rangeEnd = 0;
+
+	for (unsigned int i = m.firstMeshlet; i < m.firstMeshlet + m.numMeshlets; ++i) {
+
+		const VSMeshOptLib::Meshlet &ml = mMeshlets[i];
+
+		bool visible = true;
+		for (int p = 0; p < 6 && visible; ++p) {
+			const float *pl = &planes[p * 4];
+			if (pl[0] * ml.center[0] + pl[1] * ml.center[1] + pl[2] * ml.center[2] + pl[3] < -ml.radius)
+				visible = false;
+		}
+		if (visible && ml.coneCutoff <= 1.0f) {
+			float d[3] = { ml.coneApex[0] - cam[0], ml.coneApex[1] - cam[1], ml.coneApex[2] - cam[2] };
+			float len = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+			if (d[0] * ml.coneAxis[0] + d[1] * ml.coneAxis[1] + d[2] * ml.coneAxis[2] >= ml.coneCutoff * len)
+				visible = false;
+		}
+		if (!visible) {
+			mRenderStats.clustersCulled++;
+			continue;
+		}
+		mRenderStats.clustersDrawn++;
+
+		// clusters are contiguous, merge neighbouring ranges
+		if (mClusterCounts.size() > 0 && rangeEnd == ml.firstIndex)
+			mClusterCounts.back() += ml.numIndices;
+		else {
+			mClusterCounts.push_back(ml.numIndices);
+			mClusterOffsets.push_back((const GLvoid *)(ml.firstIndex * sizeof(unsigned int)));
+		}
+		rangeEnd = ml.firstIndex + ml.numIndices;
+	}
+	return (unsigned int)mClusterCounts.size();
+}
+
+
+bool
+VSModelLib::setMergedMode(bool merged) {
+
+	if (!merged) {
+		deleteMergedGeometry();
+		mMergedMode = false;
+		// the sort may be stale since the merged draw data took over
+		mDrawOrderValid = false;
+		return true;
+	}
+	// the mesh buffers are copied on the GPU
+	completeUpload(true);
+	mMergedMode = buildMergedGeometry();
+	return mMergedMode;
+}
+
+
+bool
+VSModelLib::isMerged() {
+
+	return mMergedMode;
+}
+
+
+bool
+VSModelLib::buildMergedGeometry() {
+
+	deleteMergedGeometry();
+
+#ifdef __ANDROID_API__
+	VSLOG(sLogError, "Merged mode requires glMultiDrawElementsIndirect");
+	return false;
+#else
+	if (!GLEW_ARB_multi_draw_indirect || !GLEW_ARB_shader_storage_buffer_object ||
+			!GLEW_ARB_shader_draw_parameters) {
+		VSLOG(sLogError, "Merged mode requires GL_ARB_multi_draw_indirect, GL_ARB_shader_storage_buffer_object and GL_ARB_shader_draw_parameters");
+		return false;
+	}
+	if (mMyMeshes.size() == 0)
+		return false;
+
+	// all meshes must be drawn with the same command
+	GLenum type = mMyMeshes[0].type;
+	int tangComponents = 0;
+	for (unsigned int i = 0; i < mMyMeshes.size(); ++i) {
+		if (!mMyMeshes[i].hasIndices || mMyMeshes[i].type != type) {
+			VSLOG(sLogError, "Merged mode requires indexed meshes with the same primitive type");
+			return false;
+		}
+		// the merged tangent buffer has a single layout
+		if (mMyMeshes[i].vboTangent != 0) {
+			if (tangComponents != 0 && tangComponents != mMyMeshes[i].tangentComponents) {
+				VSLOG(sLogError, "Merged mode requires meshes with the same tangent components");
+				return false;
+			}
+			tangComponents = mMyMeshes[i].tangentComponents;
+		}
+	}
+
+	// meshes sharing a VAO (instanced nodes) share the vertex range
+	std::map<GLuint, unsigned int> firstUse;
+	std::vector<unsigned int> source;
+	GLuint totalVerts = 0, totalInd = 0;
+	bool hasNormal = false, hasTexCoord = false, hasTangent = false, hasBitangent = false;
+	bool missing = false;
+
+	mMerged.commands.resize(mMyMeshes.size());
+	for (unsigned int i = 0; i < mMyMeshes.size(); ++i) {
+
+		MyMesh &m = mMyMeshes[i];
+		DrawElementsIndirectCommand &cmd = mMerged.commands[i];
+		cmd.count = m.numIndices;
+		cmd.instanceCount = 1;
+		cmd.baseInstance = 0;
+
+		if (firstUse.count(m.vao)) {
+			const DrawElementsIndirectCommand &other = mMerged.commands[firstUse[m.vao]];
+			cmd.firstIndex = other.firstIndex;
+			cmd.baseVertex = other.baseVertex;
+			continue;
+		}
+		firstUse[m.vao] = i;
+		source.push_back(i);
+		cmd.firstIndex = totalInd;
+		cmd.baseVertex = totalVerts;
+		totalInd += m.numIndices;
+		totalVerts += m.numVertices;
+
+		hasNormal |= (m.vboNormal != 0);
+		hasTexCoord |= (m.vboTexCoord != 0);
+		hasTangent |= (m.vboTangent != 0);
+		hasBitangent |= (m.vboBitangent != 0);
+		missing |= !m.vboNormal || !m.vboTexCoord || !m.vboTangent || !m.vboBitangent;
+	}
+
+	// attributes absent from some meshes are filled with zeros
+	std::vector<float> zeros;
+	if (missing)
+		zeros.resize(totalVerts * 4, 0.0f);
+
+	glGenVertexArrays(1, &mMerged.vao);
+	glBindVertexArray(mMerged.vao);
+
+	GLuint *targets[5] = { &mMerged.vboPos, &mMerged.vboNormal, &mMerged.vboTexCoord,
+							&mMerged.vboTangent, &mMerged.vboBitangent };
+	bool present[5] = { true, hasNormal, hasTexCoord, hasTangent, hasBitangent };
+	int components[5] = { 4, 3, 2, tangComponents, 3 };
+	GLuint attribs[5] = { VSShaderLib::VERTEX_COORD_ATTRIB, VSShaderLib::NORMAL_ATTRIB,
+						VSShaderLib::TEXTURE_COORD_ATTRIB, VSShaderLib::TANGENT_ATTRIB,
+						VSShaderLib::BITANGENT_ATTRIB };
+
+	for (int a = 0; a < 5; ++a) {
+
+		if (!present[a])
+			continue;
+
+		GLsizeiptr stride = components[a] * sizeof(float);
+		glGenBuffers(1, targets[a]);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, *targets[a]);
+		glBufferData(GL_COPY_WRITE_BUFFER, totalVerts * stride,
+					missing ? &zeros[0] : NULL, GL_STATIC_DRAW);
+
+		// copy each mesh on the GPU, no read back is required
+		for (unsigned int k = 0; k < source.size(); ++k) {
+			MyMesh &m = mMyMeshes[source[k]];
+			GLuint vbos[5] = { m.vboPos, m.vboNormal, m.vboTexCoord, m.vboTangent, m.vboBitangent };
+			if (vbos[a] == 0)
+				continue;
+			glBindBuffer(GL_COPY_READ_BUFFER, vbos[a]);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+						mMerged.commands[source[k]].baseVertex * stride, m.numVertices * stride);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, *targets[a]);
+		glEnableVertexAttribArray(attribs[a]);
+		glVertexAttribPointer(attribs[a], components[a], GL_FLOAT, 0, 0, 0);
+	}
+
+	glGenBuffers(1, &mMerged.vboIndices);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mMerged.vboIndices);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, totalInd * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mMerged.vboIndices);
+	for (unsigned int k = 0; k < source.size(); ++k) {
+		MyMesh &m = mMyMeshes[source[k]];
+		glBindBuffer(GL_COPY_READ_BUFFER, m.vboIndices);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+					mMerged.commands[source[k]].firstIndex * sizeof(unsigned int),
+					m.numIndices * sizeof(unsigned int));
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	glGenBuffers(1, &mMerged.indirectBuffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mMerged.indirectBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * mMerged.commands.size(),
+				&mMerged.commands[0], GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	glGenBuffers(1, &mMerged.drawDataBuffer);
+	mMerged.drawCount = (GLuint)mMyMeshes.size();
+	mMerged.type = type;
+	updateMergedDrawData();
+
+	VSLOG(sLogInfo, "Merged %d meshes | Vertices: %d | Indices: %d",
+				mMerged.drawCount, totalVerts, totalInd);
+	return true;
+#endif
+}
+
+
+void
+VSModelLib::updateMergedDrawData() {
+
+#ifndef __ANDROID_API__
+	std::vector<MergedDrawData> data(mMyMeshes.size());
+	for (unsigned int i = 0; i < mMyMeshes.size(); ++i) {
+		memcpy(data[i].transform, mMyMeshes[i].transform, sizeof(float) * 16);
+		data[i].mat = mMyMeshes[i].mat;
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mMerged.drawDataBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(MergedDrawData) * data.size(),
+				&data[0], GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	// draw data is now in sync with the meshes
+	mDrawOrderValid = true;
+#endif
+}
+
+
+void
+VSModelLib::deleteMergedGeometry() {
+
+	if (mMerged.vao == 0)
+		return;
+
+	glDeleteVertexArrays(1, &mMerged.vao);
+	GLuint buffers[8] = { mMerged.vboPos, mMerged.vboNormal, mMerged.vboTexCoord,
+						mMerged.vboTangent, mMerged.vboBitangent, mMerged.vboIndices,
+						mMerged.indirectBuffer, mMerged.drawDataBuffer };
+	glDeleteBuffers(8, buffers);
+
+	mMerged.vao = 0; mMerged.vboPos = 0; mMerged.vboNormal = 0; mMerged.vboTexCoord = 0;
+	mMerged.vboTangent = 0; mMerged.vboBitangent = 0; mMerged.vboIndices = 0;
+	mMerged.indirectBuffer = 0; mMerged.drawDataBuffer = 0;
+	mMerged.drawCount = 0;
+	mMerged.commands.clear();
+}
+
+
+void
+VSModelLib::renderMerged(int instances) {
+
+#ifndef __ANDROID_API__
+	// meshes were added or removed since the merge
+	if (mMerged.drawCount != mMyMeshes.size()) {
+		if (!buildMergedGeometry()) {
+			mMergedMode = false;
+			render(instances);
+			return;
+		}
+	}
+	// transforms or materials changed
+	else if (!mDrawOrderValid)
+		updateMergedDrawData();
+
+	GLuint inst = instances == 0 ? 1 : (GLuint)instances;
+	if (mMerged.commands[0].instanceCount != inst) {
+		for (unsigned int i = 0; i < mMerged.commands.size(); ++i)
+			mMerged.commands[i].instanceCount = inst;
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mMerged.indirectBuffer);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0,
+				sizeof(DrawElementsIndirectCommand) * mMerged.commands.size(),
+				&mMerged.commands[0]);
+	}
+
+	memset(&mRenderStats, 0, sizeof(RenderStats));
+
+	mVSML->matricesToGL();
+	// shaders still reading the material block get the first material
+	setMaterial(mMyMeshes[0].mat);
+	mRenderStats.materialUpdates = 1;
+
+#if defined(__VSL_TEXTURE_LOADING__)
+	for (unsigned int j = 0; j < VSResourceLib::MAX_TEXTURES; ++j) {
+		if (mMyMeshes[0].texUnits[j] != 0) {
+			glActiveTexture(GL_TEXTURE0 + j);
+#if !defined(__ANDROID_API__)
+			VSTextureLib::touch(mMyMeshes[0].texUnits[j]);
+			if (!VSUploadLib::isTextureReady(mMyMeshes[0].texUnits[j]))
+				continue;
+#endif
+			glBindTexture(mMyMeshes[0].texTypes[j], mMyMeshes[0].texUnits[j]);
+			mRenderStats.textureBinds++;
+		}
+	}
+#endif
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, mMerged.drawDataBuffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mMerged.indirectBuffer);
+	glBindVertexArray(mMerged.vao);
+	bindInstanceAttribs();
+	glMultiDrawElementsIndirect(mMerged.type, GL_UNSIGNED_INT, 0, mMerged.drawCount, 0);
+	unbindInstanceAttribs(false);
+	glBindVertexArray(0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	mRenderStats.vaoBinds = 1;
+	mRenderStats.draws = 1;
+
+#if defined(__VSL_TEXTURE_LOADING__)
+	for (unsigned int j = 0; j < VSResourceLib::MAX_TEXTURES; ++j) {
+		if (mMyMeshes[0].texUnits[j] != 0) {
+			glActiveTexture(GL_TEXTURE0 + j);
+			glBindTexture(mMyMeshes[0].texTypes[j], 0);
+		}
+	}
+#endif
+#endif
 }
 
+
 #if defined(__VSL_TEXTURE_LOADING__)
 
 // Load model textures
@@ -305,11 +2044,14 @@ VSModelLib::loadTextures(const aiScene* scene,
 		std::string filename = (*itr).first;
 		filename = prefix + filename;
 		// save texture id for filename in map
-#ifdef __ANDROID_API__
-		(*itr).second = (GLuint)LoadTexture(filename);
-#else
-		(*itr).second = loadRGBATexture(filename, true,true);
+		// textures already loaded by other resources are shared
+#if !defined(__ANDROID_API__)
+		if (mTextureStreaming)
+			(*itr).second = VSTextureLib::acquireTextureAsync(filename, true, mTextureCompression);
+		else
 #endif
+			(*itr).second = VSTextureLib::acquireTexture(filename, true, mTextureCompression);
+		holdTexture((*itr).second);
 		VSLOG(sLogInfo, "Texture %s loaded with name %d",
 			filename.c_str(), (int)(*itr).second);
 	}
@@ -322,213 +2064,393 @@ VSModelLib::loadTextures(const aiScene* scene,
 
 #if defined(__VSL_MODEL_LOADING__)
 
-void
-VSModelLib::genVAOsAndUniformBuffer(const struct aiScene *sc) {
-
-	MyMesh aMesh;
-	struct Material aMat;
-	int totalTris = 0, totalVerts = 0;
-	unsigned int *adjFaceArray;
+int
+VSModelLib::getLoadMode() {
+
+	int mode = mFlagMode;
+	if (!mProgramAttributeFilter)
+		return mode;
+
+	GLint program = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+	if (program == 0)
+		return mode;
+
+	unsigned int used = VSShaderLib::getActiveAttribLocations(program);
+	if (!(used & (1 << VSShaderLib::NORMAL_ATTRIB)))
+		mode &= ~NORMAL;
+	if (!(used & (1 << VSShaderLib::TANGENT_ATTRIB)))
+		mode &= ~(TANGENT | PACKED_TANGENT);
+	if (!(used & (1 << VSShaderLib::BITANGENT_ATTRIB)))
+		mode &= ~BITANGENT;
+	if (!(used & (1 << VSShaderLib::TEXTURE_COORD_ATTRIB)))
+		mode &= ~TEXCOORD;
+	return mode;
+}
 
-	VSLOG(sLogInfo, "Number of Meshes: %d",sc->mNumMeshes);
-	// For each mesh
-	for (unsigned int n = 0; n < sc->mNumMeshes; ++n)
-	{
-		const struct aiMesh* mesh = sc->mMeshes[n];
 
-		if (mesh->mPrimitiveTypes != 4) {
-			aMesh.numIndices = 0;
-			mMyMeshesAux.push_back(aMesh);
-			continue;
-		}
+unsigned int
+VSModelLib::getImportFlags(int mode, int &removed) {
+
+	unsigned int flags;
+	if (mImportProfile == IMPORT_FAST)
+		flags = aiProcessPreset_TargetRealtime_Fast;
+	else
+		flags = aiProcessPreset_TargetRealtime_Quality;
+
+	// attributes that are not wanted are neither generated nor kept,
+	// the latter also lets more vertices be joined. Tangents are
+	// computed by the lib from the normals and texture coordinates
+	flags &= ~aiProcess_CalcTangentSpace;
+	removed = aiComponent_TANGENTS_AND_BITANGENTS;
+	bool tangents = (mode & (TANGENT | BITANGENT | PACKED_TANGENT)) != 0;
+	if (!(mode & NORMAL) && !tangents) {
+		flags &= ~(aiProcess_GenNormals | aiProcess_GenSmoothNormals);
+		removed |= aiComponent_NORMALS;
+	}
+	if (!(mode & TEXCOORD) && !tangents) {
+		flags &= ~aiProcess_GenUVCoords;
+		removed |= aiComponent_TEXCOORDS;
+	}
+	if (removed)
+		flags |= aiProcess_RemoveComponent;
+	return flags;
+}
 
-		VSLOG(sLogInfo, "Mesh[%d] Triangles %d",n,
-							mesh->mNumFaces);
-		totalTris += mesh->mNumFaces;
-		// create array with faces
-		// have to convert from Assimp format to array
-		unsigned int *faceArray;
-		faceArray = (unsigned int *)malloc(
-				sizeof(unsigned int) * mesh->mNumFaces * 3);
 
-		aMesh.hasIndices = true;
+void
+VSModelLib::uploadBuffer(GLuint buffer, size_t size, const void *data) {
 
-		unsigned int faceIndex = 0;
+	if (mPendingBuffers) {
+		mPendingBuffers->push_back(std::make_pair(buffer, std::vector<unsigned char>()));
+		mPendingBuffers->back().second.assign((const unsigned char *)data,
+									(const unsigned char *)data + size);
+		return;
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, size, data, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
 
-		for (unsigned int t = 0; t < mesh->mNumFaces; ++t) {
-			const struct aiFace* face = &mesh->mFaces[t];
 
-			memcpy(&faceArray[faceIndex], face->mIndices,
-								3 * sizeof(unsigned int));
-			faceIndex += 3;
-		}
+void
+VSModelLib::gatherVertices(const float *data, unsigned int components,
+							const std::vector<unsigned int> &unique, float *res) {
 
-		if (pUseAdjacency) {
-			// Create the half edge structure
-			std::map<std::pair<unsigned int,unsigned int>, struct HalfEdge *> myEdges;
-			struct HalfEdge *edge;
+	// assimp stores all attributes as 3D vectors
+	for (size_t v = 0; v < unique.size(); ++v)
+		memcpy(&res[v * components], data + (size_t)unique[v] * 3, components * sizeof(float));
+}
 
-			// fill it up with edges. twin info will be added latter
-			edge = (struct HalfEdge *)malloc(sizeof(struct HalfEdge) * mesh->mNumFaces * 3);
-			for (unsigned int i = 0; i < mesh->mNumFaces; ++i) {
 
-				edge[i*3].vertex = faceArray[i*3+1];
-				edge[i*3+1].vertex = faceArray[i*3+2];
-				edge[i*3+2].vertex = faceArray[i*3];
+bool
+VSModelLib::sameMeshContents(const aiMesh *a, const std::vector<unsigned int> &uniqueA,
+							const std::vector<unsigned int> &facesA,
+							const aiMesh *b, const std::vector<unsigned int> &uniqueB,
+							const std::vector<unsigned int> &facesB) {
+
+	if (uniqueA.size() != uniqueB.size() || facesA != facesB ||
+			a->HasNormals() != b->HasNormals() ||
+			a->HasTangentsAndBitangents() != b->HasTangentsAndBitangents() ||
+			a->HasTextureCoords(0) != b->HasTextureCoords(0))
+		return false;
 
-				edge[i*3].next = &edge[i*3+1];
-				edge[i*3+1].next = &edge[i*3+2];
-				edge[i*3+2].next = &edge[i*3];
+	for (size_t v = 0; v < uniqueA.size(); ++v) {
+		unsigned int i = uniqueA[v], j = uniqueB[v];
+		if (memcmp(&a->mVertices[i], &b->mVertices[j], sizeof(aiVector3D)))
+			return false;
+		if (a->HasNormals() && memcmp(&a->mNormals[i], &b->mNormals[j], sizeof(aiVector3D)))
+			return false;
+		if (a->HasTangentsAndBitangents() &&
+				(memcmp(&a->mTangents[i], &b->mTangents[j], sizeof(aiVector3D)) ||
+				memcmp(&a->mBitangents[i], &b->mBitangents[j], sizeof(aiVector3D))))
+			return false;
+		if (a->HasTextureCoords(0) &&
+				memcmp(&a->mTextureCoords[0][i], &b->mTextureCoords[0][j], 2 * sizeof(float)))
+			return false;
+	}
+	return true;
+}
 
-				edge[i*3].twin   = NULL;
-				edge[i*3+1].twin = NULL;
-				edge[i*3+2].twin = NULL;
 
-				myEdges[std::pair<unsigned int,unsigned int>(faceArray[i*3+2],faceArray[i*3])] = &edge[i*3];
-				myEdges[std::pair<unsigned int,unsigned int>(faceArray[i*3],faceArray[i*3+1])] = &edge[i*3+1];
-				myEdges[std::pair<unsigned int,unsigned int>(faceArray[i*3+1],faceArray[i*3+2])] = &edge[i*3+2];
-			}
+void
+VSModelLib::genVAOsAndUniformBuffer(const struct aiScene *sc, int mode) {
 
-			// add twin info
-			std::map<std::pair<unsigned int,unsigned int>, struct HalfEdge *>::iterator iter;
-			std::pair<unsigned int,unsigned int> edgeIndex, twinIndex;
+	mDrawOrderValid = false;
 
-			iter = myEdges.begin();
+	MyMesh aMesh;
+	struct Material aMat;
+	int totalTris = 0, totalVerts = 0;
 
-			for (; iter != myEdges.end(); ++iter) {
+	// per mesh data prepared in parallel, before the uploads
+	struct MeshData {
+		// original index of each welded vertex
+		std::vector<unsigned int> unique;
+		// welded positions, three floats per vertex
+		std::vector<float> positions;
+		// faces, with adjacency or levels of detail when enabled
+		std::vector<unsigned int> faces;
+		std::vector<VSMeshOptLib::Meshlet> meshlets;
+		// welded tangent space, empty when not wanted
+		std::vector<float> tangents, bitangents;
+		// bounds and levels of detail
+		MyMesh info;
+		unsigned long long hash;
+		// a previous mesh with the same contents, or -1
+		int duplicateOf;
+	};
+	std::vector<MeshData> data(sc->mNumMeshes);
+
+	VSThreadLib::parallelFor(sc->mNumMeshes, [&](unsigned int n) {
 
-				edgeIndex = iter->first;
-				twinIndex = std::pair<unsigned int, unsigned int>(edgeIndex.second, edgeIndex.first);
+		const struct aiMesh* mesh = sc->mMeshes[n];
+		MeshData &md = data[n];
+		md.duplicateOf = -1;
+		if (mesh->mPrimitiveTypes != 4)
+			return;
+		// each thread has its own arena
+		VSMemoryLib::ScratchScope scope;
+
+		// weld vertices equal in all the attributes that will be uploaded
+		std::vector<VSMeshOptLib::VertexStream> streams;
+		VSMeshOptLib::VertexStream vs;
+		vs.components = 3; vs.stride = 3;
+		vs.data = reinterpret_cast<const float *>(mesh->mVertices);
+		streams.push_back(vs);
+		bool tangents = (mode & (TANGENT | BITANGENT | PACKED_TANGENT)) &&
+						mesh->HasNormals() && mesh->HasTextureCoords(0);
+		if (mesh->HasNormals() && ((mode & NORMAL) || tangents)) {
+			vs.data = reinterpret_cast<const float *>(mesh->mNormals);
+			streams.push_back(vs);
+		}
+		if (mesh->HasTextureCoords(0) && ((mode & TEXCOORD) || tangents)) {
+			vs.components = 2;
+			vs.data = reinterpret_cast<const float *>(mesh->mTextureCoords[0]);
+			streams.push_back(vs);
+		}
 
-				if (myEdges.count(twinIndex))
-					iter->second->twin = myEdges[twinIndex];
-				else
-					iter->second->twin = NULL;
+		std::vector<unsigned int> remap;
+		if (mWeldEpsilon >= 0.0f)
+			VSMeshOptLib::weldVertices(streams, mesh->mNumVertices, mWeldEpsilon, remap, md.unique);
+		else {
+			remap.resize(mesh->mNumVertices);
+			md.unique.resize(mesh->mNumVertices);
+			for (unsigned int v = 0; v < mesh->mNumVertices; ++v)
+				remap[v] = md.unique[v] = v;
+		}
+		unsigned int numVertices = (unsigned int)md.unique.size();
+
+		md.positions.resize(numVertices * 3);
+		for (unsigned int v = 0; v < numVertices; ++v)
+			memcpy(&md.positions[v * 3], &mesh->mVertices[md.unique[v]].x, 3 * sizeof(float));
+
+		unsigned int numFaceIndices = mesh->mNumFaces * 3;
+		unsigned int *faces = VSMemoryLib::scratchArray<unsigned int>(numFaceIndices);
+		for (unsigned int t = 0; t < mesh->mNumFaces; ++t)
+			for (int k = 0; k < 3; ++k)
+				faces[t * 3 + k] = remap[mesh->mFaces[t].mIndices[k]];
+
+		// meshes are already processed in parallel
+		if (tangents) {
+			float *normals = VSMemoryLib::scratchArray<float>(numVertices * 3);
+			float *texCoords = VSMemoryLib::scratchArray<float>(numVertices * 2);
+			gatherVertices(reinterpret_cast<const float *>(mesh->mNormals), 3, md.unique, normals);
+			gatherVertices(reinterpret_cast<const float *>(mesh->mTextureCoords[0]), 2, md.unique, texCoords);
+			bool packed = (mode & PACKED_TANGENT) != 0;
+			md.tangents.resize(numVertices * 4);
+			if ((mode & BITANGENT) && !packed)
+				md.bitangents.resize(numVertices * 3);
+			VSMeshOptLib::computeTangents(&md.positions[0], 3, normals, 3, texCoords, 2,
+						numVertices, faces, numFaceIndices, &md.tangents[0],
+						md.bitangents.empty() ? NULL : &md.bitangents[0], 1);
+			if (!packed && !(mode & TANGENT))
+				std::vector<float>().swap(md.tangents);
+			else if (!packed) {
+				for (unsigned int v = 1; v < numVertices; ++v)
+					memmove(&md.tangents[v * 3], &md.tangents[v * 4], 3 * sizeof(float));
+				md.tangents.resize(numVertices * 3);
 			}
+		}
 
-			adjFaceArray = (unsigned int *)malloc(sizeof(unsigned int) * mesh->mNumFaces * 6);
-			for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
-
-				// NOTE: twin may be null
-				adjFaceArray[i*6]   = edge[3*i + 0].next->vertex;
-				adjFaceArray[i*6+1] = edge[3*i + 0].twin?edge[3*i + 0].twin->vertex:edge[3*i + 0].next->vertex;
+		if (pUseAdjacency) {
+			buildAdjacency(faces, mesh->mNumFaces, numVertices, md.faces);
+			computeBounds(md.info, &md.positions[0], 3, numVertices);
+		}
+		else {
+				buildLODs(md.info, &md.positions[0], 3, numVertices,
+							faces, numFaceIndices, md.faces);
+				if (mMeshletTriangles > 0)
+					VSMeshOptLib::buildMeshlets(&md.positions[0], numVertices, 3,
+							&md.faces[0], md.info.lods[0].numIndices,
+							mMeshletTriangles, md.meshlets);
+		}
 
-				adjFaceArray[i*6+2] = edge[3*i + 1].next->vertex;
-				adjFaceArray[i*6+3] = edge[3*i + 1].twin?edge[3*i + 1].twin->vertex:edge[3*i + 1].next->vertex;
+		// the contents of the buffers, to find repeated meshes
+		md.hash = VSMeshOptLib::hash(&md.faces[0], md.faces.size() * sizeof(unsigned int));
+		for (size_t s = 0; s < streams.size(); ++s) {
+			md.hash = VSMeshOptLib::hash(&streams[s].components, sizeof(unsigned int), md.hash);
+			for (unsigned int v = 0; v < numVertices; ++v)
+				md.hash = VSMeshOptLib::hash(streams[s].data + (size_t)md.unique[v] * streams[s].stride,
+							streams[s].components * sizeof(float), md.hash);
+		}
+	});
+
+	// meshes with the same contents share their buffers
+	unsigned int duplicates = 0;
+	size_t weldedBytes = 0, sharedBytes = 0;
+	if (mShareDuplicates) {
+		std::multimap<unsigned long long, unsigned int> byHash;
+		for (unsigned int n = 0; n < sc->mNumMeshes; ++n) {
+
+			if (sc->mMeshes[n]->mPrimitiveTypes != 4)
+				continue;
+			auto range = byHash.equal_range(data[n].hash);
+			for (auto it = range.first; it != range.second && data[n].duplicateOf < 0; ++it) {
+				if (sameMeshContents(sc->mMeshes[it->second], data[it->second].unique, data[it->second].faces,
+									sc->mMeshes[n], data[n].unique, data[n].faces))
+					data[n].duplicateOf = (int)it->second;
+			}
+			if (data[n].duplicateOf < 0)
+				byHash.insert(std::make_pair(data[n].hash, n));
+			else
+				duplicates++;
+		}
+	}
 
-				adjFaceArray[i*6+4] = edge[3*i + 2].next->vertex;
-				adjFaceArray[i*6+5] = edge[3*i + 2].twin?edge[3*i + 2].twin->vertex:edge[3*i + 2].next->vertex;
+	VSLOG(sLogInfo, "Number of Meshes: %d",sc->mNumMeshes);
+	// For each mesh
+	for (unsigned int n = 0; n < sc->mNumMeshes; ++n)
+	{
+		const struct aiMesh* mesh = sc->mMeshes[n];
+		MeshData &md = data[n];
+		// do not carry buffers from the previous mesh
+		aMesh = MyMesh();
+		// the arrays to upload are released with each mesh
+		VSMemoryLib::ScratchScope scope;
 
-			}
+		if (mesh->mPrimitiveTypes != 4) {
+			aMesh.numIndices = 0;
+			mMyMeshesAux.push_back(aMesh);
+			continue;
 		}
+
+		VSLOG(sLogInfo, "Mesh[%d] Triangles %d",n,
+							mesh->mNumFaces);
+		totalTris += mesh->mNumFaces;
+		aMesh.hasIndices = true;
+		unsigned int numVertices = (unsigned int)md.unique.size();
+		aMesh.numVertices = numVertices;
 		if (pUseAdjacency) {
 			aMesh.numIndices = mesh->mNumFaces * 6;
 		}
 		else
 			aMesh.numIndices = mesh->mNumFaces * 3;
 
-		// generate Vertex Array for mesh
-		glGenVertexArrays(1,&(aMesh.vao));
-		glBindVertexArray(aMesh.vao);
+		// bytes per vertex in the buffers
+		size_t vertexSize = 4 * sizeof(float);
+		if (mesh->HasNormals() && (mode & NORMAL))
+			vertexSize += 3 * sizeof(float);
+		vertexSize += (md.tangents.size() + md.bitangents.size()) / std::max(numVertices, 1u) * sizeof(float);
+		if (mesh->HasTextureCoords(0) && (mode & TEXCOORD))
+			vertexSize += 2 * sizeof(float);
+		weldedBytes += (mesh->mNumVertices - numVertices) * vertexSize;
+
+		if (md.duplicateOf >= 0) {
+
+			// same geometry, the material can still differ
+			const MyMesh &src = mMyMeshesAux[md.duplicateOf];
+			aMesh.vao = src.vao;
+			aMesh.vboPos = src.vboPos;
+			aMesh.vboNormal = src.vboNormal;
+			aMesh.vboTexCoord = src.vboTexCoord;
+			aMesh.vboTangent = src.vboTangent;
+			aMesh.tangentComponents = src.tangentComponents;
+			aMesh.vboBitangent = src.vboBitangent;
+			aMesh.vboIndices = src.vboIndices;
+			aMesh.geometry = src.geometry;
+			memcpy(aMesh.lods, src.lods, sizeof(aMesh.lods));
+			aMesh.numLODs = src.numLODs;
+			memcpy(aMesh.boundCenter, src.boundCenter, sizeof(aMesh.boundCenter));
+			aMesh.boundRadius = src.boundRadius;
+			memcpy(aMesh.bbMin, src.bbMin, sizeof(aMesh.bbMin));
+			memcpy(aMesh.bbMax, src.bbMax, sizeof(aMesh.bbMax));
+			aMesh.firstMeshlet = src.firstMeshlet;
+			aMesh.numMeshlets = src.numMeshlets;
+			sharedBytes += numVertices * vertexSize + md.faces.size() * sizeof(unsigned int);
+		}
+		else {
+
+			memcpy(aMesh.lods, md.info.lods, sizeof(aMesh.lods));
+			aMesh.numLODs = md.info.numLODs;
+			aMesh.currentLOD = 0;
+			memcpy(aMesh.boundCenter, md.info.boundCenter, sizeof(aMesh.boundCenter));
+			aMesh.boundRadius = md.info.boundRadius;
+			memcpy(aMesh.bbMin, md.info.bbMin, sizeof(aMesh.bbMin));
+			memcpy(aMesh.bbMax, md.info.bbMax, sizeof(aMesh.bbMax));
+			aMesh.firstMeshlet = (unsigned int)mMeshlets.size();
+			aMesh.numMeshlets = (unsigned int)md.meshlets.size();
+			mMeshlets.insert(mMeshlets.end(), md.meshlets.begin(), md.meshlets.end());
+
+			// buffer for faces
+			glGenBuffers(1, &aMesh.vboIndices);
+			uploadBuffer(aMesh.vboIndices, sizeof(unsigned int) * md.faces.size(), &md.faces[0]);
+
+			// buffer for vertex positions
+			if (mesh->HasPositions()) {
+
+				glGenBuffers(1, &aMesh.vboPos);
+				float *pp = VSMemoryLib::scratchArray<float>(4 * numVertices);
+				for (unsigned int k = 0; k < numVertices; ++k) {
+					pp[k * 4] = md.positions[k * 3];
+					pp[k * 4 + 1] = md.positions[k * 3 + 1];
+					pp[k * 4 + 2] = md.positions[k * 3 + 2];
+					pp[k * 4 + 3] = 1.0f;;
+				}
+				uploadBuffer(aMesh.vboPos, sizeof(float) * 4 * numVertices, pp);
+				totalVerts += numVertices;
+			}
 
-		// buffer for faces
-		glGenBuffers(1, &aMesh.vboIndices);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, aMesh.vboIndices);
+			// buffer for vertex normals
+			if (mesh->HasNormals() && (mode & NORMAL)) {
 
-		if (pUseAdjacency) {
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-						sizeof(unsigned int) * aMesh.numIndices,
-						adjFaceArray, GL_STATIC_DRAW);
-			free(adjFaceArray);
-		}
-		else
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-						sizeof(unsigned int) * aMesh.numIndices,
-						faceArray, GL_STATIC_DRAW);
-
-		// buffer for vertex positions
-		if (mesh->HasPositions()) {
-
-			glGenBuffers(1, &aMesh.vboPos);
-			glBindBuffer(GL_ARRAY_BUFFER, aMesh.vboPos);
-			std::vector<float> pp; pp.resize(4 * mesh->mNumVertices);
-			for (unsigned int k = 0; k < mesh->mNumVertices; ++k) {
-				pp[k * 4] = mesh->mVertices[k].x;
-				pp[k * 4 + 1] = mesh->mVertices[k].y;
-				pp[k * 4 + 2] = mesh->mVertices[k].z;
-				pp[k * 4 + 3] = 1.0f;;
+				float *normals = VSMemoryLib::scratchArray<float>(3 * numVertices);
+				gatherVertices(reinterpret_cast<const float *>(mesh->mNormals), 3, md.unique, normals);
+				glGenBuffers(1, &aMesh.vboNormal);
+				uploadBuffer(aMesh.vboNormal, sizeof(float) * 3 * numVertices, normals);
+			}
+
+			// buffer for vertex tangents
+			if (!md.tangents.empty()) {
+				glGenBuffers(1, &aMesh.vboTangent);
+				uploadBuffer(aMesh.vboTangent, sizeof(float) * md.tangents.size(), &md.tangents[0]);
+				aMesh.tangentComponents = getTangentComponents();
 			}
-			glBufferData(GL_ARRAY_BUFFER, sizeof(float)*pp.size(), 	&pp[0], GL_STATIC_DRAW);
-			glEnableVertexAttribArray(
-					VSShaderLib::VERTEX_COORD_ATTRIB);
-			glVertexAttribPointer(VSShaderLib::VERTEX_COORD_ATTRIB,
-					4, GL_FLOAT, 0, 0, 0);
-			totalVerts += mesh->mNumVertices;
-		}
-
-		// buffer for vertex normals
-		if (mesh->HasNormals()) {
-
-			glGenBuffers(1, &aMesh.vboNormal);
-			glBindBuffer(GL_ARRAY_BUFFER, aMesh.vboNormal);
-			glBufferData(GL_ARRAY_BUFFER,
-				sizeof(float)*3*mesh->mNumVertices, mesh->mNormals, GL_STATIC_DRAW);
-			glEnableVertexAttribArray(VSShaderLib::NORMAL_ATTRIB);
-			glVertexAttribPointer(VSShaderLib::NORMAL_ATTRIB,
-				3, GL_FLOAT, 0, 0, 0);
-		}
-
-		// buffer for vertex tangents
-		if (mesh->HasTangentsAndBitangents()) {
-			glGenBuffers(1, &aMesh.vboTangent);
-			glBindBuffer(GL_ARRAY_BUFFER, aMesh.vboTangent);
-			glBufferData(GL_ARRAY_BUFFER,
-				sizeof(float)*3*mesh->mNumVertices, mesh->mTangents,
-				GL_STATIC_DRAW);
-			glEnableVertexAttribArray(VSShaderLib::TANGENT_ATTRIB);
-			glVertexAttribPointer(VSShaderLib::TANGENT_ATTRIB,
-				3, GL_FLOAT, 0, 0, 0);
-		}
-
-		// buffer for vertex bitangents
-		if (mesh->HasTangentsAndBitangents()) {
-			glGenBuffers(1, &aMesh.vboBitangent);
-			glBindBuffer(GL_ARRAY_BUFFER, aMesh.vboBitangent);
-			glBufferData(GL_ARRAY_BUFFER,
-				sizeof(float)*3*mesh->mNumVertices, mesh->mBitangents,
-				GL_STATIC_DRAW);
-			glEnableVertexAttribArray(VSShaderLib::BITANGENT_ATTRIB);
-			glVertexAttribPointer(VSShaderLib::BITANGENT_ATTRIB,
-				3, GL_FLOAT, 0, 0, 0);
-		}
-
-		// buffer for vertex texture coordinates
-		if (mesh->HasTextureCoords(0)) {
-			float *texCoords = (float *)malloc(
-						sizeof(float)*2*mesh->mNumVertices);
-			for (unsigned int k = 0; k < mesh->mNumVertices; ++k) {
-
-				texCoords[k*2]   = mesh->mTextureCoords[0][k].x;
-				texCoords[k*2+1] = mesh->mTextureCoords[0][k].y;
 
+			// buffer for vertex bitangents
+			if (!md.bitangents.empty()) {
+				glGenBuffers(1, &aMesh.vboBitangent);
+				uploadBuffer(aMesh.vboBitangent, sizeof(float) * md.bitangents.size(), &md.bitangents[0]);
 			}
-			glGenBuffers(1, &aMesh.vboTexCoord);
-			glBindBuffer(GL_ARRAY_BUFFER, aMesh.vboTexCoord);
-			glBufferData(GL_ARRAY_BUFFER,
-				sizeof(float)*2*mesh->mNumVertices, texCoords,
-				GL_STATIC_DRAW);
-			glEnableVertexAttribArray(
-				VSShaderLib::TEXTURE_COORD_ATTRIB);
-			glVertexAttribPointer(
-				VSShaderLib::TEXTURE_COORD_ATTRIB, 2,
-				GL_FLOAT, 0, 0, 0);
-			free(texCoords);
-		}
-
-		// unbind buffers
-		glBindVertexArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER,0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
+
+			// buffer for vertex texture coordinates
+			if (mesh->HasTextureCoords(0) && (mode & TEXCOORD)) {
+				float *texCoords = VSMemoryLib::scratchArray<float>(2 * numVertices);
+				gatherVertices(reinterpret_cast<const float *>(mesh->mTextureCoords[0]), 2, md.unique, texCoords);
+				glGenBuffers(1, &aMesh.vboTexCoord);
+				uploadBuffer(aMesh.vboTexCoord, sizeof(float) * 2 * numVertices, texCoords);
+			}
+
+			// vertex arrays are not shared, so with the uploader
+			// they are built once the buffers are complete
+			ownGeometry(aMesh);
+			if (!mPendingBuffers)
+				buildMeshVAO(aMesh);
+		}
+		// release the memory as soon as it is in the buffers
+		std::vector<unsigned int>().swap(md.faces);
+		std::vector<float>().swap(md.positions);
+		std::vector<float>().swap(md.tangents);
+		std::vector<float>().swap(md.bitangents);
 
 		// create material uniform buffer
 		struct aiMaterial *mtl =
@@ -602,6 +2524,8 @@ VSModelLib::genVAOsAndUniformBuffer(const struct aiScene *sc) {
 
 	VSLOG(sLogInfo, "Total Meshes: %d  | Vertices: %d | Faces: %d",
 					sc->mNumMeshes, totalVerts, totalTris);
+	VSLOG(sLogInfo, "Welding saved %d KB | %d meshes share buffers, saving %d KB",
+					(int)(weldedBytes / 1024), duplicates, (int)(sharedBytes / 1024));
 }
 
 
@@ -688,9 +2612,7 @@ VSModelLib::recursive_walk_for_matrices(
 
 			if(sc->mMeshes[nd->mMeshes[n]]->mPrimitiveTypes == 4) {
 
-				MyMesh aMesh;
-				memcpy(&aMesh, &(mMyMeshesAux[nd->mMeshes[n]]),
-											sizeof (aMesh));
+				MyMesh aMesh = mMyMeshesAux[nd->mMeshes[n]];
 				memcpy(aMesh.transform,mVSML->get(VSMathLib::AUX0),
 											sizeof(float)*16);
 #ifndef __ANDROID_API__
@@ -724,6 +2646,8 @@ VSModelLib::setColor(VSResourceLib::MaterialSemantics m, float r, float g, float
 void
 VSModelLib::setColor(VSResourceLib::MaterialSemantics m, float *values) {
 
+	mDrawOrderValid = false;
+
 	if (m == TEX_COUNT)
 		return;
 
@@ -745,6 +2669,8 @@ VSModelLib::setColor(VSResourceLib::MaterialSemantics m, float *values) {
 			case EMISSIVE:
 				memcpy(mMyMeshes[i].mat.emissive, values, sizeof(float)*4);
 				break;
+			default:
+				break;
 		}
 	}
 }
@@ -753,6 +2679,8 @@ VSModelLib::setColor(VSResourceLib::MaterialSemantics m, float *values) {
 void
 VSModelLib::setColor(unsigned int mesh, VSResourceLib::MaterialSemantics m, float *values) {
 
+	mDrawOrderValid = false;
+
 	if (mesh >= mMyMeshes.size())
 		return;
 
@@ -776,6 +2704,8 @@ VSModelLib::setColor(unsigned int mesh, VSResourceLib::MaterialSemantics m, floa
 		case EMISSIVE:
 			memcpy(mMyMeshes[mesh].mat.emissive, values, sizeof(float)*4);
 			break;
+		default:
+			break;
 	}
 }
 
@@ -783,6 +2713,8 @@ VSModelLib::setColor(unsigned int mesh, VSResourceLib::MaterialSemantics m, floa
 void
 VSModelLib::setMaterialColor(MaterialColors m) {
 
+	mDrawOrderValid = false;
+
 	for (unsigned int i = 0; i < mMyMeshes.size(); ++i) {
 
 		memcpy(mMyMeshes[i].mat.ambient, &(VSResourceLib::Colors[m][0]), 3*sizeof(float));
@@ -797,23 +2729,32 @@ VSModelLib::setMaterialColor(MaterialColors m) {
 void
 VSModelLib::setTexture(unsigned int unit, unsigned int textureID, GLenum textureType) {
 
-	for (unsigned int i = 0; i < mMyMeshes.size(); ++i) {
-		mMyMeshes[i].texUnits[unit] = textureID;
-		mMyMeshes[i].texTypes[unit] = textureType;
-		mMyMeshes[i].mat.texCount = 1;
+	mDrawOrderValid = false;
+
+	// share the texture if it comes from the registry
+	if (VSTextureLib::isRegistered(textureID)) {
+		VSTextureLib::retain(textureID);
+		holdTexture(textureID);
 	}
+
+	replaceUnitTexture(unit, textureID, textureType);
 }
 
 
 void
 VSModelLib::addTexture(unsigned int unit, std::string filename) {
 
-	int textID = loadRGBATexture(filename, true);
-	for (unsigned int i = 0; i < mMyMeshes.size(); ++i) {
-		mMyMeshes[i].texUnits[unit] = (GLuint)textID;
-		mMyMeshes[i].texTypes[unit] = GL_TEXTURE_2D;
-		mMyMeshes[i].mat.texCount = 1;
-	}
+	mDrawOrderValid = false;
+
+	int textID;
+#if !defined(__ANDROID_API__)
+	if (mTextureStreaming)
+		textID = VSTextureLib::acquireTextureAsync(filename, true);
+	else
+#endif
+		textID = VSTextureLib::acquireTexture(filename, true);
+	holdTexture(textID);
+	replaceUnitTexture(unit, (GLuint)textID, GL_TEXTURE_2D);
 }
 
 
@@ -822,12 +2763,47 @@ VSModelLib::addCubeMapTexture(unsigned int unit, std::string posX, std::string n
 									std::string posY, std::string negY,
 									std::string posZ, std::string negZ) {
 
-	int textID = loadCubeMapTexture(posX, negX, posY, negY, posZ, negZ);
+	mDrawOrderValid = false;
+
+	int textID;
+#if !defined(__ANDROID_API__)
+	if (mTextureStreaming)
+		textID = VSTextureLib::acquireCubeMapTextureAsync(posX, negX, posY, negY, posZ, negZ);
+	else
+#endif
+		textID = VSTextureLib::acquireCubeMapTexture(posX, negX, posY, negY, posZ, negZ);
+	holdTexture(textID);
+	replaceUnitTexture(unit, (GLuint)textID, GL_TEXTURE_CUBE_MAP);
+}
+
+
+void
+VSModelLib::replaceUnitTexture(unsigned int unit, GLuint textureID, GLenum textureType) {
+
+	std::vector<GLuint> previous;
 	for (unsigned int i = 0; i < mMyMeshes.size(); ++i) {
-		mMyMeshes[i].texUnits[unit] = (GLuint)textID;
-		mMyMeshes[i].texTypes[unit] = GL_TEXTURE_CUBE_MAP;
+		GLuint old = mMyMeshes[i].texUnits[unit];
+		if (old != 0 && old != textureID &&
+				std::find(previous.begin(), previous.end(), old) == previous.end())
+			previous.push_back(old);
+		mMyMeshes[i].texUnits[unit] = textureID;
+		mMyMeshes[i].texTypes[unit] = textureType;
 		mMyMeshes[i].mat.texCount = 1;
 	}
+
+	// textures still used by other units are kept
+	for (unsigned int k = 0; k < previous.size(); ++k) {
+		bool used = false;
+		for (unsigned int i = 0; i < mMyMeshes.size() && !used; ++i)
+			for (int t = 0; t < MAX_TEXTURES && !used; ++t)
+				used = mMyMeshes[i].texUnits[t] == previous[k];
+		if (used)
+			continue;
+		// appended models hold a reference per mesh
+		size_t held = std::count(mHeldTextures.begin(), mHeldTextures.end(), previous[k]);
+		for (size_t r = 0; r < held; ++r)
+			releaseTexture(previous[k]);
+	}
 }
 
 
@@ -850,27 +2826,325 @@ VSModelLib::addMesh(size_t nump, float *p, float *n, float *tc, float *tang, flo
 void
 VSModelLib::setMesh(int i, size_t nump, float *p, float *n, float *tc, float *tang, float *bitan, size_t numInd, unsigned int *indices) {
 
-	if (mMyMeshes.size() >= (unsigned int)i)
+	if (i < 0 || (unsigned int)i >= mMyMeshes.size())
 		return;
+	completeUpload(true);
 	MyMesh &m = mMyMeshes[i];
 
-	if (m.vao != 0) {
-		glDeleteVertexArrays(1, &(m.vao));
-		glDeleteBuffers(1, &m.vboPos);
-		glDeleteBuffers(1, &m.vboNormal);
-		glDeleteBuffers(1, &m.vboTexCoord);
-		glDeleteBuffers(1, &m.vboTangent);
-		glDeleteBuffers(1, &m.vboBitangent);
-		glDeleteBuffers(1, &m.vboIndices);
-	}
+	// the previous buffers are deleted if no other mesh shares them
 	buildVAO(m, nump, p, n, tc, tang, bitan, numInd, indices);
 }
 
 
+bool
+VSModelLib::updateMesh(int i, size_t nump, float *p, float *n, float *tc, float *tang, float *bitan, size_t numInd, unsigned int *indices) {
+
+	// the buffers are complete before they are changed
+	completeUpload(true);
+	if (i < 0 || (unsigned int)i >= mMyMeshes.size())
+		return false;
+	MyMesh &m = mMyMeshes[i];
+
+	// tangents of new vertices on the current faces need the
+	// indices, which are read back from the buffer
+	const unsigned int *faces = indices;
+	size_t numFaceIndices = numInd;
+	std::vector<unsigned int> oldIndices;
+	bool wantTangents = (mFlagMode & (TANGENT | BITANGENT | PACKED_TANGENT)) != 0;
+	if (faces == NULL && m.hasIndices && m.numIndices > 0 && m.vboIndices != 0 && wantTangents &&
+			tang == NULL && p != NULL && n != NULL && tc != NULL) {
+		GLsizeiptr size = m.numIndices * sizeof(unsigned int);
+		glBindBuffer(GL_COPY_READ_BUFFER, m.vboIndices);
+		const unsigned int *mapped = (const unsigned int *)
+				glMapBufferRange(GL_COPY_READ_BUFFER, 0, size, GL_MAP_READ_BIT);
+		if (mapped != NULL) {
+			oldIndices.assign(mapped, mapped + m.numIndices);
+			glUnmapBuffer(GL_COPY_READ_BUFFER);
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		for (size_t k = 0; k < oldIndices.size() && mapped != NULL; ++k) {
+			if (oldIndices[k] >= nump)
+				mapped = NULL;
+		}
+		if (mapped == NULL) {
+			VSLOG(sLogError, "Mesh %d: the current indices do not fit the new vertices, pass the indices to update the tangents", i);
+			return false;
+		}
+		faces = &oldIndices[0];
+		numFaceIndices = oldIndices.size();
+	}
+	std::vector<float> tangData, bitanData;
+	int tangComponents = prepareTangents(nump, p, n, tc, numFaceIndices, faces,
+						faces != NULL || !m.hasIndices, tang, bitan, tangData, bitanData);
+
+	if (m.vao == 0 || !m.geometry || m.geometry.use_count() > 1) {
+		buildVAO(m, nump, p, n, tc, tang, bitan, numInd, indices);
+		return true;
+	}
+
+	// the draw records keep these, see below
+	int oldCount = m.numIndices;
+	bool oldIndexed = m.hasIndices, oldDetailed = isDetailed(m);
+
+	Geometry &g = *m.geometry;
+	bool grow = nump > g.vertexCapacity;
+	if (grow && ((p == NULL && m.vboPos) || (n == NULL && m.vboNormal) ||
+			(tc == NULL && m.vboTexCoord) || (tang == NULL && m.vboTangent) ||
+			(bitan == NULL && m.vboBitangent))) {
+		VSLOG(sLogError, "Mesh %d: all attributes are required to add vertices", i);
+		return false;
+	}
+	GLuint capacity = grow ? std::max((GLuint)nump, g.vertexCapacity * 2) : g.vertexCapacity;
+
+	// buffers keep their names, the VAO needs no changes
+	// except for new attributes
+	struct {
+		const float *data;
+		GLuint *buffer;
+		GLuint attrib;
+		int components;
+		bool enabled;
+	} attribs[5] = {
+		{ p, &m.vboPos, VSShaderLib::VERTEX_COORD_ATTRIB, 4, true },
+		{ n, &m.vboNormal, VSShaderLib::NORMAL_ATTRIB, 3, (mFlagMode & NORMAL) != 0 },
+		{ tang, &m.vboTangent, VSShaderLib::TANGENT_ATTRIB, tangComponents, true },
+		{ bitan, &m.vboBitangent, VSShaderLib::BITANGENT_ATTRIB, 3, true },
+		{ tc, &m.vboTexCoord, VSShaderLib::TEXTURE_COORD_ATTRIB, 2, (mFlagMode & TEXCOORD) != 0 } };
+
+	glBindVertexArray(m.vao);
+	for (int a = 0; a < 5; ++a) {
+		if (attribs[a].data == NULL || !attribs[a].enabled)
+			continue;
+		// an attribute the mesh did not have, the whole buffer is allocated
+		GLuint c = *attribs[a].buffer ? capacity : std::max(capacity, (GLuint)nump);
+		bool created = (*attribs[a].buffer == 0);
+		GLsizeiptr elemSize = attribs[a].components * sizeof(float);
+		streamBuffer(GL_ARRAY_BUFFER, *attribs[a].buffer, c * elemSize,
+					nump * elemSize, attribs[a].data);
+		// the tangent layout may change with the mode
+		bool relayout = attribs[a].buffer == &m.vboTangent && m.tangentComponents != tangComponents;
+		if (created || relayout) {
+			glEnableVertexAttribArray(attribs[a].attrib);
+			glVertexAttribPointer(attribs[a].attrib, attribs[a].components, GL_FLOAT, 0, 0, 0);
+		}
+		if (attribs[a].buffer == &m.vboTangent)
+			m.tangentComponents = tangComponents;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	g.vertexCapacity = capacity;
+
+	if (indices != NULL && numInd > 0) {
+		GLuint indexCapacity = numInd > g.indexCapacity ?
+					std::max((GLuint)numInd, g.indexCapacity * 2) : g.indexCapacity;
+		streamBuffer(GL_ELEMENT_ARRAY_BUFFER, m.vboIndices, indexCapacity * sizeof(unsigned int),
+					numInd * sizeof(unsigned int), indices);
+		g.indexCapacity = indexCapacity;
+		m.hasIndices = true;
+		m.numIndices = (int)numInd;
+	}
+	else if (!m.hasIndices)
+		m.numIndices = (int)nump;
+	glBindVertexArray(0);
+
+	g.vboPos = m.vboPos; g.vboNormal = m.vboNormal; g.vboTexCoord = m.vboTexCoord;
+	g.vboTangent = m.vboTangent; g.vboBitangent = m.vboBitangent; g.vboIndices = m.vboIndices;
+
+	m.numVertices = (int)nump;
+	m.numLODs = 0;
+	m.currentLOD = 0;
+	dropMeshlets(m);
+	// render reads the counts from the draw records
+	if (m.numIndices != oldCount || m.hasIndices != oldIndexed || oldDetailed)
+		mDrawOrderValid = false;
+	if (p != NULL) {
+		computeBounds(m, p, 4, (unsigned int)nump);
+		// the boxes are in draw order, which did not change
+		if (mDrawOrderValid)
+			buildCullBoxes();
+	}
+	return true;
+}
+
+
+bool
+VSModelLib::updateMeshVertices(int i, VSShaderLib::AttribType attrib, size_t first, size_t count, const float *values) {
+
+	// the buffers are complete before they are changed
+	completeUpload(true);
+	if (i < 0 || (unsigned int)i >= mMyMeshes.size())
+		return false;
+	MyMesh &m = mMyMeshes[i];
+
+	GLuint buffer;
+	int components;
+	switch (attrib) {
+		case VSShaderLib::VERTEX_COORD_ATTRIB: buffer = m.vboPos; components = 4; break;
+		case VSShaderLib::NORMAL_ATTRIB: buffer = m.vboNormal; components = 3; break;
+		case VSShaderLib::TANGENT_ATTRIB: buffer = m.vboTangent; components = m.tangentComponents; break;
+		case VSShaderLib::BITANGENT_ATTRIB: buffer = m.vboBitangent; components = 3; break;
+		case VSShaderLib::TEXTURE_COORD_ATTRIB: buffer = m.vboTexCoord; components = 2; break;
+		default: buffer = 0; components = 0;
+	}
+	if (buffer == 0 || first + count > (size_t)m.numVertices) {
+		VSLOG(sLogError, "Mesh %d: invalid vertex update", i);
+		return false;
+	}
+	if (m.geometry.use_count() > 1) {
+		VSLOG(sLogError, "Mesh %d: the buffers are shared, use updateMesh", i);
+		return false;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferSubData(GL_ARRAY_BUFFER, first * components * sizeof(float),
+					count * components * sizeof(float), values);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (attrib == VSShaderLib::VERTEX_COORD_ATTRIB && count > 0) {
+		// grow the bounds to include the new positions
+		float bbMin[3], bbMax[3];
+		VSMeshOptLib::computeBoundingBox(values, (unsigned int)count, 4, bbMin, bbMax);
+		for (int k = 0; k < 3; ++k) {
+			m.bbMin[k] = std::min(m.bbMin[k], bbMin[k]);
+			m.bbMax[k] = std::max(m.bbMax[k], bbMax[k]);
+		}
+		float r = 0.0f;
+		for (int k = 0; k < 3; ++k) {
+			m.boundCenter[k] = (m.bbMin[k] + m.bbMax[k]) * 0.5f;
+			r += (m.bbMax[k] - m.boundCenter[k]) * (m.bbMax[k] - m.boundCenter[k]);
+		}
+		m.boundRadius = sqrtf(r);
+		dropMeshlets(m);
+		if (mDrawOrderValid)
+			buildCullBoxes();
+	}
+	return true;
+}
+
+
+bool
+VSModelLib::updateMeshIndices(int i, size_t first, size_t count, const unsigned int *indices) {
+
+	// the buffers are complete before they are changed
+	completeUpload(true);
+	if (i < 0 || (unsigned int)i >= mMyMeshes.size())
+		return false;
+	MyMesh &m = mMyMeshes[i];
+
+	if (!m.hasIndices || first + count > (size_t)m.numIndices) {
+		VSLOG(sLogError, "Mesh %d: invalid index update", i);
+		return false;
+	}
+	if (m.geometry.use_count() > 1) {
+		VSLOG(sLogError, "Mesh %d: the buffers are shared, use updateMesh", i);
+		return false;
+	}
+
+	// the element array binding is part of the VAO
+	glBindVertexArray(m.vao);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, first * sizeof(unsigned int),
+					count * sizeof(unsigned int), indices);
+	glBindVertexArray(0);
+
+	// the levels and clusters were built for the previous indices
+	if (isDetailed(m))
+		mDrawOrderValid = false;
+	m.numLODs = 0;
+	m.currentLOD = 0;
+	dropMeshlets(m);
+	return true;
+}
+
+
+void
+VSModelLib::streamBuffer(GLenum target, GLuint &buffer, GLsizeiptr capacity,
+						GLsizeiptr size, const void *data) {
+
+	if (buffer == 0)
+		glGenBuffers(1, &buffer);
+	glBindBuffer(target, buffer);
+	// orphaning: the driver hands a new block while draws
+	// in flight keep reading the previous one
+	glBufferData(target, capacity, NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(target, 0, size, data);
+}
+
+
+int
+VSModelLib::getTangentComponents() {
+
+	return (mFlagMode & PACKED_TANGENT) ? 4 : 3;
+}
+
+
+int
+VSModelLib::prepareTangents(size_t nump, const float *p, const float *n, const float *tc,
+						size_t numInd, const unsigned int *ind, bool generate,
+						float *&tang, float *&bitan,
+						std::vector<float> &tangData, std::vector<float> &bitanData) {
+
+	bool packed = (mFlagMode & PACKED_TANGENT) != 0;
+	bool wantTangent = packed || (mFlagMode & TANGENT);
+	bool wantBitangent = !packed && (mFlagMode & BITANGENT);
+
+	if (((wantTangent && tang == NULL) || (wantBitangent && bitan == NULL)) &&
+			generate && p != NULL && n != NULL && tc != NULL && nump > 0) {
+
+		tangData.resize(nump * 4);
+		if (wantBitangent)
+			bitanData.resize(nump * 3);
+		VSMeshOptLib::computeTangents(p, 4, n, 3, tc, 2, (unsigned int)nump,
+					ind, (unsigned int)(ind ? numInd : nump), &tangData[0],
+					wantBitangent ? &bitanData[0] : NULL);
+		if (!packed) {
+			for (size_t v = 1; v < nump; ++v)
+				memmove(&tangData[v * 3], &tangData[v * 4], 3 * sizeof(float));
+			tangData.resize(nump * 3);
+		}
+		if (tang == NULL)
+			tang = &tangData[0];
+		if (bitan == NULL && wantBitangent)
+			bitan = &bitanData[0];
+		else
+			std::vector<float>().swap(bitanData);
+	}
+	else if (packed && tang != NULL) {
+
+		// handedness from the user bitangents, if any
+		tangData.resize(nump * 4);
+		for (size_t v = 0; v < nump; ++v) {
+			float *t = &tangData[v * 4];
+			memcpy(t, tang + v * 3, 3 * sizeof(float));
+			t[3] = 1.0f;
+			if (bitan != NULL && n != NULL) {
+				const float *nn = n + v * 3, *b = bitan + v * 3;
+				float c[3] = { nn[1] * t[2] - nn[2] * t[1],
+							nn[2] * t[0] - nn[0] * t[2],
+							nn[0] * t[1] - nn[1] * t[0] };
+				if (c[0] * b[0] + c[1] * b[1] + c[2] * b[2] < 0.0f)
+					t[3] = -1.0f;
+			}
+		}
+		tang = &tangData[0];
+	}
+
+	if (!wantTangent)
+		tang = NULL;
+	if (!wantBitangent)
+		bitan = NULL;
+	return packed ? 4 : 3;
+}
+
+
 void
 VSModelLib::buildVAO(MyMesh &m, size_t nump, float *p, float *n, float *tc, float *tang, float *bitang, size_t  numInd, unsigned int *ind) {
 
+	mDrawOrderValid = false;
 
+	m.vao = 0; m.vboPos = 0; m.vboNormal = 0; m.vboTexCoord = 0;
+	m.vboTangent = 0; m.vboBitangent = 0; m.vboIndices = 0;
+	std::vector<float> tangData, bitanData;
+	int tangComponents = prepareTangents(nump, p, n, tc, numInd, ind, true,
+						tang, bitang, tangData, bitanData);
 	glGenVertexArrays(1, &m.vao);
 	glBindVertexArray(m.vao);
 
@@ -888,14 +3162,15 @@ VSModelLib::buildVAO(MyMesh &m, size_t nump, float *p, float *n, float *tc, floa
 		glEnableVertexAttribArray(VSShaderLib::NORMAL_ATTRIB);
 		glVertexAttribPointer(VSShaderLib::NORMAL_ATTRIB, 3, GL_FLOAT, 0, 0, 0);
 	}
-	if (tang != NULL && (mFlagMode & TANGENT)) {
+	if (tang != NULL) {
 		glGenBuffers(1, &m.vboTangent);
 		glBindBuffer(GL_ARRAY_BUFFER, m.vboTangent);
-		glBufferData(GL_ARRAY_BUFFER, nump * 3 * sizeof(float), &(tang[0]), GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, nump * tangComponents * sizeof(float), &(tang[0]), GL_STATIC_DRAW);
 		glEnableVertexAttribArray(VSShaderLib::TANGENT_ATTRIB);
-		glVertexAttribPointer(VSShaderLib::TANGENT_ATTRIB, 3, GL_FLOAT, 0, 0, 0);
+		glVertexAttribPointer(VSShaderLib::TANGENT_ATTRIB, tangComponents, GL_FLOAT, 0, 0, 0);
+		m.tangentComponents = tangComponents;
 	}
-	if (bitang != NULL && (mFlagMode & BITANGENT)) {
+	if (bitang != NULL) {
 		glGenBuffers(1, &m.vboBitangent);
 		glBindBuffer(GL_ARRAY_BUFFER, m.vboBitangent);
 		glBufferData(GL_ARRAY_BUFFER, nump * 3 * sizeof(float), &(bitang[0]), GL_STATIC_DRAW);
@@ -909,10 +3184,33 @@ VSModelLib::buildVAO(MyMesh &m, size_t nump, float *p, float *n, float *tc, floa
 		glEnableVertexAttribArray(VSShaderLib::TEXTURE_COORD_ATTRIB);
 		glVertexAttribPointer(VSShaderLib::TEXTURE_COORD_ATTRIB, 2, GL_FLOAT, 0, 0, 0);
 	}
+	m.numVertices = (int)nump;
+	m.numLODs = 0;
+	if (p != NULL && ind == NULL)
+		computeBounds(m, p, 4, (unsigned int)nump);
 	if (ind != NULL) {
+		// bounds are computed with the levels of detail
+		std::vector<unsigned int> lodIndices;
+		if (p != NULL)
+			buildLODs(m, p, 4, (unsigned int)nump, ind, (unsigned int)numInd, lodIndices);
+		else
+			lodIndices.assign(ind, ind + numInd);
+
+		dropMeshlets(m);
+		if (p != NULL && mMeshletTriangles > 0 && numInd > 0) {
+			std::vector<VSMeshOptLib::Meshlet> meshlets;
+			VSMeshOptLib::buildMeshlets(p, (unsigned int)nump, 4, &lodIndices[0],
+						(unsigned int)numInd, mMeshletTriangles, meshlets);
+			// meshes rebuilt over and over leave their old ranges behind
+			if (mMeshletsFreed > 0 && mMeshletsFreed * 2 >= mMeshlets.size())
+				compactMeshlets();
+			m.firstMeshlet = (unsigned int)mMeshlets.size();
+			m.numMeshlets = (unsigned int)meshlets.size();
+			mMeshlets.insert(mMeshlets.end(), meshlets.begin(), meshlets.end());
+		}
 		glGenBuffers(1, &m.vboIndices);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.vboIndices);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, numInd * sizeof(unsigned int), &(ind[0]), GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, lodIndices.size() * sizeof(unsigned int), lodIndices.data(), GL_STATIC_DRAW);
 		m.hasIndices = true;
 		m.numIndices = (int)numInd;
 	}
@@ -921,14 +3219,126 @@ VSModelLib::buildVAO(MyMesh &m, size_t nump, float *p, float *n, float *tc, floa
 		m.numIndices = (int)nump;
 	}
 	glBindVertexArray(0);
+	ownGeometry(m);
+}
+
+
+void
+VSModelLib::dropMeshlets(MyMesh &m) {
+
+	mMeshletsFreed += m.numMeshlets;
+	m.numMeshlets = 0;
+}
+
+
+void
+VSModelLib::compactMeshlets() {
+
+	// meshes with the same range, such as duplicates, keep sharing it
+	std::vector<VSMeshOptLib::Meshlet> meshlets;
+	std::map<unsigned int, unsigned int> moved;
+	for (unsigned int i = 0; i < mMyMeshes.size(); ++i) {
+		MyMesh &m = mMyMeshes[i];
+		if (m.numMeshlets == 0)
+			continue;
+		std::map<unsigned int, unsigned int>::iterator iter = moved.find(m.firstMeshlet);
+		if (iter == moved.end()) {
+			iter = moved.insert(std::make_pair(m.firstMeshlet, (unsigned int)meshlets.size())).first;
+			meshlets.insert(meshlets.end(), mMeshlets.begin() + m.firstMeshlet,
+						mMeshlets.begin() + m.firstMeshlet + m.numMeshlets);
+		}
+		m.firstMeshlet = iter->second;
+	}
+	mMeshlets.swap(meshlets);
+	mMeshletsFreed = 0;
+}
+
+
+void
+VSModelLib::buildMeshVAO(MyMesh &m) {
+
+	glGenVertexArrays(1, &m.vao);
+	glBindVertexArray(m.vao);
+
+	GLuint vbos[5] = { m.vboPos, m.vboNormal, m.vboTexCoord, m.vboTangent, m.vboBitangent };
+	int components[5] = { 4, 3, 2, m.tangentComponents, 3 };
+	GLuint attribs[5] = { VSShaderLib::VERTEX_COORD_ATTRIB, VSShaderLib::NORMAL_ATTRIB,
+						VSShaderLib::TEXTURE_COORD_ATTRIB, VSShaderLib::TANGENT_ATTRIB,
+						VSShaderLib::BITANGENT_ATTRIB };
+	for (int a = 0; a < 5; ++a) {
+		if (vbos[a] == 0)
+			continue;
+		glBindBuffer(GL_ARRAY_BUFFER, vbos[a]);
+		glEnableVertexAttribArray(attribs[a]);
+		glVertexAttribPointer(attribs[a], components[a], GL_FLOAT, 0, 0, 0);
+	}
+	if (m.vboIndices != 0)
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.vboIndices);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	if (m.geometry)
+		m.geometry->vao = m.vao;
+}
+
+
+bool
+VSModelLib::completeUpload(bool block) {
+
+	if (!mVAOsPending)
+		return true;
+
+#if !defined(__ANDROID_API__)
+	if (mUploadTicket != 0) {
+		if (block)
+			VSUploadLib::wait(mUploadTicket);
+		else if (!VSUploadLib::isReady(mUploadTicket))
+			return false;
+		mUploadTicket = 0;
+	}
+#endif
+
+	// meshes sharing a geometry share its vertex array
+	for (unsigned int i = 0; i < mMyMeshes.size(); ++i) {
+		MyMesh &m = mMyMeshes[i];
+		if (m.vao != 0 || !m.geometry)
+			continue;
+		if (m.geometry->vao == 0)
+			buildMeshVAO(m);
+		else
+			m.vao = m.geometry->vao;
+	}
+	mVAOsPending = false;
+	mDrawOrderValid = false;
+	return true;
 }
 
 
 void 
 VSModelLib::addMeshes(const VSModelLib &model) {
 
+	mDrawOrderValid = false;
+
+	// the vertex arrays of meshes still uploading are built by each model
+#if !defined(__ANDROID_API__)
+	VSUploadLib::wait(model.mUploadTicket);
+#endif
+	mVAOsPending = mVAOsPending || model.mVAOsPending;
+
+	// cluster ranges are rebased to this model's list
+	unsigned int meshletBase = (unsigned int)mMeshlets.size();
+	mMeshlets.insert(mMeshlets.end(), model.mMeshlets.begin(), model.mMeshlets.end());
+
 	for (auto mesh : model.mMyMeshes) {
+		mesh.firstMeshlet += meshletBase;
 		mMyMeshes.push_back(mesh);
+		// keep the shared textures alive while this model uses them
+		for (int t = 0; t < MAX_TEXTURES; ++t) {
+			if (VSTextureLib::isRegistered(mesh.texUnits[t])) {
+				VSTextureLib::retain(mesh.texUnits[t]);
+				holdTexture(mesh.texUnits[t]);
+			}
+		}
 	}
 }
 
@@ -0,0 +1,362 @@
+/** ----------------------------------------------------------
+ * \class VSReadbackLib
+ *
+ * Lighthouse3D
+ *
+ * VSReadbackLib - Very Simple Readback Library
+ *
+ * \version 0.1.0
+ *		Initial Release
+ *
+ * This lib reads rendered frames back without stalling the GPU.
+ * Each capture issues glReadPixels into a ring of pixel pack
+ * buffers, and the frames are handed to a callback a few frames
+ * later, once their fences have signalled.
+ *
+ * Full documentation at
+ * http://www.lighthouse3d.com/very-simple-libs
+ *
+ ---------------------------------------------------------------*/
+
+#include "vsReadbackLib.h"
+
+#if !defined(__ANDROID_API__)
+
+#include <algorithm>
+#include <string.h>
+
+
+VSReadbackLib::VSReadbackLib():
+	mRingSize(3),
+	mHead(0),
+	mTail(0),
+	mInFlight(0),
+	mConversion(CONVERT_NONE),
+	mCaptures(0),
+	mStalls(0),
+	mConverting(0),
+	mStop(false) {
+
+}
+
+
+VSReadbackLib::~VSReadbackLib() {
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStop = true;
+	}
+	mCond.notify_all();
+	if (mWorker.joinable())
+		mWorker.join();
+	deleteSlots();
+}
+
+
+void
+VSReadbackLib::setCallback(const Callback &callback) {
+
+	mCallback = callback;
+}
+
+
+void
+VSReadbackLib::setConversion(unsigned int conversion) {
+
+	mConversion = conversion;
+}
+
+
+void
+VSReadbackLib::setRingSize(unsigned int buffers) {
+
+	if (buffers == 0 || buffers == mRingSize)
+		return;
+	// the captures in flight are delivered with the old ring
+	finish();
+	deleteSlots();
+	mRingSize = buffers;
+}
+
+
+void
+VSReadbackLib::capture(GLint x, GLint y, GLsizei width, GLsizei height) {
+
+	if (mSlots.empty()) {
+		mSlots.resize(mRingSize);
+		for (unsigned int i = 0; i < mRingSize; ++i) {
+			mSlots[i].buffer = 0;
+			mSlots[i].ptr = NULL;
+			mSlots[i].size = 0;
+			mSlots[i].fence = 0;
+		}
+	}
+
+	// all buffers in flight, the oldest read is waited for
+	if (mInFlight == mRingSize) {
+		if (!collect(false)) {
+			mStalls++;
+			// the wait times out after a second, the slot is not reused before
+			while (!collect(true))
+				;
+		}
+	}
+
+	Slot &slot = mSlots[mHead];
+	size_t size = (size_t)width * height * 4;
+	if (slot.size < size)
+		allocateSlot(slot, size);
+
+	slot.frame.number = mCaptures++;
+	slot.frame.width = width;
+	slot.frame.height = height;
+	slot.frame.channels = 4;
+	slot.conversion = mConversion;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	// the fence is flushed now, so that polling sees it signal
+	glFlush();
+
+	mHead = (mHead + 1) % mRingSize;
+	mInFlight++;
+}
+
+
+void
+VSReadbackLib::update() {
+
+	while (mInFlight > 0 && collect(false))
+		;
+	deliverConverted(false);
+}
+
+
+void
+VSReadbackLib::finish() {
+
+	while (mInFlight > 0)
+		collect(true);
+	deliverConverted(true);
+}
+
+
+bool
+VSReadbackLib::collect(bool block) {
+
+	Slot &slot = mSlots[mTail];
+	GLenum result = block ?
+		glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) :
+		glClientWaitSync(slot.fence, 0, 0);
+	if (result == GL_TIMEOUT_EXPIRED)
+		return false;
+	if (result == GL_WAIT_FAILED)
+		VSLOG(mLogError, "Readback of frame %u failed", slot.frame.number);
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+
+	std::shared_ptr<Frame> frame(new Frame());
+	frame->number = slot.frame.number;
+	frame->width = slot.frame.width;
+	frame->height = slot.frame.height;
+	frame->channels = slot.frame.channels;
+	size_t size = (size_t)frame->width * frame->height * 4;
+	frame->data.resize(size);
+
+	if (slot.ptr != NULL)
+		memcpy(&frame->data[0], slot.ptr, size);
+	else {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		void *ptr = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+		if (ptr != NULL) {
+			memcpy(&frame->data[0], ptr, size);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		else
+			VSLOG(mLogError, "Could not map the buffer of frame %u", frame->number);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	mTail = (mTail + 1) % mRingSize;
+	mInFlight--;
+	deliver(frame, slot.conversion);
+	return true;
+}
+
+
+void
+VSReadbackLib::deliver(std::shared_ptr<Frame> frame, unsigned int conversion) {
+
+	// frames already at the worker go first, to keep the order
+	if (conversion == CONVERT_NONE && mConverting == 0) {
+		if (mCallback)
+			mCallback(*frame);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQueue.push_back(std::make_pair(frame, conversion));
+		if (!mWorker.joinable())
+			mWorker = std::thread(&VSReadbackLib::workerLoop, this);
+	}
+	mConverting++;
+	mCond.notify_all();
+}
+
+
+void
+VSReadbackLib::deliverConverted(bool block) {
+
+	std::deque<std::shared_ptr<Frame> > converted;
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		if (block)
+			mCond.wait(lock, [this] { return mConverted.size() == mConverting; });
+		converted.swap(mConverted);
+	}
+
+	mConverting -= (unsigned int)converted.size();
+	for (size_t i = 0; i < converted.size(); ++i) {
+		if (mCallback)
+			mCallback(*converted[i]);
+	}
+}
+
+
+void
+VSReadbackLib::workerLoop() {
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	for (;;) {
+		mCond.wait(lock, [this] { return mStop || !mQueue.empty(); });
+		if (mStop)
+			return;
+
+		std::pair<std::shared_ptr<Frame>, unsigned int> job = mQueue.front();
+		mQueue.pop_front();
+		lock.unlock();
+
+		convert(*job.first, job.second);
+
+		lock.lock();
+		mConverted.push_back(job.first);
+		mCond.notify_all();
+	}
+}
+
+
+void
+VSReadbackLib::convert(Frame &frame, unsigned int conversion) {
+
+	if (conversion == CONVERT_NONE)
+		return;
+
+	unsigned int channels = (conversion & CONVERT_DROP_ALPHA) ? 3 : 4;
+	size_t srcRow = (size_t)frame.width * 4;
+	size_t dstRow = (size_t)frame.width * channels;
+	int r = (conversion & CONVERT_SWAP_RB) ? 2 : 0;
+	int b = 2 - r;
+
+	// rows are written at or before the rows they are read from,
+	// so only flipped frames need a second buffer
+	std::vector<unsigned char> flipped;
+	const unsigned char *src = &frame.data[0];
+	if (conversion & CONVERT_FLIP_ROWS) {
+		flipped.swap(frame.data);
+		frame.data.resize(dstRow * frame.height);
+		src = &flipped[0];
+	}
+
+	for (unsigned int y = 0; y < frame.height; ++y) {
+		unsigned int srcY = (conversion & CONVERT_FLIP_ROWS) ? frame.height - 1 - y : y;
+		const unsigned char *s = src + srcY * srcRow;
+		unsigned char *d = &frame.data[y * dstRow];
+		for (unsigned int x = 0; x < frame.width; ++x, s += 4, d += channels) {
+			unsigned char red = s[r], green = s[1], blue = s[b], alpha = s[3];
+			d[0] = red;
+			d[1] = green;
+			d[2] = blue;
+			if (channels == 4)
+				d[3] = alpha;
+		}
+	}
+	frame.data.resize(dstRow * frame.height);
+	frame.channels = channels;
+}
+
+
+void
+VSReadbackLib::allocateSlot(Slot &slot, size_t size) {
+
+	if (slot.buffer != 0) {
+		if (slot.ptr != NULL) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glDeleteBuffers(1, &slot.buffer);
+	}
+
+	glGenBuffers(1, &slot.buffer);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	slot.ptr = NULL;
+	if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+		GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_PIXEL_PACK_BUFFER, size, NULL, flags);
+		slot.ptr = (unsigned char *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, flags);
+	}
+	else
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot.size = size;
+}
+
+
+void
+VSReadbackLib::deleteSlots() {
+
+	for (size_t i = 0; i < mSlots.size(); ++i) {
+		Slot &slot = mSlots[i];
+		if (slot.fence != 0)
+			glDeleteSync(slot.fence);
+		if (slot.buffer == 0)
+			continue;
+		if (slot.ptr != NULL) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		}
+		glDeleteBuffers(1, &slot.buffer);
+	}
+	mSlots.clear();
+	mHead = 0;
+	mTail = 0;
+	mInFlight = 0;
+}
+
+
+unsigned int
+VSReadbackLib::getPendingCount() {
+
+	return mInFlight + mConverting;
+}
+
+
+unsigned int
+VSReadbackLib::getStallCount() {
+
+	return mStalls;
+}
+
+
+std::string
+VSReadbackLib::getErrors() {
+
+	return mLogError.dumpToString();
+}
+
+#endif
@@ -0,0 +1,275 @@
+/** ----------------------------------------------------------
+ * \class VSRenderTargetLib
+ *
+ * Lighthouse3D
+ *
+ * VSRenderTargetLib - Very Simple Render Target Library
+ *
+ * \version 0.1.0
+ *		Initial Release
+ *
+ * This lib keeps a pool of framebuffers with their color and depth
+ * textures, looked up by size, formats and samples.
+ *
+ * Full documentation at
+ * http://www.lighthouse3d.com/very-simple-libs
+ *
+ ---------------------------------------------------------------*/
+
+#include "vsRenderTargetLib.h"
+
+#if !defined(__ANDROID_API__)
+
+
+VSLogLib VSRenderTargetLib::sLogError;
+
+std::map<GLuint, VSRenderTargetLib::Entry> VSRenderTargetLib::sTargets;
+unsigned int VSRenderTargetLib::sFrame = 0;
+unsigned int VSRenderTargetLib::sMaxIdleFrames = 3;
+size_t VSRenderTargetLib::sMemory = 0;
+unsigned int VSRenderTargetLib::sAllocations = 0;
+
+
+const VSRenderTargetLib::Target *
+VSRenderTargetLib::acquire(const Desc &desc) {
+
+	std::map<GLuint, Entry>::iterator iter;
+	for (iter = sTargets.begin(); iter != sTargets.end(); ++iter) {
+		Entry &entry = iter->second;
+		if (!entry.inUse && entry.target.desc == desc) {
+			entry.inUse = true;
+			entry.lastUsed = sFrame;
+			return &entry.target;
+		}
+	}
+
+	Entry entry;
+	if (!create(desc, entry.target))
+		return NULL;
+
+	size_t pixels = (size_t)desc.width * desc.height * (desc.samples > 0 ? desc.samples : 1);
+	entry.bytes = pixels * (getFormatSize(desc.colorFormat) + getFormatSize(desc.depthFormat));
+	entry.inUse = true;
+	entry.lastUsed = sFrame;
+	sMemory += entry.bytes;
+	sAllocations++;
+
+	Entry &stored = sTargets[entry.target.fbo] = entry;
+	return &stored.target;
+}
+
+
+void
+VSRenderTargetLib::release(const Target *target) {
+
+	if (target == NULL)
+		return;
+	std::map<GLuint, Entry>::iterator iter = sTargets.find(target->fbo);
+	if (iter != sTargets.end()) {
+		iter->second.inUse = false;
+		// idle frames count from the release
+		iter->second.lastUsed = sFrame;
+	}
+}
+
+
+void
+VSRenderTargetLib::update() {
+
+	std::map<GLuint, Entry>::iterator iter = sTargets.begin();
+	while (iter != sTargets.end()) {
+		Entry &entry = iter->second;
+		if (!entry.inUse && sFrame - entry.lastUsed >= sMaxIdleFrames) {
+			destroy(entry);
+			sTargets.erase(iter++);
+		}
+		else
+			++iter;
+	}
+	sFrame++;
+}
+
+
+void
+VSRenderTargetLib::setMaxIdleFrames(unsigned int frames) {
+
+	sMaxIdleFrames = frames;
+}
+
+
+void
+VSRenderTargetLib::trim() {
+
+	std::map<GLuint, Entry>::iterator iter = sTargets.begin();
+	while (iter != sTargets.end()) {
+		if (!iter->second.inUse) {
+			destroy(iter->second);
+			sTargets.erase(iter++);
+		}
+		else
+			++iter;
+	}
+}
+
+
+bool
+VSRenderTargetLib::create(const Desc &desc, Target &target) {
+
+	target.desc = desc;
+	target.color = 0;
+	target.depth = 0;
+
+	GLint previous;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+
+	GLenum texTarget = desc.samples > 0 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+	glGenFramebuffers(1, &target.fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+
+	if (desc.colorFormat != 0) {
+		target.color = createTexture(desc.colorFormat, desc);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texTarget, target.color, 0);
+	}
+	else {
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+
+	if (desc.depthFormat != 0) {
+		target.depth = createTexture(desc.depthFormat, desc);
+		bool stencil = desc.depthFormat == GL_DEPTH24_STENCIL8 ||
+						desc.depthFormat == GL_DEPTH32F_STENCIL8;
+		glFramebufferTexture2D(GL_FRAMEBUFFER,
+						stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT,
+						texTarget, target.depth, 0);
+	}
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, previous);
+	if (status == GL_FRAMEBUFFER_COMPLETE)
+		return true;
+
+	VSLOG(sLogError, "Framebuffer %dx%d color 0x%x depth 0x%x samples %d not complete: 0x%x",
+		desc.width, desc.height, desc.colorFormat, desc.depthFormat, desc.samples, status);
+	glDeleteFramebuffers(1, &target.fbo);
+	if (target.color != 0)
+		glDeleteTextures(1, &target.color);
+	if (target.depth != 0)
+		glDeleteTextures(1, &target.depth);
+	return false;
+}
+
+
+GLuint
+VSRenderTargetLib::createTexture(GLenum internalFormat, const Desc &desc) {
+
+	bool depth = internalFormat == GL_DEPTH_COMPONENT16 || internalFormat == GL_DEPTH_COMPONENT24 ||
+				internalFormat == GL_DEPTH_COMPONENT32 || internalFormat == GL_DEPTH_COMPONENT32F ||
+				internalFormat == GL_DEPTH24_STENCIL8 || internalFormat == GL_DEPTH32F_STENCIL8;
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+
+	if (desc.samples > 0) {
+		glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, texture);
+		if (GLEW_VERSION_4_3 || GLEW_ARB_texture_storage_multisample)
+			glTexStorage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, desc.samples, internalFormat,
+							desc.width, desc.height, GL_TRUE);
+		else
+			glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, desc.samples, internalFormat,
+							desc.width, desc.height, GL_TRUE);
+		glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+		return texture;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, texture);
+	if (GLEW_VERSION_4_2 || GLEW_ARB_texture_storage)
+		glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, desc.width, desc.height);
+	else if (internalFormat == GL_DEPTH24_STENCIL8)
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, desc.width, desc.height, 0,
+					GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+	else if (internalFormat == GL_DEPTH32F_STENCIL8)
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, desc.width, desc.height, 0,
+					GL_DEPTH_STENCIL, GL_FLOAT_32_UNSIGNED_INT_24_8_REV, NULL);
+	else if (depth)
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, desc.width, desc.height, 0,
+					GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	else
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, desc.width, desc.height, 0,
+					GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+	// targets are usually sampled one to one by the next pass
+	GLenum filter = depth ? GL_NEAREST : GL_LINEAR;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return texture;
+}
+
+
+void
+VSRenderTargetLib::destroy(Entry &entry) {
+
+	glDeleteFramebuffers(1, &entry.target.fbo);
+	if (entry.target.color != 0)
+		glDeleteTextures(1, &entry.target.color);
+	if (entry.target.depth != 0)
+		glDeleteTextures(1, &entry.target.depth);
+	sMemory -= entry.bytes;
+}
+
+
+unsigned int
+VSRenderTargetLib::getFormatSize(GLenum internalFormat) {
+
+	switch (internalFormat) {
+		case 0: return 0;
+		case GL_R8: return 1;
+		case GL_RG8:
+		case GL_R16F:
+		case GL_DEPTH_COMPONENT16: return 2;
+		case GL_RGB8: return 3;
+		case GL_RGB16F: return 6;
+		case GL_RGBA16F:
+		case GL_RG32F:
+		case GL_DEPTH32F_STENCIL8: return 8;
+		case GL_RGB32F: return 12;
+		case GL_RGBA32F: return 16;
+		// RGBA8, SRGB8_ALPHA8, RGB10_A2, R11F_G11F_B10F, RG16F, R32F,
+		// and the 24 and 32 bit depth formats
+		default: return 4;
+	}
+}
+
+
+size_t
+VSRenderTargetLib::getMemory() {
+
+	return sMemory;
+}
+
+
+unsigned int
+VSRenderTargetLib::getTargetCount() {
+
+	return (unsigned int)sTargets.size();
+}
+
+
+unsigned int
+VSRenderTargetLib::getAllocationCount() {
+
+	return sAllocations;
+}
+
+
+std::string
+VSRenderTargetLib::getErrors() {
+
+	return sLogError.dumpToString();
+}
+
+#endif
@@ -5,6 +5,14 @@
  *
  * VSResourceLib - Very Simple Resource Library
  *
+ * \version 0.1.2
+ *		Textures can be block compressed by the lib, with a disk cache
+ *		Fixed the compress flag of loadRGBATexture, which was inverted
+ *		Mip chains are built on the CPU with the options of VSImageLib
+ *		Images can be decoded in any thread, DevIL calls are serialized
+ *		Materials have a texture layer and an atlas rect
+ *		Textures are defined through VSUploadLib
+ *
  * \version 0.1.1
  *		Added virtual function load cubemaps
  *		Added virtual function to set a preloaded texture
@@ -33,6 +41,7 @@
  ---------------------------------------------------------------*/
 
 #include "vsResourceLib.h"
+#include "vsTextureLib.h"
 
 float VSResourceLib::Colors[24][10] = 
 	{{0.0215f ,0.1745f ,0.0215f ,0.07568f ,0.61424f ,0.07568f ,0.633f ,0.727811f, 0.633f, 76.8f} ,
@@ -80,6 +89,12 @@ GLenum VSResourceLib::faceTarget[6] = {
 	};
 
 
+#if defined(__VSL_TEXTURE_LOADING__) && !defined(__ANDROID_API__)
+std::mutex VSResourceLib::sDevILMutex;
+bool VSResourceLib::sDevILReady = false;
+#endif
+
+
 #if defined(__ANDROID_API__)
 
 Assimp::Importer *VSResourceLib::s_Importer = NULL;
@@ -103,15 +118,42 @@ VSResourceLib::VSResourceLib(): mScaleToUnitCube(1.0), bbVAO(0), bbInit(false)
 
 	/* initialization of DevIL */
 #if defined(__VSL_TEXTURE_LOADING__) && !defined(__ANDROID_API__)
+	std::lock_guard<std::mutex> lock(sDevILMutex);
 	ilInit(); 
 	ilEnable(IL_ORIGIN_SET);
 	ilOriginFunc(IL_ORIGIN_LOWER_LEFT);
+	sDevILReady = true;
 #endif
 }
 
 
 VSResourceLib::~VSResourceLib() {
 
+	// give back the registry textures
+	for (unsigned int i = 0; i < mHeldTextures.size(); ++i)
+		VSTextureLib::release(mHeldTextures[i]);
+	mHeldTextures.clear();
+}
+
+
+void
+VSResourceLib::holdTexture(GLuint textureID) {
+
+	if (VSTextureLib::isRegistered(textureID))
+		mHeldTextures.push_back(textureID);
+}
+
+
+void
+VSResourceLib::releaseTexture(GLuint textureID) {
+
+	for (unsigned int i = 0; i < mHeldTextures.size(); ++i) {
+		if (mHeldTextures[i] == textureID) {
+			mHeldTextures.erase(mHeldTextures.begin() + i);
+			VSTextureLib::release(textureID);
+			return;
+		}
+	}
 }
 
 
@@ -226,21 +268,8 @@ VSResourceLib::setMaterial(Material &aMat) {
 
 		std::map<std::string, MaterialSemantics>::iterator iter;
 		for (iter = mMatSemanticMap.begin(); iter != mMatSemanticMap.end(); ++iter) {
-			void *value;
-			switch ((*iter).second) {
-				case DIFFUSE: value = (void *)aMat.diffuse;
-					break;
-				case AMBIENT: value = (void *)aMat.ambient;
-					break;
-				case SPECULAR: value = (void *)aMat.specular;
-					break;
-				case EMISSIVE: value = (void *)aMat.emissive;
-					break;
-				case SHININESS: value = (void *)&aMat.shininess;
-					break;
-				case TEX_COUNT: value = (void *)&aMat.texCount;
-					break;
-			}
+			int size;
+			void *value = getMaterialField(aMat, (*iter).second, size);
 			VSShaderLib::setBlockUniform(sMaterialBlockName, 
 						(*iter).first, value);
 		}
@@ -248,6 +277,30 @@ VSResourceLib::setMaterial(Material &aMat) {
 }
 
 
+void *
+VSResourceLib::getMaterialField(Material &aMat, MaterialSemantics field, int &size) {
+
+	size = 4 * sizeof(float);
+	switch (field) {
+		case DIFFUSE: return (void *)aMat.diffuse;
+		case AMBIENT: return (void *)aMat.ambient;
+		case SPECULAR: return (void *)aMat.specular;
+		case EMISSIVE: return (void *)aMat.emissive;
+		case SHININESS:
+			size = sizeof(float);
+			return (void *)&aMat.shininess;
+		case TEX_LAYER:
+			size = sizeof(int);
+			return (void *)&aMat.texLayer;
+		case TEX_RECT: return (void *)aMat.texRect;
+		case TEX_COUNT:
+		default:
+			size = sizeof(int);
+			return (void *)&aMat.texCount;
+	}
+}
+
+
 void 
 VSResourceLib::setUniformSemantics(MaterialSemantics field, std::string name) {
 
@@ -306,63 +359,41 @@ VSResourceLib::loadRGBATexture(std::string filename,
 	return textureID;
 #else
 
-	ILboolean success;
+	// compression is done by the lib, BC7 if available, else BC1 or BC3
+	bool bptc = VSImageLib::isSupported(VSImageLib::BC7);
+	bool s3tc = VSImageLib::isSupported(VSImageLib::BC1);
+
+	if (!compress || bptc || s3tc) {
+		VSImageLib::Image image;
+		std::string info;
+		VSImageLib::Format format = !compress ? VSImageLib::RGBA8 :
+							bptc ? VSImageLib::BC7 : VSImageLib::BC1;
+		if (!decodeImage(filename, mipmap, format, image, info)) {
+			VSLOG(sLogError, "%s", info.c_str());
+			return 0;
+		}
+		VSLOG(sLogInfo, "%s", info.c_str());
+		return createTexture(image, aFilter, aRepMode);
+	}
+
+	// without the lib's encoders the driver compresses
+	std::lock_guard<std::mutex> lock(sDevILMutex);
+
 	unsigned int imageID;
 	GLuint textureID = 0;
-
-	// Load Texture Map
 	ilGenImages(1, &imageID); 
-	
 	ilBindImage(imageID); /* Binding of DevIL image name */
 	ilEnable(IL_ORIGIN_SET);
 	ilOriginFunc(IL_ORIGIN_LOWER_LEFT); 
-	success = ilLoadImage((ILstring)filename.c_str());
-
-	if (!success) {
+	if (!ilLoadImage((ILstring)filename.c_str())) {
 		VSLOG(sLogError, "Couldn't load texture: %s", 
 							filename.c_str());
-		// The operation was not sucessfull 
-		// hence free image and texture 
 		ilDeleteImages(1, &imageID); 
 		return 0;
 	}
-
-	// add information to the log
-
 	VSLOG(sLogInfo, "Texture Loaded: %s", filename.c_str());
-	printf("Width: %d, Height %d, Bytes per Pixel %d", 
-				ilGetInteger(IL_IMAGE_WIDTH),
-				ilGetInteger(IL_IMAGE_HEIGHT),
-				ilGetInteger(IL_IMAGE_BYTES_PER_PIXEL));
-
-	std::string s;
-	switch(ilGetInteger(IL_IMAGE_FORMAT)) {
-		case IL_COLOR_INDEX      : s =  "IL_COLOR_INDEX"; break;     
-		case IL_ALPHA		     : s =  "IL_ALPHA"; break;	
-		case IL_RGB              : s =  "IL_RGB"; break;     
-		case IL_RGBA             : s =  "IL_RGBA"; break;     
-		case IL_BGR              : s =  "IL_BGR"; break;     
-		case IL_BGRA             : s =  "IL_BGRA"; break;     
-		case IL_LUMINANCE        : s =  "IL_LUMINANCE"; break;     
-		case  IL_LUMINANCE_ALPHA : s =  "IL_LUMINANCE_ALPHA"; break;
-	}
-	printf(" Format %s", s.c_str());
-	
-	switch(ilGetInteger(IL_IMAGE_TYPE)) {
-		case IL_BYTE           : s =  "IL_BYTE"; break;     
-		case IL_UNSIGNED_BYTE  : s =  "IL_UNSIGNED_BYTE"; break;	
-		case IL_SHORT          : s =  "IL_SHORT"; break;     
-		case IL_UNSIGNED_SHORT : s =  "IL_UNSIGNED_SHORT"; break;     
-		case IL_INT            : s =  "IL_INT"; break;     
-		case IL_UNSIGNED_INT   : s =  "IL_UNSIGNED_INT"; break;     
-		case IL_FLOAT          : s =  "IL_FLOAT"; break;     
-		case IL_DOUBLE         : s =  "IL_DOUBLE"; break;
-		case IL_HALF           : s =  "IL_HALF"; break;
-	}
-	printf(" Data type:  %s\n", s.c_str());
-
-	/* Convert image to RGBA */
 	ilConvertImage(IL_RGBA, IL_UNSIGNED_BYTE); 
+
 	// Set filters
 	GLenum minFilter = aFilter;
 	if (aFilter == GL_LINEAR && mipmap) {
@@ -371,12 +402,6 @@ VSResourceLib::loadRGBATexture(std::string filename,
 	else if (aFilter == GL_NEAREST && mipmap){
 		minFilter = GL_NEAREST_MIPMAP_LINEAR;
 	}
-	GLenum type;
-	if (compress)
-		type = GL_RGBA;
-	else
-		type = GL_COMPRESSED_RGBA;
-
 
 	/* Create and load textures to OpenGL */
 	glGenTextures(1, &textureID); /* Texture name generation */
@@ -385,7 +410,7 @@ VSResourceLib::loadRGBATexture(std::string filename,
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, aRepMode);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, aRepMode);
-	glTexImage2D(GL_TEXTURE_2D, 0, type, 
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGBA, 
 					ilGetInteger(IL_IMAGE_WIDTH),
 					ilGetInteger(IL_IMAGE_HEIGHT), 
 					0, GL_RGBA, GL_UNSIGNED_BYTE,
@@ -401,12 +426,121 @@ VSResourceLib::loadRGBATexture(std::string filename,
 	we can release memory used by image. */
 	ilDeleteImages(1, &imageID); 
 
-
 	return textureID;
 #endif
 }
 
 
+#ifndef __ANDROID_API__
+
+bool
+VSResourceLib::decodeImage(const std::string &filename, bool mipmap, VSImageLib::Format format,
+							VSImageLib::Image &image, std::string &info) {
+
+	// the file contents are the key for the cache
+	std::vector<unsigned char> source;
+	FILE *f = fopen(filename.c_str(), "rb");
+	if (f != NULL) {
+		fseek(f, 0, SEEK_END);
+		long size = ftell(f);
+		fseek(f, 0, SEEK_SET);
+		if (size > 0) {
+			source.resize(size);
+			if (fread(&source[0], size, 1, f) != 1)
+				source.clear();
+		}
+		fclose(f);
+	}
+	if (source.empty()) {
+		info = "Couldn't load texture: " + filename;
+		return false;
+	}
+
+	std::string cacheFile;
+	if (mipmap || format != VSImageLib::RGBA8)
+		cacheFile = VSImageLib::getCacheFile(&source[0], source.size(),
+						std::string(format == VSImageLib::RGBA8 ? "RGBA8" :
+									format == VSImageLib::BC7 ? "BC7" : "BC1/BC3") +
+						(mipmap ? VSImageLib::getMipOptionsTag(VSImageLib::getMipOptions()) : ""));
+	if (cacheFile != "" && VSImageLib::loadDDS(cacheFile, image)) {
+		info = "Texture Loaded: " + filename + " (cached " + cacheFile + ")";
+		return true;
+	}
+
+	VSImageLib::Image rgba;
+	rgba.format = VSImageLib::RGBA8;
+	rgba.levels.resize(1);
+	VSImageLib::Level &top = rgba.levels[0];
+	{
+		// DevIL keeps global state
+		std::lock_guard<std::mutex> lock(sDevILMutex);
+		if (!sDevILReady) {
+			ilInit();
+			sDevILReady = true;
+		}
+
+		unsigned int imageID;
+		ilGenImages(1, &imageID);
+		ilBindImage(imageID);
+		ilEnable(IL_ORIGIN_SET);
+		ilOriginFunc(IL_ORIGIN_LOWER_LEFT);
+		if (!ilLoadL(IL_TYPE_UNKNOWN, &source[0], (ILuint)source.size())) {
+			ilDeleteImages(1, &imageID);
+			info = "Couldn't load texture: " + filename;
+			return false;
+		}
+		ilConvertImage(IL_RGBA, IL_UNSIGNED_BYTE);
+		top.width = ilGetInteger(IL_IMAGE_WIDTH);
+		top.height = ilGetInteger(IL_IMAGE_HEIGHT);
+		top.data.assign(ilGetData(), ilGetData() + VSImageLib::getLevelSize(VSImageLib::RGBA8,
+														top.width, top.height));
+		ilDeleteImages(1, &imageID);
+	}
+
+	if (format == VSImageLib::BC1 && !VSImageLib::isOpaque(top))
+		format = VSImageLib::BC3;
+	if (mipmap)
+		VSImageLib::buildMipChain(rgba, VSImageLib::getMipOptions());
+	VSImageLib::compress(rgba, format, image);
+
+	char dims[64];
+	snprintf(dims, 64, " (%ux%u)", top.width, top.height);
+	info = "Texture Loaded: " + filename + dims;
+	if (cacheFile != "" && !VSImageLib::saveDDS(cacheFile, image))
+		info += ", couldn't write texture cache " + cacheFile;
+	return true;
+}
+
+
+GLuint
+VSResourceLib::createTexture(VSImageLib::Image &image, GLenum aFilter, GLenum aRepMode) {
+
+	GLenum minFilter = aFilter;
+	if (image.levels.size() > 1)
+		minFilter = (aFilter == GL_NEAREST) ? GL_NEAREST_MIPMAP_LINEAR : GL_LINEAR_MIPMAP_LINEAR;
+
+	GLuint textureID;
+	glGenTextures(1, &textureID);
+
+	// the texture is defined by the uploader thread, if running
+	std::shared_ptr<VSImageLib::Image> levels = std::make_shared<VSImageLib::Image>();
+	std::swap(*levels, image);
+	VSUploadLib::submitTexture(textureID, [=] {
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, aFilter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, aRepMode);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, aRepMode);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels->levels.size() - 1);
+		VSImageLib::upload(GL_TEXTURE_2D, *levels);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	});
+	return textureID;
+}
+
+#endif
+
+
 // helper function for derived classes
 // loads an image and defines an 8-bit RGBA texture
 unsigned int
@@ -441,6 +575,7 @@ VSResourceLib::loadCubeMapTexture(	std::string posX, std::string negX,
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T,  GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R,  GL_CLAMP_TO_EDGE);
 
+	std::lock_guard<std::mutex> lock(sDevILMutex);
 	ilGenImages(1, &imageID); 
 	ilBindImage(imageID); /* Binding of DevIL image name */
 
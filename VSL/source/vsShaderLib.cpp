@@ -36,6 +36,7 @@
 #include <stdlib.h>
 
 #include "vsShaderLib.h"
+#include "vsMemoryLib.h"
 
 
 // pre conditions are established with asserts
@@ -128,7 +129,7 @@ VSShaderLib::loadShader(VSShaderLib::ShaderType st, std::string fileName) {
 		glAttachShader(pProgram, pShader[st]);
 		glCompileShader(pShader[st]);
 
-		free(s);
+		VSMemoryLib::release(s);
 	}
 }
 
@@ -243,6 +244,70 @@ VSShaderLib::setBlockUniformArrayElement(std::string blockName,
 }
 
 
+bool
+VSShaderLib::getBlockBinding(std::string name, GLuint &bindingIndex, int &size) {
+
+	std::map<std::string, UniformBlock>::iterator iter = spBlocks.find(name);
+	if (iter == spBlocks.end())
+		return false;
+	bindingIndex = iter->second.bindingIndex;
+	size = iter->second.size;
+	return true;
+}
+
+
+int
+VSShaderLib::getBlockUniformOffset(std::string blockName, std::string uniformName) {
+
+	std::map<std::string, UniformBlock>::iterator iter = spBlocks.find(blockName);
+	if (iter == spBlocks.end())
+		return -1;
+
+	std::map<std::string, myBlockUniform> &offsets = iter->second.uniformOffsets;
+	if (offsets.count(uniformName))
+		return offsets[uniformName].offset;
+	std::string uniformComposed = blockName + "." + uniformName;
+	if (offsets.count(uniformComposed))
+		return offsets[uniformComposed].offset;
+	return -1;
+}
+
+
+void
+VSShaderLib::bindBlockBuffer(std::string name) {
+
+	std::map<std::string, UniformBlock>::iterator iter = spBlocks.find(name);
+	if (iter != spBlocks.end())
+		glBindBufferRange(GL_UNIFORM_BUFFER, iter->second.bindingIndex,
+					iter->second.buffer, 0, iter->second.size);
+}
+
+
+unsigned int
+VSShaderLib::getActiveAttribLocations(GLuint program) {
+
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+
+	unsigned int mask = 0;
+	std::vector<char> name(maxLength + 1);
+	for (GLint i = 0; i < count; ++i) {
+		GLint size;
+		GLenum type;
+		glGetActiveAttrib(program, i, maxLength + 1, NULL, &size, &type, &name[0]);
+		GLint location = glGetAttribLocation(program, &name[0]);
+		// matrices take one location per column
+		int columns = (type == GL_FLOAT_MAT4) ? 4 : (type == GL_FLOAT_MAT3) ? 3 :
+						(type == GL_FLOAT_MAT2) ? 2 : 1;
+		for (int c = 0; c < columns * size; ++c)
+			if (location >= 0 && location + c < 32)
+				mask |= 1u << (location + c);
+	}
+	return mask;
+}
+
+
 void 
 VSShaderLib::setUniform(std::string name, int value) {
 
@@ -479,13 +544,13 @@ VSShaderLib::getShaderInfoLog(VSShaderLib::ShaderType st) {
 
 		if (infologLength > 0)
 		{
-			infoLog = (char *)malloc((size_t)infologLength);
+			VSMemoryLib::ScratchScope scope;
+			infoLog = VSMemoryLib::scratchArray<char>((size_t)infologLength);
 			glGetShaderInfoLog(pShader[st], infologLength, &charsWritten, infoLog);
 			if (charsWritten)
 				pResult = infoLog;
 			else
 				pResult= "OK";
-			free(infoLog);
 		}
 		else
 			pResult="OK";
@@ -511,14 +576,14 @@ VSShaderLib::getProgramInfoLog() {
 
 		if (infologLength > 0)
 		{
-			infoLog = (char *)malloc((size_t)infologLength);
+			VSMemoryLib::ScratchScope scope;
+			infoLog = VSMemoryLib::scratchArray<char>((size_t)infologLength);
 			glGetProgramInfoLog(pProgram, infologLength, &charsWritten, infoLog);
 			pResult = infoLog;
 			if (charsWritten)
 				pResult = infoLog;
 			else
 				pResult= "OK";
-			free(infoLog);
 		}
 	}
 	return pResult;
@@ -620,7 +685,7 @@ VSShaderLib::textFileRead(std::string fileName) {
 			rewind(fp);
 
 			if (count > 0) {
-				content = (char *)malloc(sizeof(char) * (count+1));
+				content = VSMemoryLib::allocateArray<char>(count + 1);
 				count = fread(content, sizeof(char), count, fp);
 				content[count] = '\0';
 			}
@@ -636,7 +701,7 @@ VSShaderLib::textFileRead(std::string fileName) {
 		return content;
 	}
 	size_t size = (size_t)AAsset_getLength(asset);
-	content = (char*)malloc(sizeof(char)*size + 1);
+	content = VSMemoryLib::allocateArray<char>(size + 1);
 	AAsset_read(asset, content, size);
 	content[size] = '\0';
 	__android_log_print(ANDROID_LOG_DEBUG, loc, "%s", content);
@@ -653,13 +718,15 @@ VSShaderLib::addBlocks() {
 	int uniType, uniSize, uniOffset, uniMatStride, uniArrayStride, auxSize;
 	char *name, *name2;
 
+	// the names and indices are released at once when done
+	VSMemoryLib::ScratchScope scope;
 	glGetProgramiv(pProgram, GL_ACTIVE_UNIFORM_BLOCKS, &count);
 
 	for (int i = 0; i < count; ++i) {
 		// Get buffers name
 		UniformBlock block;
 		glGetActiveUniformBlockiv(pProgram, i, GL_UNIFORM_BLOCK_NAME_LENGTH, &actualLen);
-		name = (char *)malloc(sizeof(char) * actualLen);
+		name = VSMemoryLib::scratchArray<char>(actualLen);
 		glGetActiveUniformBlockName(pProgram, i, actualLen, NULL, name);
 
 		bool newBlock=true;
@@ -684,11 +751,11 @@ VSShaderLib::addBlocks() {
 		glGetActiveUniformBlockiv(pProgram, i, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &activeUnif);
 
 		unsigned int *indices;
-		indices = (unsigned int *)malloc(sizeof(unsigned int) * activeUnif);
+		indices = VSMemoryLib::scratchArray<unsigned int>(activeUnif);
 		glGetActiveUniformBlockiv(pProgram, i, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, (int *)indices);
 			
 		glGetProgramiv(pProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxUniLength);
-		name2 = (char *)malloc(sizeof(char) * maxUniLength);
+		name2 = VSMemoryLib::scratchArray<char>(maxUniLength);
 
 		for (int k = 0; k < activeUnif; ++k) {
 		
@@ -754,7 +821,6 @@ VSShaderLib::addBlocks() {
 
 
 		}
-		free(name2);
 		if (newBlock) {
 		block.size = dataSize;
 		block.bindingIndex = spBlockCount;
@@ -780,7 +846,8 @@ VSShaderLib::addUniforms() {
 
 	glGetProgramiv(pProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxUniLength);
 
-	name = (char *)malloc(sizeof(char) * maxUniLength);
+	VSMemoryLib::ScratchScope scope;
+	name = VSMemoryLib::scratchArray<char>(maxUniLength);
 
 	unsigned int loc;
 	for (int i = 0; i < count; ++i) {
@@ -794,7 +861,6 @@ VSShaderLib::addUniforms() {
 			addUniform(name, type, size);
 		}
 	}
-	free(name);
 }
 
 
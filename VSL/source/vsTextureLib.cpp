@@ -0,0 +1,670 @@
+/** ----------------------------------------------------------
+ * \class VSTextureLib
+ *
+ * Lighthouse3D
+ *
+ * VSTextureLib - Very Simple Texture Library
+ *
+ * \version 0.1.1
+ *		Textures can be streamed by VSTextureStreamLib
+ *		Textures built from other textures, such as arrays, can be registered
+ *		Memory budget, least recently used textures lose their top levels
+ *
+ * \version 0.1.0
+ *		Initial Release
+ *
+ * This lib keeps a process wide registry of the textures loaded
+ * from image files. Textures are identified by the canonical path
+ * of the image(s) and the parameters used to load them, so that
+ * two resources asking for the same image share a single
+ * OpenGL texture. Textures are reference counted and deleted
+ * when the last user releases them.
+ *
+ * The registry also tracks the memory taken by the textures and
+ * can keep it within a budget (see setBudget).
+ *
+ * Full documentation at
+ * http://www.lighthouse3d.com/very-simple-libs
+ *
+ ---------------------------------------------------------------*/
+
+#include "vsTextureLib.h"
+#include "vsResourceLib.h"
+#include "vsTextureStreamLib.h"
+#include "vsUploadLib.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if !defined(_WIN32)
+#include <limits.h>
+#endif
+
+
+std::map<std::string, GLuint> VSTextureLib::sKeys;
+std::map<GLuint, VSTextureLib::TextureEntry> VSTextureLib::sTextures;
+
+#if !defined(__ANDROID_API__)
+VSLogLib VSTextureLib::sLogError, VSTextureLib::sLogInfo;
+size_t VSTextureLib::sBudget = 0;
+size_t VSTextureLib::sRestorePerUpdate = 16 << 20;
+unsigned int VSTextureLib::sMinResidentSize = 64;
+size_t VSTextureLib::sResidentBytes = 0;
+unsigned int VSTextureLib::sFrame = 0;
+#endif
+
+
+std::string
+VSTextureLib::getCanonicalPath(std::string filename) {
+
+#if defined(_WIN32)
+	char path[_MAX_PATH];
+	if (_fullpath(path, filename.c_str(), _MAX_PATH) != NULL)
+		return std::string(path);
+#elif !defined(__ANDROID_API__)
+	char path[PATH_MAX];
+	if (realpath(filename.c_str(), path) != NULL)
+		return std::string(path);
+#endif
+	// android assets, or files that do not exist, are kept as is
+	return filename;
+}
+
+
+#if defined(__VSL_TEXTURE_LOADING__)
+
+std::string
+VSTextureLib::getTextureKey(const std::string &filename, bool mipmap, bool compress,
+							GLenum aFilter, GLenum aRepMode) {
+
+	char params[64];
+	snprintf(params, 64, "|2D|%d|%d|%x|%x", mipmap, compress, aFilter, aRepMode);
+	return getCanonicalPath(filename) + params;
+}
+
+
+std::string
+VSTextureLib::getCubeMapKey(std::string posX, std::string negX,
+						std::string posY, std::string negY,
+						std::string posZ, std::string negZ) {
+
+	return getCanonicalPath(posX) + "|" + getCanonicalPath(negX) + "|" +
+			getCanonicalPath(posY) + "|" + getCanonicalPath(negY) + "|" +
+			getCanonicalPath(posZ) + "|" + getCanonicalPath(negZ) + "|CUBE";
+}
+
+
+GLuint
+VSTextureLib::acquireTexture(std::string filename, bool mipmap, bool compress,
+							GLenum aFilter, GLenum aRepMode) {
+
+	std::string key = getTextureKey(filename, mipmap, compress, aFilter, aRepMode);
+	GLuint textureID = findTexture(key);
+	if (textureID != 0)
+		return textureID;
+
+#if !defined(__ANDROID_API__)
+	// textures loaded under a budget can be reduced and reloaded
+	if (sBudget > 0) {
+		VSImageLib::Image image;
+		textureID = loadManaged(filename, mipmap, compress, aFilter, aRepMode, image);
+		if (registerTexture(key, textureID, GL_TEXTURE_2D) == 0)
+			return 0;
+
+		TextureEntry &entry = sTextures[textureID];
+		entry.managed = true;
+		entry.filename = filename;
+		entry.mipmap = mipmap;
+		entry.format = image.format;
+		entry.width = image.levels[0].width;
+		entry.height = image.levels[0].height;
+		entry.levels = (int)image.levels.size();
+		setEntryBytes(entry, getManagedBytes(entry, 0));
+		return textureID;
+	}
+#endif
+
+	textureID = VSResourceLib::loadRGBATexture(filename, mipmap, compress,
+											aFilter, aRepMode);
+	return registerTexture(key, textureID, GL_TEXTURE_2D);
+}
+
+
+GLuint
+VSTextureLib::acquireCubeMapTexture(std::string posX, std::string negX,
+						std::string posY, std::string negY,
+						std::string posZ, std::string negZ) {
+
+	std::string key = getCubeMapKey(posX, negX, posY, negY, posZ, negZ);
+	GLuint textureID = findTexture(key);
+	if (textureID != 0)
+		return textureID;
+
+	textureID = VSResourceLib::loadCubeMapTexture(posX, negX,
+											posY, negY, posZ, negZ);
+	return registerTexture(key, textureID, GL_TEXTURE_CUBE_MAP);
+}
+
+
+#if !defined(__ANDROID_API__)
+
+GLuint
+VSTextureLib::acquireTextureAsync(std::string filename, bool mipmap, bool compress,
+							GLenum aFilter, GLenum aRepMode) {
+
+	std::string key = getTextureKey(filename, mipmap, compress, aFilter, aRepMode);
+	GLuint textureID = findTexture(key);
+	if (textureID != 0)
+		return textureID;
+
+	textureID = VSTextureStreamLib::load(filename, mipmap, compress, aFilter, aRepMode);
+	return registerTexture(key, textureID, GL_TEXTURE_2D);
+}
+
+
+GLuint
+VSTextureLib::acquireCubeMapTextureAsync(std::string posX, std::string negX,
+						std::string posY, std::string negY,
+						std::string posZ, std::string negZ) {
+
+	std::string key = getCubeMapKey(posX, negX, posY, negY, posZ, negZ);
+	GLuint textureID = findTexture(key);
+	if (textureID != 0)
+		return textureID;
+
+	textureID = VSTextureStreamLib::loadCubeMap(posX, negX, posY, negY, posZ, negZ);
+	return registerTexture(key, textureID, GL_TEXTURE_CUBE_MAP);
+}
+
+#endif
+
+#endif
+
+
+std::string
+VSTextureLib::getPackedKey(const std::string &kind, const std::vector<GLuint> &sources) {
+
+	std::string key = kind;
+	for (size_t i = 0; i < sources.size(); ++i) {
+		std::map<GLuint, TextureEntry>::iterator iter = sTextures.find(sources[i]);
+		if (iter != sTextures.end())
+			key += "[" + iter->second.key + "]";
+		else {
+			// textures from elsewhere are only known by name
+			char name[32];
+			snprintf(name, 32, "[#%u]", sources[i]);
+			key += name;
+		}
+	}
+	return key;
+}
+
+
+GLuint
+VSTextureLib::acquirePacked(const std::string &key) {
+
+	return findTexture(key);
+}
+
+
+GLuint
+VSTextureLib::registerPacked(const std::string &key, GLuint textureID, GLenum target) {
+
+	return registerTexture(key, textureID, target);
+}
+
+
+GLuint
+VSTextureLib::findTexture(const std::string &key) {
+
+	std::map<std::string, GLuint>::iterator iter = sKeys.find(key);
+	if (iter == sKeys.end())
+		return 0;
+	sTextures[iter->second].refCount++;
+	return iter->second;
+}
+
+
+GLuint
+VSTextureLib::registerTexture(const std::string &key, GLuint textureID, GLenum target) {
+
+	// failed loads are not cached so that they can be retried
+	if (textureID == 0)
+		return 0;
+
+	TextureEntry entry;
+	entry.key = key;
+	entry.target = target;
+	entry.refCount = 1;
+	entry.bytes = 0;
+	entry.measured = false;
+	entry.lastUsed = 0;
+	entry.managed = false;
+	entry.mipmap = false;
+	entry.format = VSImageLib::RGBA8;
+	entry.width = 0;
+	entry.height = 0;
+	entry.levels = 0;
+	entry.dropped = 0;
+
+	sKeys[key] = textureID;
+	TextureEntry &stored = sTextures[textureID] = entry;
+
+#if !defined(__ANDROID_API__)
+	stored.lastUsed = sFrame;
+#if defined(__VSL_TEXTURE_LOADING__)
+	// streamed textures are measured once complete
+	if (VSTextureStreamLib::isPending(textureID))
+		return textureID;
+#endif
+	if (!VSUploadLib::isTextureReady(textureID))
+		return textureID;
+	stored.measured = true;
+	setEntryBytes(stored, measureTexture(textureID, target));
+#endif
+	return textureID;
+}
+
+
+void
+VSTextureLib::retain(GLuint textureID) {
+
+	std::map<GLuint, TextureEntry>::iterator iter = sTextures.find(textureID);
+	if (iter != sTextures.end())
+		iter->second.refCount++;
+}
+
+
+void
+VSTextureLib::release(GLuint textureID) {
+
+	std::map<GLuint, TextureEntry>::iterator iter = sTextures.find(textureID);
+	if (iter == sTextures.end())
+		return;
+
+	iter->second.refCount--;
+	if (iter->second.refCount > 0)
+		return;
+
+#if defined(__VSL_TEXTURE_LOADING__) && !defined(__ANDROID_API__)
+	VSTextureStreamLib::cancel(textureID);
+#endif
+#if !defined(__ANDROID_API__)
+	// the name must not be reused while the uploader writes to it
+	VSUploadLib::waitTexture(textureID);
+#endif
+	glDeleteTextures(1, &textureID);
+#if !defined(__ANDROID_API__)
+	setEntryBytes(iter->second, 0);
+#endif
+	sKeys.erase(iter->second.key);
+	sTextures.erase(iter);
+}
+
+
+bool
+VSTextureLib::isRegistered(GLuint textureID) {
+
+	return sTextures.count(textureID) != 0;
+}
+
+
+int
+VSTextureLib::getRefCount(GLuint textureID) {
+
+	std::map<GLuint, TextureEntry>::iterator iter = sTextures.find(textureID);
+	if (iter == sTextures.end())
+		return 0;
+	return iter->second.refCount;
+}
+
+
+size_t
+VSTextureLib::getTextureCount() {
+
+	return sTextures.size();
+}
+
+
+#if !defined(__ANDROID_API__)
+
+void
+VSTextureLib::setBudget(size_t bytes, size_t restorePerUpdate) {
+
+	sBudget = bytes;
+	sRestorePerUpdate = restorePerUpdate;
+}
+
+
+size_t
+VSTextureLib::getBudget() {
+
+	return sBudget;
+}
+
+
+void
+VSTextureLib::setMinResidentSize(unsigned int texels) {
+
+	sMinResidentSize = texels;
+}
+
+
+void
+VSTextureLib::touch(GLuint textureID) {
+
+	if (sBudget == 0)
+		return;
+	std::map<GLuint, TextureEntry>::iterator iter = sTextures.find(textureID);
+	if (iter != sTextures.end())
+		iter->second.lastUsed = sFrame;
+}
+
+
+size_t
+VSTextureLib::getResidentBytes() {
+
+	return sResidentBytes;
+}
+
+
+size_t
+VSTextureLib::getTextureBytes(GLuint textureID) {
+
+	std::map<GLuint, TextureEntry>::iterator iter = sTextures.find(textureID);
+	if (iter == sTextures.end())
+		return 0;
+	return iter->second.bytes;
+}
+
+
+int
+VSTextureLib::getDroppedLevels(GLuint textureID) {
+
+	std::map<GLuint, TextureEntry>::iterator iter = sTextures.find(textureID);
+	if (iter == sTextures.end())
+		return 0;
+	return iter->second.dropped;
+}
+
+
+void
+VSTextureLib::updateResidency() {
+
+	if (sBudget == 0)
+		return;
+
+	std::map<GLuint, TextureEntry>::iterator iter;
+	for (iter = sTextures.begin(); iter != sTextures.end(); ++iter) {
+		TextureEntry &entry = iter->second;
+#if defined(__VSL_TEXTURE_LOADING__)
+		if (!entry.measured && !VSTextureStreamLib::isPending(iter->first) &&
+#else
+		if (!entry.measured &&
+#endif
+				VSUploadLib::isTextureReady(iter->first)) {
+			entry.measured = true;
+			setEntryBytes(entry, measureTexture(iter->first, entry.target));
+		}
+	}
+
+	// textures bound in this frame get back their levels, as
+	// many as fit once the unused textures have been reduced
+	size_t restored = 0;
+	for (iter = sTextures.begin(); iter != sTextures.end() && restored < sRestorePerUpdate; ++iter) {
+		TextureEntry &entry = iter->second;
+		if (!entry.managed || entry.dropped == 0 || entry.lastUsed != sFrame)
+			continue;
+
+		size_t missing = getManagedBytes(entry, 0) - entry.bytes;
+		reduceResidency(sBudget > missing ? sBudget - missing : 0);
+		int dropped = entry.dropped;
+		while (dropped > 0 &&
+				sResidentBytes - entry.bytes + getManagedBytes(entry, dropped - 1) <= sBudget)
+			dropped--;
+		if (dropped < entry.dropped) {
+			size_t before = entry.bytes;
+			setDroppedLevels(iter->first, entry, dropped);
+			restored += entry.bytes - std::min(before, entry.bytes);
+		}
+	}
+
+	reduceResidency(sBudget);
+	sFrame++;
+}
+
+
+void
+VSTextureLib::reduceResidency(size_t target) {
+
+	if (sResidentBytes <= target)
+		return;
+
+	// least recently used first, textures bound in this frame are kept
+	std::vector<std::pair<unsigned int, GLuint> > candidates;
+	std::map<GLuint, TextureEntry>::iterator iter;
+	for (iter = sTextures.begin(); iter != sTextures.end(); ++iter) {
+		const TextureEntry &entry = iter->second;
+		if (entry.managed && entry.lastUsed != sFrame && entry.dropped < getMaxDropped(entry))
+			candidates.push_back(std::make_pair(entry.lastUsed, iter->first));
+	}
+	std::sort(candidates.begin(), candidates.end());
+
+	for (size_t i = 0; i < candidates.size() && sResidentBytes > target; ++i) {
+		TextureEntry &entry = sTextures[candidates[i].second];
+		int maxDropped = getMaxDropped(entry);
+		int dropped = entry.dropped + 1;
+		while (dropped < maxDropped &&
+				sResidentBytes - entry.bytes + getManagedBytes(entry, dropped) > target)
+			dropped++;
+		setDroppedLevels(candidates[i].second, entry, dropped);
+	}
+}
+
+
+bool
+VSTextureLib::setDroppedLevels(GLuint textureID, TextureEntry &entry, int dropped) {
+
+	int resident = entry.levels - entry.dropped;
+	int kept = entry.levels - dropped;
+
+	if (dropped > entry.dropped && (GLEW_VERSION_4_3 || GLEW_ARB_copy_image)) {
+		// the kept levels go to a temporary texture and back
+		int shift = dropped - entry.dropped;
+		GLuint temp;
+		glGenTextures(1, &temp);
+		glBindTexture(GL_TEXTURE_2D, temp);
+		specifyLevels(entry.format, entry.width, entry.height, entry.levels, dropped, 0, NULL);
+		for (int l = 0; l < kept; ++l) {
+			GLsizei w = std::max(1u, entry.width >> (dropped + l));
+			GLsizei h = std::max(1u, entry.height >> (dropped + l));
+			glCopyImageSubData(textureID, GL_TEXTURE_2D, l + shift, 0, 0, 0,
+							temp, GL_TEXTURE_2D, l, 0, 0, 0, w, h, 1);
+		}
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		specifyLevels(entry.format, entry.width, entry.height, entry.levels, dropped, resident, NULL);
+		for (int l = 0; l < kept; ++l) {
+			GLsizei w = std::max(1u, entry.width >> (dropped + l));
+			GLsizei h = std::max(1u, entry.height >> (dropped + l));
+			glCopyImageSubData(temp, GL_TEXTURE_2D, l, 0, 0, 0,
+							textureID, GL_TEXTURE_2D, l, 0, 0, 0, w, h, 1);
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glDeleteTextures(1, &temp);
+	}
+	else {
+#if defined(__VSL_TEXTURE_LOADING__)
+		// the file may have changed, its levels are taken as they are
+		VSImageLib::Image image;
+		std::string info;
+		if (!VSResourceLib::decodeImage(entry.filename, entry.mipmap, entry.format, image, info)) {
+			VSLOG(sLogError, "%s", info.c_str());
+			return false;
+		}
+		entry.format = image.format;
+		entry.width = image.levels[0].width;
+		entry.height = image.levels[0].height;
+		entry.levels = (int)image.levels.size();
+		dropped = std::min(dropped, getMaxDropped(entry));
+
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		specifyLevels(entry.format, entry.width, entry.height, entry.levels, dropped, resident, &image);
+		glBindTexture(GL_TEXTURE_2D, 0);
+#else
+		return false;
+#endif
+	}
+
+	entry.dropped = dropped;
+	setEntryBytes(entry, getManagedBytes(entry, dropped));
+	return true;
+}
+
+
+void
+VSTextureLib::specifyLevels(VSImageLib::Format format, unsigned int width, unsigned int height,
+						int levels, int first, int previousLevels, const VSImageLib::Image *data) {
+
+	GLenum internalFormat = VSImageLib::getGLFormat(format);
+	int count = levels - first;
+	for (int l = 0; l < count; ++l) {
+		GLsizei w = std::max(1u, width >> (first + l));
+		GLsizei h = std::max(1u, height >> (first + l));
+		const void *pixels = data ? &data->levels[first + l].data[0] : NULL;
+		if (format == VSImageLib::RGBA8)
+			glTexImage2D(GL_TEXTURE_2D, l, internalFormat, w, h, 0,
+						GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+		else
+			glCompressedTexImage2D(GL_TEXTURE_2D, l, internalFormat, w, h, 0,
+						(GLsizei)VSImageLib::getLevelSize(format, w, h), pixels);
+	}
+	// empty levels take no memory
+	for (int l = count; l < previousLevels; ++l)
+		glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, count - 1);
+}
+
+
+size_t
+VSTextureLib::getManagedBytes(const TextureEntry &entry, int dropped) {
+
+	size_t bytes = 0;
+	for (int l = dropped; l < entry.levels; ++l)
+		bytes += VSImageLib::getLevelSize(entry.format,
+					std::max(1u, entry.width >> l), std::max(1u, entry.height >> l));
+	return bytes;
+}
+
+
+int
+VSTextureLib::getMaxDropped(const TextureEntry &entry) {
+
+	int dropped = 0;
+	while (dropped < entry.levels - 1 &&
+			std::max(entry.width >> (dropped + 1), entry.height >> (dropped + 1)) >= sMinResidentSize)
+		dropped++;
+	return dropped;
+}
+
+
+void
+VSTextureLib::setEntryBytes(TextureEntry &entry, size_t bytes) {
+
+	sResidentBytes = sResidentBytes - entry.bytes + bytes;
+	entry.bytes = bytes;
+}
+
+
+size_t
+VSTextureLib::measureTexture(GLuint textureID, GLenum target) {
+
+	GLenum level = (target == GL_TEXTURE_CUBE_MAP) ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : target;
+	size_t faces = (target == GL_TEXTURE_CUBE_MAP) ? 6 : 1;
+	size_t bytes = 0;
+
+	glBindTexture(target, textureID);
+	for (GLint l = 0; l < 16; ++l) {
+		GLint width, height, depth, compressed;
+		glGetTexLevelParameteriv(level, l, GL_TEXTURE_WIDTH, &width);
+		if (width == 0)
+			break;
+		glGetTexLevelParameteriv(level, l, GL_TEXTURE_HEIGHT, &height);
+		glGetTexLevelParameteriv(level, l, GL_TEXTURE_DEPTH, &depth);
+		glGetTexLevelParameteriv(level, l, GL_TEXTURE_COMPRESSED, &compressed);
+		if (compressed) {
+			GLint size;
+			glGetTexLevelParameteriv(level, l, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+			bytes += (size_t)size * faces;
+		}
+		else {
+			const GLenum sizes[6] = { GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE,
+								GL_TEXTURE_ALPHA_SIZE, GL_TEXTURE_DEPTH_SIZE, GL_TEXTURE_STENCIL_SIZE };
+			GLint bits = 0, b;
+			for (int i = 0; i < 6; ++i) {
+				glGetTexLevelParameteriv(level, l, sizes[i], &b);
+				bits += b;
+			}
+			bytes += (size_t)width * height * depth * bits / 8 * faces;
+		}
+	}
+	glBindTexture(target, 0);
+	return bytes;
+}
+
+
+#if defined(__VSL_TEXTURE_LOADING__)
+
+GLuint
+VSTextureLib::loadManaged(const std::string &filename, bool mipmap, bool compress,
+						GLenum aFilter, GLenum aRepMode, VSImageLib::Image &image) {
+
+	// without the lib's encoders textures stay uncompressed
+	VSImageLib::Format format = VSImageLib::RGBA8;
+	if (compress && VSImageLib::isSupported(VSImageLib::BC7))
+		format = VSImageLib::BC7;
+	else if (compress && VSImageLib::isSupported(VSImageLib::BC1))
+		format = VSImageLib::BC1;
+
+	std::string info;
+	if (!VSResourceLib::decodeImage(filename, mipmap, format, image, info)) {
+		VSLOG(sLogError, "%s", info.c_str());
+		return 0;
+	}
+	VSLOG(sLogInfo, "%s", info.c_str());
+
+	GLenum minFilter = aFilter;
+	if (image.levels.size() > 1)
+		minFilter = (aFilter == GL_NEAREST) ? GL_NEAREST_MIPMAP_LINEAR : GL_LINEAR_MIPMAP_LINEAR;
+
+	// mutable, so that levels can be dropped keeping the name
+	GLuint textureID;
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, aFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, aRepMode);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, aRepMode);
+	specifyLevels(image.format, image.levels[0].width, image.levels[0].height,
+				(int)image.levels.size(), 0, 0, &image);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return textureID;
+}
+
+#endif
+
+
+std::string
+VSTextureLib::getErrors() {
+
+	return sLogError.dumpToString();
+}
+
+
+std::string
+VSTextureLib::getInfo() {
+
+	return sLogInfo.dumpToString();
+}
+
+#endif
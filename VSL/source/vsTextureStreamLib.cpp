@@ -0,0 +1,623 @@
+/** ----------------------------------------------------------
+ * \class VSTextureStreamLib
+ *
+ * Lighthouse3D
+ *
+ * VSTextureStreamLib - Very Simple Texture Streaming Library
+ *
+ * \version 0.1.0
+ *		Initial Release
+ *
+ * This lib loads textures without blocking the frame. Images are
+ * decoded, and compressed, by worker threads. The levels are then
+ * copied to a persistently mapped pixel unpack buffer ring and
+ * uploaded from there, the coarsest levels first, a few per frame.
+ * Textures are returned at once with a 1x1 grey image, and sharpen
+ * as levels arrive.
+ *
+ * Full documentation at
+ * http://www.lighthouse3d.com/very-simple-libs
+ *
+ ---------------------------------------------------------------*/
+
+#include "vsTextureStreamLib.h"
+
+#if defined(__VSL_TEXTURE_LOADING__) && !defined(__ANDROID_API__)
+
+#include "vsResourceLib.h"
+#include "vsThreadLib.h"
+
+#include <algorithm>
+#include <vector>
+#include <string.h>
+#include <stdint.h>
+
+
+VSLogLib VSTextureStreamLib::sLogError, VSTextureStreamLib::sLogInfo;
+
+std::mutex VSTextureStreamLib::sMutex;
+std::condition_variable VSTextureStreamLib::sCond;
+std::deque<std::shared_ptr<VSTextureStreamLib::Job> > VSTextureStreamLib::sQueue;
+std::deque<std::shared_ptr<VSTextureStreamLib::Job> > VSTextureStreamLib::sDecoded;
+unsigned int VSTextureStreamLib::sBusy = 0;
+unsigned int VSTextureStreamLib::sMaxWorkers = 0;
+bool VSTextureStreamLib::sStop = false;
+// defined after the mutex, so that it is destroyed first
+VSTextureStreamLib::Worker VSTextureStreamLib::sWorker;
+
+std::map<GLuint, std::shared_ptr<VSTextureStreamLib::Job> > VSTextureStreamLib::sJobs;
+std::deque<std::shared_ptr<VSTextureStreamLib::Job> > VSTextureStreamLib::sUploads;
+
+GLuint VSTextureStreamLib::sRing = 0;
+unsigned char *VSTextureStreamLib::sRingPtr = NULL;
+size_t VSTextureStreamLib::sRingSize = 16 << 20;
+size_t VSTextureStreamLib::sRingHead = 0;
+std::deque<VSTextureStreamLib::Region> VSTextureStreamLib::sRegions;
+size_t VSTextureStreamLib::sUploadBudget = 4 << 20;
+
+
+VSTextureStreamLib::Worker::~Worker() {
+
+	{
+		std::lock_guard<std::mutex> lock(sMutex);
+		sStop = true;
+	}
+	sCond.notify_all();
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+}
+
+
+GLuint
+VSTextureStreamLib::load(std::string filename, bool mipmap, bool compress,
+						GLenum aFilter, GLenum aRepMode) {
+
+	std::shared_ptr<Job> job(new Job());
+	job->target = GL_TEXTURE_2D;
+	job->files[0] = filename;
+	job->faces = 1;
+	job->mipmap = mipmap;
+	// the format is picked here, the worker has no context
+	job->format = VSImageLib::RGBA8;
+	if (compress && VSImageLib::isSupported(VSImageLib::BC7))
+		job->format = VSImageLib::BC7;
+	else if (compress && VSImageLib::isSupported(VSImageLib::BC1))
+		job->format = VSImageLib::BC1;
+	job->filter = aFilter;
+
+	return queue(job, aRepMode);
+}
+
+
+GLuint
+VSTextureStreamLib::loadCubeMap(std::string posX, std::string negX,
+						std::string posY, std::string negY,
+						std::string posZ, std::string negZ) {
+
+	std::shared_ptr<Job> job(new Job());
+	job->target = GL_TEXTURE_CUBE_MAP;
+	job->files[0] = posX;
+	job->files[1] = negX;
+	job->files[2] = posY;
+	job->files[3] = negY;
+	job->files[4] = posZ;
+	job->files[5] = negZ;
+	job->faces = 6;
+	job->mipmap = false;
+	job->format = VSImageLib::RGBA8;
+	job->filter = GL_LINEAR;
+
+	return queue(job, GL_CLAMP_TO_EDGE);
+}
+
+
+GLuint
+VSTextureStreamLib::queue(std::shared_ptr<Job> job, GLenum aRepMode) {
+
+	job->cancelled = false;
+	job->ok = false;
+	job->allocated = false;
+	job->level = 0;
+	job->face = 0;
+	job->ticket = 0;
+
+	// the placeholder, mutable so that the storage can be replaced
+	const unsigned char grey[4] = {128, 128, 128, 255};
+	glGenTextures(1, &job->texture);
+	glBindTexture(job->target, job->texture);
+	glTexParameteri(job->target, GL_TEXTURE_MAG_FILTER, job->filter);
+	glTexParameteri(job->target, GL_TEXTURE_MIN_FILTER, job->filter);
+	glTexParameteri(job->target, GL_TEXTURE_WRAP_S, aRepMode);
+	glTexParameteri(job->target, GL_TEXTURE_WRAP_T, aRepMode);
+	if (job->target == GL_TEXTURE_CUBE_MAP)
+		glTexParameteri(job->target, GL_TEXTURE_WRAP_R, aRepMode);
+	for (unsigned int f = 0; f < job->faces; ++f)
+		glTexImage2D(job->target == GL_TEXTURE_CUBE_MAP ? VSResourceLib::faceTarget[f] : GL_TEXTURE_2D,
+					0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+	glBindTexture(job->target, 0);
+
+	sJobs[job->texture] = job;
+	{
+		std::lock_guard<std::mutex> lock(sMutex);
+		sQueue.push_back(job);
+		// a thread is added when the queue outgrows the idle ones
+		unsigned int maxWorkers = sMaxWorkers != 0 ? sMaxWorkers :
+					std::max(1u, VSThreadLib::getHardwareThreads() / 2);
+		size_t idle = sWorker.threads.size() - sBusy;
+		if (sQueue.size() > idle && sWorker.threads.size() < maxWorkers)
+			sWorker.threads.push_back(std::thread(workerLoop));
+	}
+	sCond.notify_all();
+
+	return job->texture;
+}
+
+
+void
+VSTextureStreamLib::workerLoop() {
+
+	std::unique_lock<std::mutex> lock(sMutex);
+	for (;;) {
+		sCond.wait(lock, [] { return sStop || !sQueue.empty(); });
+		if (sStop)
+			return;
+
+		std::shared_ptr<Job> job = sQueue.front();
+		sQueue.pop_front();
+		sBusy++;
+		lock.unlock();
+
+		if (!job->cancelled)
+			decode(*job);
+
+		lock.lock();
+		sBusy--;
+		if (!job->cancelled)
+			sDecoded.push_back(job);
+		sCond.notify_all();
+	}
+}
+
+
+void
+VSTextureStreamLib::decode(Job &job) {
+
+	if (job.target == GL_TEXTURE_2D) {
+		job.ok = VSResourceLib::decodeImage(job.files[0], job.mipmap, job.format,
+										job.images[0], job.info);
+		return;
+	}
+
+	// the faces are decoded in parallel, DevIL itself is serialized
+	bool ok[6];
+	std::string info[6];
+	VSThreadLib::parallelFor(job.faces, [&job, &ok, &info](unsigned int f) {
+		ok[f] = VSResourceLib::decodeImage(job.files[f], false, VSImageLib::RGBA8,
+										job.images[f], info[f]);
+	});
+
+	for (unsigned int f = 0; f < job.faces; ++f) {
+		job.ok = ok[f];
+		if (!job.ok) {
+			job.info = info[f];
+			return;
+		}
+		if (job.images[f].levels[0].width != job.images[0].levels[0].width ||
+				job.images[f].levels[0].height != job.images[0].levels[0].height) {
+			job.ok = false;
+			job.info = "Cube map faces differ in size: " + job.files[f];
+			return;
+		}
+	}
+	job.info = "Cube Map Loaded: " + job.files[0];
+}
+
+
+void
+VSTextureStreamLib::update() {
+
+	{
+		std::lock_guard<std::mutex> lock(sMutex);
+		for (size_t i = 0; i < sDecoded.size(); ++i) {
+			if (!sDecoded[i]->cancelled)
+				sUploads.push_back(sDecoded[i]);
+		}
+		sDecoded.clear();
+	}
+
+	retireRegions(false);
+	upload(sUploadBudget, false);
+}
+
+
+void
+VSTextureStreamLib::finish() {
+
+	{
+		std::unique_lock<std::mutex> lock(sMutex);
+		sCond.wait(lock, [] { return sQueue.empty() && sBusy == 0; });
+	}
+	update();
+	upload(SIZE_MAX, true);
+}
+
+
+void
+VSTextureStreamLib::upload(size_t budget, bool block) {
+
+	// with the uploader, new textures are uploaded whole by its thread
+	if (VSUploadLib::isRunning()) {
+		for (size_t i = 0; i < sUploads.size(); ++i) {
+			std::shared_ptr<Job> job = sUploads[i];
+			if (job->ticket != 0 || !job->ok || job->allocated)
+				continue;
+			VSLOG(sLogInfo, "%s", job->info.c_str());
+			job->ticket = VSUploadLib::submitTexture(job->texture, [job] {
+				if (!job->cancelled)
+					uploadAll(*job);
+			});
+		}
+	}
+
+	bool progress = false;
+	while (!sUploads.empty()) {
+
+		std::shared_ptr<Job> job = sUploads.front();
+		if (!job->ok) {
+			VSLOG(sLogError, "%s", job->info.c_str());
+			// the placeholder stays
+			sJobs.erase(job->texture);
+			sUploads.pop_front();
+			continue;
+		}
+
+		if (job->ticket != 0) {
+			if (block)
+				VSUploadLib::waitTexture(job->texture);
+			else if (!VSUploadLib::isTextureReady(job->texture))
+				break;
+			sJobs.erase(job->texture);
+			sUploads.pop_front();
+			continue;
+		}
+
+		const VSImageLib::Image &image = job->images[0];
+		if (!job->allocated) {
+			// new textures start only if their coarsest level fits
+			size_t size = image.levels.back().data.size() * job->faces;
+			if (progress && !block && size > budget)
+				break;
+			allocate(*job);
+			VSLOG(sLogInfo, "%s", job->info.c_str());
+		}
+
+		// a level is completed in a single call, the coarsest at once
+		bool force = block || !progress || job->face != 0 ||
+					job->level == (int)image.levels.size() - 1;
+		size_t size = job->images[job->face].levels[job->level].data.size();
+		if (!force && size > budget)
+			break;
+		if (!uploadLevel(*job, force, block))
+			break;
+
+		progress = true;
+		budget -= std::min(size, budget);
+		if (job->level < 0) {
+			sJobs.erase(job->texture);
+			sUploads.pop_front();
+		}
+	}
+}
+
+
+void
+VSTextureStreamLib::allocate(Job &job) {
+
+	const VSImageLib::Image &image = job.images[0];
+	GLsizei levels = (GLsizei)image.levels.size();
+	GLenum internalFormat = VSImageLib::getGLFormat(image.format);
+
+	glBindTexture(job.target, job.texture);
+	if (GLEW_VERSION_4_2 || GLEW_ARB_texture_storage) {
+		glTexStorage2D(job.target, levels, internalFormat,
+					image.levels[0].width, image.levels[0].height);
+	}
+	else {
+		for (unsigned int f = 0; f < job.faces; ++f) {
+			GLenum target = job.target == GL_TEXTURE_CUBE_MAP ? VSResourceLib::faceTarget[f] : job.target;
+			for (GLsizei l = 0; l < levels; ++l) {
+				const VSImageLib::Level &level = image.levels[l];
+				if (image.format == VSImageLib::RGBA8)
+					glTexImage2D(target, l, internalFormat, level.width, level.height, 0,
+								GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+				else
+					glCompressedTexImage2D(target, l, internalFormat, level.width, level.height, 0,
+								(GLsizei)level.data.size(), NULL);
+			}
+		}
+	}
+
+	// only the uploaded levels are sampled
+	GLenum minFilter = job.filter;
+	if (levels > 1)
+		minFilter = (job.filter == GL_NEAREST) ? GL_NEAREST_MIPMAP_LINEAR : GL_LINEAR_MIPMAP_LINEAR;
+	glTexParameteri(job.target, GL_TEXTURE_MIN_FILTER, minFilter);
+	glTexParameteri(job.target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	glTexParameteri(job.target, GL_TEXTURE_BASE_LEVEL, levels - 1);
+	glBindTexture(job.target, 0);
+
+	job.allocated = true;
+	job.level = levels - 1;
+	job.face = 0;
+}
+
+
+void
+VSTextureStreamLib::uploadAll(Job &job) {
+
+	allocate(job);
+
+	glBindTexture(job.target, job.texture);
+	for (; job.level >= 0; job.level--) {
+		for (unsigned int f = 0; f < job.faces; ++f) {
+			VSImageLib::Level &level = job.images[f].levels[job.level];
+			GLenum target = job.target == GL_TEXTURE_CUBE_MAP ? VSResourceLib::faceTarget[f] : job.target;
+			if (job.images[f].format == VSImageLib::RGBA8)
+				glTexSubImage2D(target, job.level, 0, 0, level.width, level.height,
+							GL_RGBA, GL_UNSIGNED_BYTE, &level.data[0]);
+			else
+				glCompressedTexSubImage2D(target, job.level, 0, 0, level.width, level.height,
+							VSImageLib::getGLFormat(job.images[f].format),
+							(GLsizei)level.data.size(), &level.data[0]);
+			std::vector<unsigned char>().swap(level.data);
+		}
+	}
+	glTexParameteri(job.target, GL_TEXTURE_BASE_LEVEL, 0);
+	glBindTexture(job.target, 0);
+}
+
+
+bool
+VSTextureStreamLib::uploadLevel(Job &job, bool force, bool block) {
+
+	VSImageLib::Level &level = job.images[job.face].levels[job.level];
+	GLenum internalFormat = VSImageLib::getGLFormat(job.images[job.face].format);
+	GLenum target = job.target == GL_TEXTURE_CUBE_MAP ? VSResourceLib::faceTarget[job.face] : job.target;
+	GLsizei size = (GLsizei)level.data.size();
+
+	if (sRing == 0)
+		createRing();
+	long long offset = allocateRing(size, block);
+	if (offset < 0 && !force)
+		return false;
+
+	const void *pixels = &level.data[0];
+	if (offset >= 0) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, sRing);
+		if (sRingPtr != NULL)
+			memcpy(sRingPtr + offset, &level.data[0], size);
+		else
+			glBufferSubData(GL_PIXEL_UNPACK_BUFFER, (GLintptr)offset, size, &level.data[0]);
+		pixels = (const void *)(size_t)offset;
+	}
+
+	glBindTexture(job.target, job.texture);
+	if (job.images[job.face].format == VSImageLib::RGBA8)
+		glTexSubImage2D(target, job.level, 0, 0, level.width, level.height,
+					GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	else
+		glCompressedTexSubImage2D(target, job.level, 0, 0, level.width, level.height,
+					internalFormat, size, pixels);
+
+	if (offset >= 0) {
+		Region region;
+		region.offset = (size_t)offset;
+		region.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		sRegions.push_back(region);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	std::vector<unsigned char>().swap(level.data);
+
+	job.face++;
+	if (job.face == job.faces) {
+		job.face = 0;
+		glTexParameteri(job.target, GL_TEXTURE_BASE_LEVEL, job.level);
+		job.level--;
+	}
+	glBindTexture(job.target, 0);
+	return true;
+}
+
+
+long long
+VSTextureStreamLib::allocateRing(size_t size, bool block) {
+
+	// offsets are kept aligned for any pixel format
+	size = (size + 15) & ~(size_t)15;
+	if (size > sRingSize)
+		return -1;
+
+	for (;;) {
+		retireRegions(false);
+
+		// the regions are in use from the oldest to the head
+		long long offset = -1;
+		if (sRegions.empty())
+			offset = 0;
+		else {
+			size_t tail = sRegions.front().offset;
+			if (sRingHead >= tail) {
+				if (sRingHead + size <= sRingSize)
+					offset = sRingHead;
+				// the head never reaches the tail
+				else if (size < tail)
+					offset = 0;
+			}
+			else if (sRingHead + size < tail)
+				offset = sRingHead;
+		}
+
+		if (offset >= 0) {
+			sRingHead = (size_t)offset + size;
+			return offset;
+		}
+		if (!block)
+			return -1;
+		retireRegions(true);
+	}
+}
+
+
+void
+VSTextureStreamLib::retireRegions(bool block) {
+
+	while (!sRegions.empty()) {
+		// when blocking, only the oldest region is waited for
+		GLenum result = block ?
+			glClientWaitSync(sRegions.front().fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) :
+			glClientWaitSync(sRegions.front().fence, 0, 0);
+		if (result == GL_TIMEOUT_EXPIRED)
+			return;
+		glDeleteSync(sRegions.front().fence);
+		sRegions.pop_front();
+		block = false;
+	}
+}
+
+
+void
+VSTextureStreamLib::createRing() {
+
+	glGenBuffers(1, &sRing);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, sRing);
+	if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_PIXEL_UNPACK_BUFFER, sRingSize, NULL, flags);
+		sRingPtr = (unsigned char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, sRingSize, flags);
+	}
+	else
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, sRingSize, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	sRingHead = 0;
+}
+
+
+void
+VSTextureStreamLib::deleteRing() {
+
+	for (size_t i = 0; i < sRegions.size(); ++i)
+		glDeleteSync(sRegions[i].fence);
+	sRegions.clear();
+
+	if (sRing == 0)
+		return;
+	// the buffer is released by the driver once the pending uploads are done
+	if (sRingPtr != NULL) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, sRing);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		sRingPtr = NULL;
+	}
+	glDeleteBuffers(1, &sRing);
+	sRing = 0;
+}
+
+
+void
+VSTextureStreamLib::cancel(GLuint textureID) {
+
+	std::map<GLuint, std::shared_ptr<Job> >::iterator iter = sJobs.find(textureID);
+	if (iter == sJobs.end())
+		return;
+
+	// the workers drop cancelled jobs
+	iter->second->cancelled = true;
+	for (size_t i = 0; i < sUploads.size(); ++i) {
+		if (sUploads[i] == iter->second) {
+			sUploads.erase(sUploads.begin() + i);
+			break;
+		}
+	}
+	sJobs.erase(iter);
+}
+
+
+bool
+VSTextureStreamLib::isPending(GLuint textureID) {
+
+	return sJobs.count(textureID) != 0;
+}
+
+
+unsigned int
+VSTextureStreamLib::getPendingCount() {
+
+	return (unsigned int)sJobs.size();
+}
+
+
+void
+VSTextureStreamLib::setRingSize(size_t bytes) {
+
+	if (bytes == sRingSize)
+		return;
+	deleteRing();
+	sRingSize = bytes;
+}
+
+
+void
+VSTextureStreamLib::setUploadBudget(size_t bytes) {
+
+	sUploadBudget = bytes;
+}
+
+
+void
+VSTextureStreamLib::setWorkerCount(unsigned int count) {
+
+	std::lock_guard<std::mutex> lock(sMutex);
+	sMaxWorkers = count;
+}
+
+
+void
+VSTextureStreamLib::shutdown() {
+
+	{
+		std::lock_guard<std::mutex> lock(sMutex);
+		sStop = true;
+		for (size_t i = 0; i < sQueue.size(); ++i)
+			sQueue[i]->cancelled = true;
+	}
+	sCond.notify_all();
+	for (size_t i = 0; i < sWorker.threads.size(); ++i)
+		sWorker.threads[i].join();
+	sWorker.threads.clear();
+
+	{
+		std::lock_guard<std::mutex> lock(sMutex);
+		sStop = false;
+		sQueue.clear();
+		sDecoded.clear();
+	}
+	sJobs.clear();
+	sUploads.clear();
+	deleteRing();
+}
+
+
+std::string
+VSTextureStreamLib::getErrors() {
+
+	return sLogError.dumpToString();
+}
+
+
+std::string
+VSTextureStreamLib::getInfo() {
+
+	return sLogInfo.dumpToString();
+}
+
+#endif
@@ -0,0 +1,146 @@
+/** ----------------------------------------------------------
+ * \class VSThreadLib
+ *
+ * Lighthouse3D
+ *
+ * VSThreadLib - Very Simple Thread Library
+ *
+ * \version 0.1.0
+ *		Initial Release
+ *
+ * This lib provides helpers to spread CPU work, such as
+ * mesh processing, across the available cores, with a pool
+ * of worker threads.
+ *
+ * Full documentation at
+ * http://www.lighthouse3d.com/very-simple-libs
+ *
+ ---------------------------------------------------------------*/
+
+#include "vsThreadLib.h"
+
+
+std::mutex VSThreadLib::sMutex;
+std::condition_variable VSThreadLib::sWork;
+std::condition_variable VSThreadLib::sDone;
+std::deque<VSThreadLib::Batch *> VSThreadLib::sBatches;
+bool VSThreadLib::sStop = false;
+// declared after the queue, so that it is joined before the queue is destroyed
+VSThreadLib::Pool VSThreadLib::sPool;
+
+
+VSThreadLib::Pool::~Pool() {
+
+	{
+		std::lock_guard<std::mutex> lock(sMutex);
+		sStop = true;
+	}
+	sWork.notify_all();
+	for (unsigned int t = 0; t < threads.size(); ++t)
+		threads[t].join();
+}
+
+
+unsigned int
+VSThreadLib::getHardwareThreads() {
+
+	unsigned int n = std::thread::hardware_concurrency();
+	return n == 0 ? 1 : n;
+}
+
+
+unsigned int
+VSThreadLib::getWorkerCount() {
+
+	std::lock_guard<std::mutex> lock(sMutex);
+	return (unsigned int)sPool.threads.size();
+}
+
+
+void
+VSThreadLib::runJobs(Batch &batch) {
+
+	for (unsigned int i = batch.next++; i < batch.count; i = batch.next++)
+		(*batch.job)(i);
+}
+
+
+VSThreadLib::Batch *
+VSThreadLib::findBatch() {
+
+	for (unsigned int b = 0; b < sBatches.size(); ++b) {
+		Batch *batch = sBatches[b];
+		if (batch->joined < batch->helpers && batch->next < batch->count)
+			return batch;
+	}
+	return NULL;
+}
+
+
+void
+VSThreadLib::workerLoop() {
+
+	std::unique_lock<std::mutex> lock(sMutex);
+	for (;;) {
+		Batch *batch = NULL;
+		sWork.wait(lock, [&] { return sStop || (batch = findBatch()) != NULL; });
+		if (sStop)
+			break;
+
+		batch->joined++;
+		batch->active++;
+		lock.unlock();
+		runJobs(*batch);
+		lock.lock();
+		if (--batch->active == 0)
+			sDone.notify_all();
+	}
+}
+
+
+void
+VSThreadLib::parallelFor(unsigned int count,
+						const std::function<void(unsigned int)> &job,
+						unsigned int maxThreads) {
+
+	if (count == 0)
+		return;
+
+	unsigned int threads = maxThreads == 0 ? getHardwareThreads() : maxThreads;
+	if (threads > count)
+		threads = count;
+
+	if (threads <= 1) {
+		for (unsigned int i = 0; i < count; ++i)
+			job(i);
+		return;
+	}
+
+	Batch batch;
+	batch.job = &job;
+	batch.count = count;
+	batch.next = 0;
+	batch.helpers = threads - 1;
+	batch.joined = 0;
+	batch.active = 0;
+	{
+		std::lock_guard<std::mutex> lock(sMutex);
+		while (sPool.threads.size() < threads - 1)
+			sPool.threads.push_back(std::thread(workerLoop));
+		sBatches.push_back(&batch);
+	}
+	sWork.notify_all();
+
+	// the calling thread takes jobs as well, so nested calls
+	// complete even when all the workers are busy
+	runJobs(batch);
+
+	std::unique_lock<std::mutex> lock(sMutex);
+	for (unsigned int b = 0; b < sBatches.size(); ++b) {
+		if (sBatches[b] == &batch) {
+			sBatches.erase(sBatches.begin() + b);
+			break;
+		}
+	}
+	sDone.wait(lock, [&] { return batch.active == 0; });
+}
@@ -0,0 +1,286 @@
+/** ----------------------------------------------------------
+ * \class VSUploadLib
+ *
+ * Lighthouse3D
+ *
+ * VSUploadLib - Very Simple Upload Library
+ *
+ * \version 0.1.0
+ *		Initial Release
+ *
+ * This lib moves buffer and texture uploads off the render
+ * thread, to a thread with a context that shares objects with the
+ * render context. Jobs are fenced, and the fences checked by the
+ * render thread before the objects are used.
+ *
+ * Full documentation at
+ * http://www.lighthouse3d.com/very-simple-libs
+ *
+ ---------------------------------------------------------------*/
+
+#include "vsUploadLib.h"
+
+#if !defined(__ANDROID_API__)
+
+#include <vector>
+
+
+VSLogLib VSUploadLib::sLogError;
+
+std::mutex VSUploadLib::sMutex;
+std::condition_variable VSUploadLib::sCond;
+std::map<VSUploadLib::Ticket, VSUploadLib::Job> VSUploadLib::sJobs;
+std::deque<VSUploadLib::Ticket> VSUploadLib::sQueue;
+bool VSUploadLib::sRunning = false;
+bool VSUploadLib::sStop = false;
+// declared after the queue, so that it is joined before the queue is destroyed
+VSUploadLib::Worker VSUploadLib::sWorker;
+
+std::map<GLuint, VSUploadLib::Ticket> VSUploadLib::sTextures;
+VSUploadLib::Ticket VSUploadLib::sNextTicket = 1;
+
+
+VSUploadLib::Worker::~Worker() {
+
+	{
+		std::lock_guard<std::mutex> lock(sMutex);
+		sStop = true;
+	}
+	sCond.notify_all();
+	if (thread.joinable())
+		thread.join();
+}
+
+
+bool
+VSUploadLib::start(const std::function<bool()> &makeCurrent,
+				const std::function<void()> &doneCurrent) {
+
+	if (sWorker.thread.joinable())
+		return sRunning;
+
+	int result = -1;
+	sWorker.thread = std::thread(workerLoop, makeCurrent, doneCurrent, &result);
+	{
+		std::unique_lock<std::mutex> lock(sMutex);
+		sCond.wait(lock, [&] { return result != -1; });
+	}
+	if (result == 0) {
+		sWorker.thread.join();
+		VSLOG(sLogError, "Couldn't make the uploader context current, uploads stay in the render thread");
+		return false;
+	}
+	return true;
+}
+
+
+void
+VSUploadLib::stop() {
+
+	{
+		std::lock_guard<std::mutex> lock(sMutex);
+		sStop = true;
+	}
+	sCond.notify_all();
+	if (sWorker.thread.joinable())
+		sWorker.thread.join();
+
+	std::lock_guard<std::mutex> lock(sMutex);
+	sStop = false;
+}
+
+
+bool
+VSUploadLib::isRunning() {
+
+	std::lock_guard<std::mutex> lock(sMutex);
+	return sRunning;
+}
+
+
+void
+VSUploadLib::workerLoop(std::function<bool()> makeCurrent,
+					std::function<void()> doneCurrent, int *result) {
+
+	bool current = makeCurrent();
+	std::unique_lock<std::mutex> lock(sMutex);
+	*result = current ? 1 : 0;
+	sRunning = current;
+	sCond.notify_all();
+	if (!current)
+		return;
+
+	for (;;) {
+		// queued jobs are run before stopping
+		sCond.wait(lock, [] { return sStop || !sQueue.empty(); });
+		if (sQueue.empty())
+			break;
+
+		Ticket ticket = sQueue.front();
+		sQueue.pop_front();
+		std::function<void()> work;
+		work.swap(sJobs[ticket].work);
+		GLsync start = sJobs[ticket].start;
+		lock.unlock();
+
+		// objects set up by the render thread, such as placeholders,
+		// are complete before the job changes them
+		glWaitSync(start, 0, GL_TIMEOUT_IGNORED);
+		glDeleteSync(start);
+		work();
+		GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		// the render thread polls the fence from its own context
+		glFlush();
+
+		lock.lock();
+		Job &job = sJobs[ticket];
+		job.fence = fence;
+		job.done = true;
+		sCond.notify_all();
+	}
+
+	sRunning = false;
+	lock.unlock();
+	if (doneCurrent)
+		doneCurrent();
+}
+
+
+VSUploadLib::Ticket
+VSUploadLib::submit(const std::function<void()> &job) {
+
+	Ticket ticket = sNextTicket++;
+	if (sNextTicket == 0)
+		sNextTicket = 1;
+
+	std::unique_lock<std::mutex> lock(sMutex);
+	if (sRunning && !sStop) {
+		GLsync start = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glFlush();
+		Job &queued = sJobs[ticket];
+		queued.work = job;
+		queued.start = start;
+		queued.done = false;
+		queued.fence = 0;
+		sQueue.push_back(ticket);
+		sCond.notify_all();
+		return ticket;
+	}
+	lock.unlock();
+
+	// no uploader, the ticket is ready at once
+	job();
+	return ticket;
+}
+
+
+VSUploadLib::Ticket
+VSUploadLib::submitTexture(GLuint textureID, const std::function<void()> &job) {
+
+	Ticket ticket = submit(job);
+	if (!isReady(ticket))
+		sTextures[textureID] = ticket;
+	return ticket;
+}
+
+
+bool
+VSUploadLib::retire(Ticket ticket, bool block) {
+
+	GLsync fence;
+	{
+		std::unique_lock<std::mutex> lock(sMutex);
+		std::map<Ticket, Job>::iterator iter = sJobs.find(ticket);
+		// tickets not found are done, or never existed
+		if (iter == sJobs.end())
+			return true;
+		if (!iter->second.done) {
+			if (!block)
+				return false;
+			sCond.wait(lock, [&] { return iter->second.done; });
+		}
+		fence = iter->second.fence;
+	}
+
+	// the uploader flushed the fence, so waiting on it ends
+	for (;;) {
+		GLenum result = glClientWaitSync(fence, 0, block ? 1000000000 : 0);
+		if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED ||
+				result == GL_WAIT_FAILED)
+			break;
+		if (!block)
+			return false;
+	}
+	glDeleteSync(fence);
+
+	std::lock_guard<std::mutex> lock(sMutex);
+	sJobs.erase(ticket);
+	return true;
+}
+
+
+bool
+VSUploadLib::isReady(Ticket ticket) {
+
+	return retire(ticket, false);
+}
+
+
+void
+VSUploadLib::wait(Ticket ticket) {
+
+	retire(ticket, true);
+}
+
+
+bool
+VSUploadLib::checkTexture(GLuint textureID, bool block) {
+
+	std::map<GLuint, Ticket>::iterator iter = sTextures.find(textureID);
+	if (iter == sTextures.end())
+		return true;
+	if (!retire(iter->second, block))
+		return false;
+	sTextures.erase(iter);
+	return true;
+}
+
+
+void
+VSUploadLib::waitTexture(GLuint textureID) {
+
+	checkTexture(textureID, true);
+}
+
+
+void
+VSUploadLib::finish() {
+
+	std::vector<Ticket> tickets;
+	{
+		std::lock_guard<std::mutex> lock(sMutex);
+		std::map<Ticket, Job>::iterator iter;
+		for (iter = sJobs.begin(); iter != sJobs.end(); ++iter)
+			tickets.push_back(iter->first);
+	}
+	for (size_t i = 0; i < tickets.size(); ++i)
+		retire(tickets[i], true);
+	sTextures.clear();
+}
+
+
+unsigned int
+VSUploadLib::getPendingCount() {
+
+	std::lock_guard<std::mutex> lock(sMutex);
+	return (unsigned int)sJobs.size();
+}
+
+
+std::string
+VSUploadLib::getErrors() {
+
+	return sLogError.dumpToString();
+}
+
+#endif
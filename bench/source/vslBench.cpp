@@ -0,0 +1,820 @@
+//
+// Lighthouse3D.com VS*L OpenGL Benchmark
+//
+// Renders scripted stress scenes in a headless context, along a
+// fixed camera path, and writes the frame timings as JSON
+//
+// Uses:
+//  EGL, surfaceless, for a context without a window, so that it
+//		runs on Mesa llvmpipe without a GPU
+//  Assimp 3.0 library for model loading
+//		http://assimp.sourceforge.net/
+//  GLEW for OpenGL post 1.1 functions
+//		http://glew.sourceforge.net/
+//	TinyXML for font definition parsing
+//		http://sourceforge.net/projects/tinyxml/
+//
+// Usage:
+//	vsl_bench [--scene name] [--frames n] [--warmup n] [--copies n]
+//			  [--submeshes n] [--width w] [--height h] [--per-frame]
+//			  [--out file]
+//
+// Scenes: models, instanced, submeshes, surfrev, text, debug.
+// All scenes are run by default.
+//
+// Per frame, cpu is the time taken to issue the frame, gpu is
+// measured with GL_TIME_ELAPSED queries, and frame is the time
+// between the start of consecutive frames. Query results are read
+// a few frames later, so that the CPU does not wait for the GPU.
+// On Linux, cache_misses counts the hardware cache misses of the
+// thread issuing the frame, during render, with perf events. It is
+// null when the counter is not available, for instance when
+// perf_event_paranoid forbids it.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// include GLEW to access OpenGL 3.3 functions
+#include <GL/glew.h>
+
+// EGL creates the context without a window
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+// Use Very Simple Libs
+#include <vsl/vslibs.h>
+
+#include "config.h"
+
+// queries are read this many frames after being issued
+#define QUERY_LATENCY 4
+
+VSMathLib *vsml;
+VSShaderLib program, programInstanced, programFonts;
+
+float lightDir[4] = { 1.0f, 1.0f, 1.0f, 0.0f };
+
+// Command line options
+std::string sceneName, outFile;
+unsigned int frames = 200, warmup = 20;
+unsigned int copies = 64, submeshes = 50000;
+int width = 1280, height = 720;
+bool perFrame = false;
+
+
+// ------------------------------------------------------------
+//
+// Scenes
+//
+
+// A scene is built once, and then rendered for each frame.
+// render returns the draw calls issued by VSL
+class Scene {
+
+public:
+	virtual ~Scene() {}
+	virtual const char *getName() = 0;
+	virtual bool build() = 0;
+	virtual unsigned int render() = 0;
+	/// the distance of the camera to the scene center
+	virtual float getRadius() = 0;
+	std::string mError;
+};
+
+
+// N copies of bench.obj, each drawn with its own model matrix
+class ModelsScene : public Scene {
+
+public:
+	VSModelLib mModel;
+	unsigned int mSide;
+
+	const char *getName() { return "models"; }
+
+	bool build() {
+		if (!mModel.load(std::string(PATH_TO_FILES) + "models/bench.obj")) {
+			mError = mModel.getErrors();
+			return false;
+		}
+		mSide = (unsigned int)ceil(sqrt((double)copies));
+		return true;
+	}
+
+	unsigned int render() {
+		unsigned int draws = 0;
+		glUseProgram(program.getProgramIndex());
+		for (unsigned int i = 0; i < copies; ++i) {
+			vsml->pushMatrix(VSMathLib::MODEL);
+			vsml->translate(VSMathLib::MODEL, 3.0f * (i % mSide) - 1.5f * mSide,
+							0.0f, 3.0f * (i / mSide) - 1.5f * mSide);
+			mModel.render();
+			vsml->popMatrix(VSMathLib::MODEL);
+			draws += mModel.getRenderStats().draws;
+		}
+		return draws;
+	}
+
+	float getRadius() { return 2.0f * mSide + 5.0f; }
+};
+
+
+// the same copies, drawn with per instance matrices
+class InstancedScene : public ModelsScene {
+
+public:
+	const char *getName() { return "instanced"; }
+
+	bool build() {
+		if (!ModelsScene::build())
+			return false;
+		std::vector<float> matrices;
+		for (unsigned int i = 0; i < copies; ++i) {
+			float m[16] = { 1.0f, 0.0f, 0.0f, 0.0f,
+							0.0f, 1.0f, 0.0f, 0.0f,
+							0.0f, 0.0f, 1.0f, 0.0f,
+							3.0f * (i % mSide) - 1.5f * mSide, 0.0f,
+							3.0f * (i / mSide) - 1.5f * mSide, 1.0f };
+			matrices.insert(matrices.end(), m, m + 16);
+		}
+		mModel.setInstanceMatrices(copies, &matrices[0]);
+		return true;
+	}
+
+	unsigned int render() {
+		glUseProgram(programInstanced.getProgramIndex());
+		mModel.render(copies);
+		return mModel.getRenderStats().draws;
+	}
+};
+
+
+// A single model with many small meshes, each with its own
+// transform and material, sharing one cube's buffers
+class SubmeshModel : public VSModelLib {
+
+public:
+	unsigned int mSide;
+
+	void build(unsigned int count) {
+
+		float p[24 * 4], n[24 * 3], tc[24 * 2];
+		unsigned int indices[36];
+		for (int f = 0; f < 6; ++f) {
+			int axis = f / 2;
+			float sign = (f % 2) ? -1.0f : 1.0f;
+			for (int v = 0; v < 4; ++v) {
+				float c[3];
+				c[axis] = sign * 0.5f;
+				c[(axis + 1) % 3] = ((v == 1 || v == 2) ? 0.5f : -0.5f) * sign;
+				c[(axis + 2) % 3] = (v >= 2) ? 0.5f : -0.5f;
+				int k = f * 4 + v;
+				p[k * 4 + 0] = c[0]; p[k * 4 + 1] = c[1]; p[k * 4 + 2] = c[2]; p[k * 4 + 3] = 1.0f;
+				n[k * 3 + 0] = axis == 0 ? sign : 0.0f;
+				n[k * 3 + 1] = axis == 1 ? sign : 0.0f;
+				n[k * 3 + 2] = axis == 2 ? sign : 0.0f;
+				tc[k * 2 + 0] = (v == 1 || v == 2) ? 1.0f : 0.0f;
+				tc[k * 2 + 1] = (v >= 2) ? 1.0f : 0.0f;
+			}
+			unsigned int quad[6] = { 0, 1, 2, 0, 2, 3 };
+			for (int i = 0; i < 6; ++i)
+				indices[f * 6 + i] = f * 4 + quad[i];
+		}
+		addMesh(24, p, n, tc, NULL, NULL, 36, indices);
+
+		mSide = (unsigned int)ceil(sqrt((double)count));
+		MyMesh cube = mMyMeshes[0];
+		mMyMeshes.clear();
+		mMyMeshes.reserve(count);
+		for (unsigned int i = 0; i < count; ++i) {
+			MyMesh m = cube;
+			m.transform[12] = 1.5f * (i % mSide) - 0.75f * mSide;
+			m.transform[14] = 1.5f * (i / mSide) - 0.75f * mSide;
+			// a few distinct materials, as in a real scene
+			m.mat.diffuse[0] = 0.2f + 0.1f * (i % 8);
+			m.mat.diffuse[1] = 0.2f + 0.1f * ((i / 8) % 8);
+			m.mat.diffuse[2] = 0.5f;
+			m.mat.ambient[0] = m.mat.ambient[1] = m.mat.ambient[2] = 0.1f;
+			mMyMeshes.push_back(m);
+		}
+		invalidateDrawOrder();
+	}
+};
+
+
+class SubmeshScene : public Scene {
+
+public:
+	SubmeshModel mModel;
+
+	const char *getName() { return "submeshes"; }
+
+	bool build() {
+		mModel.build(submeshes);
+		return true;
+	}
+
+	unsigned int render() {
+		glUseProgram(program.getProgramIndex());
+		mModel.render();
+		return mModel.getRenderStats().draws;
+	}
+
+	float getRadius() { return 0.6f * mModel.mSide + 5.0f; }
+};
+
+
+// A grid of surfaces of revolution, of all the kinds
+class SurfRevScene : public Scene {
+
+public:
+	VSSurfRevLib mSurfaces[5];
+	unsigned int mSide;
+
+	const char *getName() { return "surfrev"; }
+
+	bool build() {
+		mSurfaces[0].createSphere(0.5f, 32);
+		mSurfaces[1].createTorus(0.2f, 0.5f, 32, 16);
+		mSurfaces[2].createCylinder(1.0f, 0.4f, 32, 4);
+		mSurfaces[3].createCone(1.0f, 0.5f, 32);
+		mSurfaces[4].createPawn();
+		float color[4] = { 0.8f, 0.6f, 0.4f, 1.0f };
+		for (int i = 0; i < 5; ++i)
+			mSurfaces[i].setColor(VSResourceLib::DIFFUSE, color);
+		mSide = (unsigned int)ceil(sqrt((double)copies * 4));
+		return true;
+	}
+
+	unsigned int render() {
+		unsigned int draws = 0;
+		glUseProgram(program.getProgramIndex());
+		for (unsigned int i = 0; i < mSide * mSide; ++i) {
+			vsml->pushMatrix(VSMathLib::MODEL);
+			vsml->translate(VSMathLib::MODEL, 1.5f * (i % mSide) - 0.75f * mSide,
+							0.0f, 1.5f * (i / mSide) - 0.75f * mSide);
+			mSurfaces[i % 5].render();
+			vsml->popMatrix(VSMathLib::MODEL);
+			draws += mSurfaces[i % 5].getRenderStats().draws;
+		}
+		return draws;
+	}
+
+	float getRadius() { return 0.6f * mSide + 5.0f; }
+};
+
+
+#if (__VSL_FONT_LOADING__ == 1)
+
+// Sentences prepared again for every frame, as a HUD does
+class TextScene : public Scene {
+
+public:
+	VSFontLib mFont;
+	std::vector<unsigned int> mSentences;
+
+	const char *getName() { return "text"; }
+
+	bool build() {
+		if (!mFont.load(std::string(PATH_TO_FILES) + "fonts/couriernew10")) {
+			mError = "Could not load fonts/couriernew10";
+			return false;
+		}
+		mFont.setFixedFont(true);
+		mFont.setColor(1.0f, 0.5f, 0.25f, 1.0f);
+		for (unsigned int i = 0; i < 40; ++i)
+			mSentences.push_back(mFont.genSentence());
+		return true;
+	}
+
+	unsigned int render() {
+		static unsigned int count = 0;
+		glUseProgram(programFonts.getProgramIndex());
+		char s[128];
+		for (unsigned int i = 0; i < mSentences.size(); ++i) {
+			sprintf(s, "Line %2u frame %6u: the quick brown fox jumps over the lazy dog", i, count);
+			mFont.prepareSentence(mSentences[i], s);
+			mFont.renderSentence(10, 10 + 16 * i, mSentences[i]);
+		}
+		count++;
+		return (unsigned int)mSentences.size();
+	}
+
+	float getRadius() { return 5.0f; }
+};
+
+#endif
+
+
+// Grid, axis, and many points and vectors drawn in batches
+class DebugScene : public Scene {
+
+public:
+	VSGrid mGrid;
+	VSAxis mAxis;
+	std::vector<VSPoint> mPoints;
+	std::vector<VSVector> mVectors;
+
+	const char *getName() { return "debug"; }
+
+	bool build() {
+		mGrid.set(VSGrid::Y, 10, 100);
+		mAxis.set(5, 0.02f);
+		mPoints.resize(copies * 16);
+		mVectors.resize(copies * 16);
+		for (unsigned int i = 0; i < mPoints.size(); ++i) {
+			float a = i * 0.618f * 6.2832f, r = 0.25f * sqrtf((float)i);
+			Point3 p(r * cosf(a), 0.1f * (i % 10), r * sinf(a));
+			mPoints[i].set(p, 0.05f);
+			mVectors[i].set(p, Point3(p.x, p.y + 0.5f, p.z), 0.01f);
+		}
+		return true;
+	}
+
+	unsigned int render() {
+		glUseProgram(program.getProgramIndex());
+		mGrid.render();
+		mAxis.render();
+		unsigned int draws = mGrid.getRenderStats().draws + mAxis.getRenderStats().draws;
+		for (unsigned int i = 0; i < mPoints.size(); ++i) {
+			mPoints[i].addToBatch();
+			mVectors[i].addToBatch();
+		}
+		glUseProgram(programInstanced.getProgramIndex());
+		VSCartesian::renderBatch();
+		// one instanced call per primitive kind
+		return draws + 3;
+	}
+
+	float getRadius() { return 0.25f * sqrtf((float)mPoints.size()) + 5.0f; }
+};
+
+
+// ------------------------------------------------------------
+//
+// Timing
+//
+
+struct FrameStats {
+	double cpu, gpu, frame, cacheMisses;
+	unsigned int draws;
+	GLuint primitives;
+};
+
+
+// Hardware cache misses of the calling thread, user space only
+class CacheCounter {
+
+public:
+	int mFD;
+
+	CacheCounter() : mFD(-1) {
+#ifdef __linux__
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		mFD = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		if (mFD >= 0)
+			ioctl(mFD, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+	}
+
+	~CacheCounter() {
+#ifdef __linux__
+		if (mFD >= 0)
+			close(mFD);
+#endif
+	}
+
+	bool isAvailable() { return mFD >= 0; }
+
+	/// the misses counted so far
+	double read() {
+		unsigned long long count = 0;
+#ifdef __linux__
+		if (mFD >= 0 && ::read(mFD, &count, sizeof(count)) != sizeof(count))
+			count = 0;
+#endif
+		return (double)count;
+	}
+};
+
+
+// nearest rank percentile of sorted values
+double percentile(const std::vector<double> &sorted, double p) {
+
+	if (sorted.empty())
+		return 0.0;
+	size_t rank = (size_t)ceil(p / 100.0 * sorted.size());
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+
+void writeSummary(std::ostream &out, const char *name, std::vector<double> values) {
+
+	std::sort(values.begin(), values.end());
+	double sum = 0.0;
+	for (size_t i = 0; i < values.size(); ++i)
+		sum += values[i];
+
+	char s[512];
+	sprintf(s, "\"%s\": {\"mean\": %.4f, \"min\": %.4f, \"p50\": %.4f, \"p90\": %.4f, "
+			"\"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}",
+			name, values.empty() ? 0.0 : sum / values.size(),
+			values.empty() ? 0.0 : values.front(),
+			percentile(values, 50), percentile(values, 90),
+			percentile(values, 95), percentile(values, 99),
+			values.empty() ? 0.0 : values.back());
+	out << s;
+}
+
+
+// ------------------------------------------------------------
+//
+// Render a scene along the camera path
+//
+
+bool runScene(Scene &scene, std::ostream &out) {
+
+	fprintf(stderr, "Scene %s\n", scene.getName());
+	if (!scene.build()) {
+		fprintf(stderr, "%s\n", scene.mError.c_str());
+		out << "{\"name\": \"" << scene.getName() << "\", \"error\": \"build failed\"}";
+		return false;
+	}
+
+	const VSRenderTargetLib::Target *target =
+		VSRenderTargetLib::acquire(VSRenderTargetLib::Desc(width, height));
+	if (target == NULL) {
+		fprintf(stderr, "%s\n", VSRenderTargetLib::getErrors().c_str());
+		out << "{\"name\": \"" << scene.getName() << "\", \"error\": \"render target failed\"}";
+		return false;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+	glViewport(0, 0, width, height);
+
+	vsml->loadIdentity(VSMathLib::PROJECTION);
+	vsml->perspective(53.13f, (float)width / height, 0.1f, 10000.0f);
+
+	GLuint timeQ[QUERY_LATENCY], primQ[QUERY_LATENCY];
+	glGenQueries(QUERY_LATENCY, timeQ);
+	glGenQueries(QUERY_LATENCY, primQ);
+
+	unsigned int total = warmup + frames;
+	std::vector<FrameStats> stats(total);
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point previous = Clock::now();
+	float radius = scene.getRadius();
+	CacheCounter cacheCounter;
+
+	for (unsigned int f = 0; f < total + QUERY_LATENCY; ++f) {
+
+		// results of older frames, the queries are then reused
+		if (f >= QUERY_LATENCY) {
+			GLuint64 ns;
+			unsigned int old = f - QUERY_LATENCY;
+			glGetQueryObjectui64v(timeQ[old % QUERY_LATENCY], GL_QUERY_RESULT, &ns);
+			glGetQueryObjectuiv(primQ[old % QUERY_LATENCY], GL_QUERY_RESULT, &stats[old].primitives);
+			stats[old].gpu = ns / 1000000.0;
+		}
+		if (f >= total)
+			continue;
+
+		Clock::time_point start = Clock::now();
+		if (f > 0)
+			stats[f - 1].frame = std::chrono::duration<double, std::milli>(start - previous).count();
+		previous = start;
+
+		glBeginQuery(GL_TIME_ELAPSED, timeQ[f % QUERY_LATENCY]);
+		glBeginQuery(GL_PRIMITIVES_GENERATED, primQ[f % QUERY_LATENCY]);
+
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		// an orbit with a changing distance and height, the same
+		// for every run
+		float t = (float)f / total;
+		float alpha = t * 6.2832f;
+		float r = radius * (1.0f + 0.25f * sinf(2.0f * alpha));
+		float camY = radius * (0.4f + 0.2f * cosf(alpha));
+		vsml->loadIdentity(VSMathLib::VIEW);
+		vsml->loadIdentity(VSMathLib::MODEL);
+		vsml->lookAt(r * sinf(alpha), camY, r * cosf(alpha), 0, 0, 0, 0, 1, 0);
+
+		float res[4];
+		vsml->multMatrixPoint(VSMathLib::VIEW, lightDir, res);
+		vsml->normalize(res);
+		program.setBlockUniform("Lights", "l_dir", res);
+
+		double misses = cacheCounter.read();
+		stats[f].draws = scene.render();
+		stats[f].cacheMisses = cacheCounter.read() - misses;
+
+		glEndQuery(GL_PRIMITIVES_GENERATED);
+		glEndQuery(GL_TIME_ELAPSED);
+		// as a swap would, so that the GPU works while the next frame is issued
+		glFlush();
+
+		VSRenderTargetLib::update();
+		stats[f].cpu = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+	glFinish();
+	stats[total - 1].frame = std::chrono::duration<double, std::milli>(Clock::now() - previous).count();
+
+	glDeleteQueries(QUERY_LATENCY, timeQ);
+	glDeleteQueries(QUERY_LATENCY, primQ);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	VSRenderTargetLib::release(target);
+
+	GLenum error = glGetError();
+	if (error != GL_NO_ERROR)
+		fprintf(stderr, "OpenGL error 0x%x\n", error);
+
+	// the warmup frames are left out
+	std::vector<double> cpu, gpu, frame, cacheMisses;
+	double draws = 0, primitives = 0;
+	for (unsigned int f = warmup; f < total; ++f) {
+		cpu.push_back(stats[f].cpu);
+		gpu.push_back(stats[f].gpu);
+		frame.push_back(stats[f].frame);
+		cacheMisses.push_back(stats[f].cacheMisses);
+		draws += stats[f].draws;
+		primitives += stats[f].primitives;
+	}
+
+	out << "{\"name\": \"" << scene.getName() << "\", \"frames\": " << frames
+		<< ", \"draws\": " << (unsigned int)(draws / frames)
+		<< ", \"primitives\": " << (unsigned int)(primitives / frames)
+		<< ", \"gl_error\": " << error << ",\n\t\t";
+	writeSummary(out, "cpu_ms", cpu);
+	out << ",\n\t\t";
+	writeSummary(out, "gpu_ms", gpu);
+	out << ",\n\t\t";
+	writeSummary(out, "frame_ms", frame);
+	out << ",\n\t\t";
+	if (cacheCounter.isAvailable())
+		writeSummary(out, "cache_misses", cacheMisses);
+	else
+		out << "\"cache_misses\": null";
+	if (perFrame) {
+		out << ",\n\t\t\"per_frame\": [";
+		char s[128];
+		for (unsigned int f = warmup; f < total; ++f) {
+			sprintf(s, "%s\n\t\t\t{\"cpu\": %.4f, \"gpu\": %.4f, \"frame\": %.4f, \"draws\": %u}",
+					f > warmup ? "," : "", stats[f].cpu, stats[f].gpu, stats[f].frame, stats[f].draws);
+			out << s;
+		}
+		out << "]";
+	}
+	out << "}";
+
+	fprintf(stderr, "  cpu p50 %.3f ms  gpu p50 %.3f ms  draws %u\n",
+			percentile(cpu, 50), percentile(gpu, 50), (unsigned int)(draws / frames));
+	return true;
+}
+
+
+// --------------------------------------------------------
+//
+// Shader Stuff
+//
+
+bool setupShaders() {
+
+	std::string path = PATH_TO_FILES;
+	// Shader for fonts
+	programFonts.init();
+	programFonts.loadShader(VSShaderLib::VERTEX_SHADER, path + "shaders/color.vert");
+	programFonts.loadShader(VSShaderLib::FRAGMENT_SHADER, path + "shaders/color.frag");
+	programFonts.setProgramOutput(0,"outputF");
+	programFonts.setVertexAttribName(VSShaderLib::VERTEX_COORD_ATTRIB, "position");
+	programFonts.setVertexAttribName(VSShaderLib::TEXTURE_COORD_ATTRIB, "texCoord");
+	programFonts.prepareProgram();
+	programFonts.setUniform("texUnit", 0);
+
+	// Shader for models
+	program.init();
+	program.loadShader(VSShaderLib::VERTEX_SHADER, path + "shaders/pixeldirdifambspec.vert");
+	program.loadShader(VSShaderLib::FRAGMENT_SHADER, path + "shaders/pixeldirdifambspec.frag");
+	program.setProgramOutput(0, "colorOut");
+	program.setVertexAttribName(VSShaderLib::VERTEX_COORD_ATTRIB, "position");
+	program.setVertexAttribName(VSShaderLib::TEXTURE_COORD_ATTRIB, "texCoord");
+	program.setVertexAttribName(VSShaderLib::NORMAL_ATTRIB, "normal");
+	program.prepareProgram();
+	program.setUniform("texUnit", 0);
+
+	// Shader for instanced models
+	programInstanced.init();
+	programInstanced.loadShader(VSShaderLib::VERTEX_SHADER, path + "shaders/pixeldirdifambspec_instanced.vert");
+	programInstanced.loadShader(VSShaderLib::FRAGMENT_SHADER, path + "shaders/pixeldirdifambspec.frag");
+	programInstanced.setProgramOutput(0, "colorOut");
+	programInstanced.setVertexAttribName(VSShaderLib::VERTEX_COORD_ATTRIB, "position");
+	programInstanced.setVertexAttribName(VSShaderLib::TEXTURE_COORD_ATTRIB, "texCoord");
+	programInstanced.setVertexAttribName(VSShaderLib::NORMAL_ATTRIB, "normal");
+	programInstanced.setVertexAttribName(VSShaderLib::INSTANCE_MATRIX_ATTRIB, "instanceMatrix");
+	programInstanced.prepareProgram();
+	programInstanced.setUniform("texUnit", 0);
+
+	if (!program.isProgramValid() || !programInstanced.isProgramValid()) {
+		fprintf(stderr, "%s\n%s\n", program.getAllInfoLogs().c_str(),
+				programInstanced.getAllInfoLogs().c_str());
+		return false;
+	}
+	return true;
+}
+
+
+// ------------------------------------------------------------
+//
+// Headless context
+//
+
+bool createContext() {
+
+	// the surfaceless platform needs neither a window system nor a GPU
+	EGLDisplay display = EGL_NO_DISPLAY;
+	const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (extensions && strstr(extensions, "EGL_MESA_platform_surfaceless") && getPlatformDisplay)
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	if (display == EGL_NO_DISPLAY)
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+		fprintf(stderr, "Could not initialize EGL\n");
+		return false;
+	}
+
+	EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE };
+	EGLConfig config;
+	EGLint count;
+	if (!eglChooseConfig(display, configAttribs, &config, 1, &count) || count == 0) {
+		fprintf(stderr, "No EGL config for OpenGL\n");
+		return false;
+	}
+	eglBindAPI(EGL_OPENGL_API);
+
+	// the highest core version available
+	int versions[4][2] = { {4, 6}, {4, 5}, {4, 3}, {3, 3} };
+	EGLContext context = EGL_NO_CONTEXT;
+	for (int i = 0; i < 4 && context == EGL_NO_CONTEXT; ++i) {
+		EGLint contextAttribs[] = {
+			EGL_CONTEXT_MAJOR_VERSION, versions[i][0],
+			EGL_CONTEXT_MINOR_VERSION, versions[i][1],
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE };
+		context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+	}
+	if (context == EGL_NO_CONTEXT) {
+		fprintf(stderr, "Could not create an OpenGL 3.3 context\n");
+		return false;
+	}
+
+	// rendering goes to framebuffer objects, no surface is needed
+	if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		EGLint surfaceAttribs[] = { EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE };
+		EGLSurface surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+		if (!eglMakeCurrent(display, surface, surface, context)) {
+			fprintf(stderr, "Could not make the context current\n");
+			return false;
+		}
+	}
+	return true;
+}
+
+
+void initVSL() {
+
+	// set the material's block name
+	VSResourceLib::setMaterialBlockName("Material");
+
+	// Init VSML
+	vsml = VSMathLib::getInstance();
+	vsml->setUniformBlockName("Matrices");
+	vsml->setUniformName(VSMathLib::PROJ_VIEW_MODEL, "m_pvm");
+	vsml->setUniformName(VSMathLib::NORMAL, "m_normal");
+	vsml->setUniformName(VSMathLib::VIEW_MODEL, "m_viewModel");
+}
+
+
+// ------------------------------------------------------------
+//
+// Main function
+//
+
+int main(int argc, char **argv) {
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--scene" && hasValue) sceneName = argv[++i];
+		else if (arg == "--frames" && hasValue) frames = atoi(argv[++i]);
+		else if (arg == "--warmup" && hasValue) warmup = atoi(argv[++i]);
+		else if (arg == "--copies" && hasValue) copies = atoi(argv[++i]);
+		else if (arg == "--submeshes" && hasValue) submeshes = atoi(argv[++i]);
+		else if (arg == "--width" && hasValue) width = atoi(argv[++i]);
+		else if (arg == "--height" && hasValue) height = atoi(argv[++i]);
+		else if (arg == "--out" && hasValue) outFile = argv[++i];
+		else if (arg == "--per-frame") perFrame = true;
+		else {
+			fprintf(stderr, "Usage: %s [--scene name] [--frames n] [--warmup n] [--copies n]\n"
+					"\t[--submeshes n] [--width w] [--height h] [--per-frame] [--out file]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (frames == 0 || copies == 0 || width <= 0 || height <= 0) {
+		fprintf(stderr, "frames, copies, width and height must be positive\n");
+		return 1;
+	}
+
+	if (!createContext())
+		return 1;
+
+//	Init GLEW
+	glewExperimental = GL_TRUE;
+	GLenum glewError = glewInit();
+	if (glewError != GLEW_OK) {
+		fprintf(stderr, "GLEW: %s\n", glewGetErrorString(glewError));
+		return 1;
+	}
+	// glewInit may leave an error behind in core profiles
+	glGetError();
+	if (!glewIsSupported("GL_VERSION_3_3")) {
+		fprintf(stderr, "OpenGL 3.3 not supported\n");
+		return 1;
+	}
+
+	initVSL();
+	if (!setupShaders())
+		return 1;
+
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_CULL_FACE);
+	glClearColor(0.25f, 0.25f, 0.25f, 0.25f);
+
+	std::vector<Scene *> scenes;
+	scenes.push_back(new ModelsScene());
+	scenes.push_back(new InstancedScene());
+	scenes.push_back(new SubmeshScene());
+	scenes.push_back(new SurfRevScene());
+#if (__VSL_FONT_LOADING__ == 1)
+	scenes.push_back(new TextScene());
+#endif
+	scenes.push_back(new DebugScene());
+
+	std::ostringstream out;
+	out << "{\n\t\"renderer\": \"" << (const char *)glGetString(GL_RENDERER) << "\",\n"
+		<< "\t\"version\": \"" << (const char *)glGetString(GL_VERSION) << "\",\n"
+		<< "\t\"width\": " << width << ", \"height\": " << height
+		<< ", \"warmup\": " << warmup << ", \"copies\": " << copies
+		<< ", \"submeshes\": " << submeshes << ",\n"
+		<< "\t\"scenes\": [";
+
+	bool ok = true, first = true, found = false;
+	for (size_t i = 0; i < scenes.size(); ++i) {
+		if (!sceneName.empty() && sceneName != scenes[i]->getName())
+			continue;
+		found = true;
+		out << (first ? "\n\t\t" : ",\n\t\t");
+		first = false;
+		ok = runScene(*scenes[i], out) && ok;
+		delete scenes[i];
+		scenes[i] = NULL;
+	}
+	out << "\n\t]\n}\n";
+	for (size_t i = 0; i < scenes.size(); ++i)
+		delete scenes[i];
+
+	if (!found) {
+		fprintf(stderr, "Unknown scene %s\n", sceneName.c_str());
+		return 1;
+	}
+
+	if (outFile.empty())
+		printf("%s", out.str().c_str());
+	else {
+		std::ofstream file(outFile.c_str());
+		file << out.str();
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1 @@
+#define PATH_TO_FILES "/root/repo/demo/../"
@@ -44,7 +44,7 @@
 #include "config.h"
 
 VSMathLib *vsml;
-VSShaderLib program, programFonts;
+VSShaderLib program, programInstanced, programFonts;
 
 #if (__VSL_FONT_LOADING__ == 1) && (__VSL_TEXTURE_LOADING__ == 1)
 VSFontLib vsfl;
@@ -127,19 +127,14 @@ void renderScene(void) {
 		{
 			PROFILE_GL("Render models");
 
-			// set the shader to render models
-			glUseProgram(program.getProgramIndex());
 			// start counting primitives
 			glBeginQuery(GL_PRIMITIVES_GENERATED, counterQ);
-			// render array of models
-			for (float x = -2.0f ; x < 3.0f ; x += 2.0f) {
-				for (float z = -2.0f; z < 3.0f ; z += 2.0f) {
-					vsml->pushMatrix(VSMathLib::MODEL);
-					vsml->translate(VSMathLib::MODEL, x, 0.0f, z);
-					myModel.render();
-					vsml->popMatrix(VSMathLib::MODEL);
-				}
-			}
+			// render array of models, the translations
+			// are per instance attributes
+			glUseProgram(programInstanced.getProgramIndex());
+			myModel.render(myModel.getInstanceCount());
+			// set the shader to render the other models
+			glUseProgram(program.getProgramIndex());
 			axis.render();
 			gridY.render();
 
@@ -369,7 +364,23 @@ GLuint setupShaders() {
 	// set sampler uniform
 	program.setUniform("texUnit", 0);
 
-	return program.isProgramValid();
+	// Shader for instanced models
+	programInstanced.init();
+	programInstanced.loadShader(VSShaderLib::VERTEX_SHADER, path + "shaders/pixeldirdifambspec_instanced.vert");
+	programInstanced.loadShader(VSShaderLib::FRAGMENT_SHADER, path + "shaders/pixeldirdifambspec.frag");
+
+	programInstanced.setProgramOutput(0, "colorOut");
+	programInstanced.setVertexAttribName(VSShaderLib::VERTEX_COORD_ATTRIB, "position");
+	programInstanced.setVertexAttribName(VSShaderLib::TEXTURE_COORD_ATTRIB, "texCoord");
+	programInstanced.setVertexAttribName(VSShaderLib::NORMAL_ATTRIB, "normal");
+	programInstanced.setVertexAttribName(VSShaderLib::INSTANCE_MATRIX_ATTRIB, "instanceMatrix");
+
+	programInstanced.prepareProgram();
+
+	printf("InfoLog for Instanced Model Shader\n%s\n", programInstanced.getAllInfoLogs().c_str());
+	programInstanced.setUniform("texUnit", 0);
+
+	return program.isProgramValid() && programInstanced.isProgramValid();
 }
 
 
@@ -389,6 +400,19 @@ int init()
 
 		printf("%s\n",myModel.getInfo().c_str());
 
+		// a 3x3 array of models, drawn with a single call
+		std::vector<float> matrices;
+		for (float x = -2.0f ; x < 3.0f ; x += 2.0f) {
+			for (float z = -2.0f; z < 3.0f ; z += 2.0f) {
+				float m[16] = { 1.0f, 0.0f, 0.0f, 0.0f,
+								0.0f, 1.0f, 0.0f, 0.0f,
+								0.0f, 0.0f, 1.0f, 0.0f,
+								x, 0.0f, z, 1.0f };
+				matrices.insert(matrices.end(), m, m + 16);
+			}
+		}
+		myModel.setInstanceMatrices(9, &matrices[0]);
+
 
 		axis.set(5, 0.02f);
 		
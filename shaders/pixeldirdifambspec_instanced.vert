@@ -0,0 +1,31 @@
+#version 330
+
+layout (std140) uniform Matrices {
+	mat4 m_pvm;
+	mat4 m_viewModel;
+	mat3 m_normal;
+};
+
+in vec4 position;	// local space
+in vec3 normal;		// local space
+in vec2 texCoord;
+// per instance, advances once per instance
+in mat4 instanceMatrix;
+
+// the data to be sent to the fragment shader
+out Data {
+	vec3 normal;
+	vec2 texCoord;
+	vec4 eye;
+} DataOut;
+
+void main () {
+
+	vec4 pos = instanceMatrix * position;
+
+	DataOut.texCoord = texCoord;
+	DataOut.normal = normalize(m_normal * mat3(instanceMatrix) * normal);
+	DataOut.eye = -(m_viewModel * pos);
+
+	gl_Position = m_pvm * pos;
+}